@@ -58,6 +58,23 @@ extern unsigned int desc_blen_max;
 extern unsigned int h2c_timeout;
 extern unsigned int c2h_timeout;
 
+#define XDMA_REG_BUF_MAX	32
+
+/* user buffer pinned and dma-mapped by IOCTL_XDMA_BUF_REGISTER */
+struct xdma_reg_buf {
+	struct xdma_cdev *xcdev;
+	struct file *owner;		/* registering file, dropped on close */
+	unsigned long addr;
+	size_t len;
+	struct page **pages;
+	unsigned int pages_nr;
+	struct sg_table sgt;		/* mapped, nents = mapped entries */
+	enum dma_data_direction dir;
+	atomic_t busy;			/* a transfer is using the buffer */
+	struct kiocb *iocb;		/* async transfer in flight */
+	struct xdma_io_cb cb;
+};
+
 struct xdma_cdev {
 	unsigned long magic;		/* structure ID for sanity checks */
 	struct xdma_pci_dev *xpdev;
@@ -70,6 +87,7 @@ struct xdma_cdev {
 	struct xdma_user_irq *user_irq;	/* IRQ value, if needed */
 	struct device *sys_device;	/* sysfs device */
 	spinlock_t lock;
+	struct xdma_reg_buf *reg_buf[XDMA_REG_BUF_MAX]; /* under lock */
 };
 
 /* XDMA PCIe device specific book-keeping */
@@ -140,6 +140,124 @@ ssize_t xdma_xfer_submit_nowait(void *cb_hndl, void *dev_hndl, int channel, bool
 ssize_t xdma_xfer_completion(void *cb_hndl, void *dev_hndl, int channel, bool write, u64 ep_addr,
 			struct sg_table *sgt, bool dma_mapped, int timeout_ms);
 
+/*
+ * xdma_engine_abort - stop the engine and cancel all transfers queued on it
+ *	asynchronous requests get io_done(-ECANCELED) and must still be
+ *	released with xdma_xfer_completion()
+ * @channel: channel number (< channel_max)
+ * @write: true for H2C, false for C2H
+ * return < 0 in case of error
+ */
+int xdma_engine_abort(void *dev_hndl, int channel, bool write);
+
+/*
+ * hybrid interrupt / busy-poll completion
+ *	xdma_engine_poll_wb - turn on descriptor writeback for one engine while
+ *		keeping its completion interrupts (applies from the next start)
+ *	xdma_engine_poll_completion - spin up to @budget_us on the writeback
+ *		area; if the oldest pending transfer/ring slot completes, the
+ *		engine is serviced in the caller's context.
+ *		returns 1 serviced, 0 budget expired, < 0 error
+ */
+int xdma_engine_poll_wb(void *dev_hndl, int channel, bool write, bool enable);
+int xdma_engine_poll_completion(void *dev_hndl, int channel, bool write,
+				unsigned int budget_us);
+
+/*
+ * xdma_engine_irq_ns - ktime_get_ns() of the last completion interrupt (or
+ *	busy-poll hit) that kicked the engine service; read it from io_done()/
+ *	frame_done() to split DMA time from bottom-half latency.
+ *	returns 0 for an unknown engine
+ */
+u64 xdma_engine_irq_ns(void *dev_hndl, int channel, bool write);
+
+/*
+ * xdma_engine_cmpl_cpu - CPU of the completion thread polling the engine's
+ *	writeback (poll_mode), -1 when completions come from the interrupt
+ */
+int xdma_engine_cmpl_cpu(void *dev_hndl, int channel, bool write);
+
+/*
+ * xdma_engine_irq_line / xdma_user_irq_line - Linux IRQ number of an engine's
+ *	or a user interrupt's MSI-X vector, e.g. to set an affinity hint;
+ *	-1 when MSI-X is not in use (shared MSI/legacy line)
+ */
+int xdma_engine_irq_line(void *dev_hndl, int channel, bool write);
+int xdma_user_irq_line(void *dev_hndl, unsigned int user);
+
+/*
+ * xdma_sg_desc_count - # of descriptors a transfer of the dma-mapped @sgt
+ *	takes: DMA-contiguous entries are merged, then split at desc_blen_max
+ */
+unsigned int xdma_sg_desc_count(struct sg_table *sgt);
+
+/*
+ * prebuilt descriptor chains
+ *	xdma_chain_build - build the descriptors for the first @len bytes of a
+ *		dma-mapped sg table once; the sgt must stay mapped until
+ *		xdma_chain_free(). returns ERR_PTR() in case of error
+ *	xdma_chain_submit - queue the chain and wait, returns # of bytes
+ *	xdma_chain_submit_nowait - queue the chain, returns -EIOCBQUEUED;
+ *		cb->io_done() is called on completion or cancel
+ *	xdma_chain_completion - result of the last nowait run (call from io_done)
+ *	xdma_chain_mark - also interrupt once the first @offset bytes landed,
+ *		returns the descriptor count that io_progress() reports then
+ *	xdma_chain_desc_count - # of descriptors the chain was built with
+ * a chain can only be queued once at a time and is never freed by libxdma
+ */
+struct xdma_chain;
+
+struct xdma_chain *xdma_chain_build(void *dev_hndl, int channel, bool write,
+				    u64 ep_addr, struct sg_table *sgt,
+				    unsigned int len);
+void xdma_chain_free(struct xdma_chain *chain);
+ssize_t xdma_chain_submit(struct xdma_chain *chain, int timeout_ms);
+ssize_t xdma_chain_submit_nowait(void *cb_hndl, struct xdma_chain *chain);
+ssize_t xdma_chain_completion(struct xdma_chain *chain);
+int xdma_chain_mark(struct xdma_chain *chain, unsigned int offset);
+unsigned int xdma_chain_desc_count(struct xdma_chain *chain);
+
+/*
+ * cyclic C2H ring (AXI-ST only)
+ *	the engine runs continuously over a self-linked ring of @slots frame
+ *	slots; every slot carries one prebuilt chain (copied in) and raises
+ *	an interrupt on its last descriptor. EOP in the writeback results
+ *	marks the frame boundary, a frame ending early or late makes the
+ *	engine restart on the next slot.
+ *	both callbacks are called with the engine lock held (atomic context):
+ *	refill - return the cookie of the next caller buffer and its chain,
+ *		NULL to put the scratch chain in the slot (frame is dropped)
+ *	frame_done - a slot finished; @cookie is NULL for scratch frames,
+ *		@err is 0, -EIO (error/misaligned frame) or -ECANCELED (stop)
+ *	frame_progress - optional, a xdma_chain_mark() point of the slot in
+ *		progress was reached; @desc_done counts from the slot start
+ *	xdma_ring_create - allocate the slots, the engine is not touched yet
+ *	xdma_ring_start - fill every slot via refill() and start the engine
+ *	xdma_ring_kick - refill slots holding scratch, call after new buffers
+ *		became available
+ *	xdma_ring_stop - stop the engine, frame_done(-ECANCELED) every cookie
+ *	xdma_ring_destroy - free the ring (after xdma_ring_stop)
+ * while a ring is running the engine rejects regular transfers (-EBUSY)
+ */
+struct xdma_ring;
+
+struct xdma_ring_ops {
+	void *(*refill)(void *priv, struct xdma_chain **chain);
+	void (*frame_done)(void *priv, void *cookie, ssize_t bytes, int err);
+	void (*frame_progress)(void *priv, void *cookie,
+			       unsigned int desc_done);
+};
+
+struct xdma_ring *xdma_ring_create(void *dev_hndl, int channel,
+				   unsigned int slots,
+				   unsigned int slot_desc_max,
+				   struct xdma_chain *scratch,
+				   const struct xdma_ring_ops *ops, void *priv);
+int xdma_ring_start(struct xdma_ring *ring);
+void xdma_ring_kick(struct xdma_ring *ring);
+void xdma_ring_stop(struct xdma_ring *ring);
+void xdma_ring_destroy(struct xdma_ring *ring);
+
 			
 
 /////////////////////missing API////////////////////
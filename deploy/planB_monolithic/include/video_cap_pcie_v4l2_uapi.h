@@ -0,0 +1,89 @@
+/*
+ * video_cap_pcie_v4l2_uapi.h - planB V4L2 驱动的私有事件/元数据格式定义（内核/用户态共用）
+ */
+
+#ifndef __VIDEO_CAP_PCIE_V4L2_UAPI_H__
+#define __VIDEO_CAP_PCIE_V4L2_UAPI_H__
+
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+/*
+ * 分片交付（slices 模块参数）：
+ * 帧的前 lines 行已经写进 buffer 时发出，订阅 VIDIOC_SUBSCRIBE_EVENT(type, id=0)。
+ * - index：正在接收的 vb2 buffer index（已 QBUF、尚未 DQBUF）
+ * - sequence：这一帧完成后将带上的 v4l2_buffer.sequence
+ * - lines/height：已就绪行数 / 整帧行数（lines==height 的事件不发，等 DQBUF）
+ * 事件自带的 timestamp（CLOCK_MONOTONIC）即该分片落地的时刻。
+ */
+#define VIDEO_CAP_EVENT_LINES_READY (V4L2_EVENT_PRIVATE_START + 1)
+
+struct video_cap_event_lines {
+	__u32 index;
+	__u32 sequence;
+	__u32 lines;
+	__u32 height;
+};
+
+/*
+ * 帧边界事件：
+ * - V4L2_EVENT_FRAME_SYNC：每次 VSYNC 中断发一个，u.frame_sync.frame_sequence 为 VSYNC 计数（低 32 位，
+ *   STREAMON 后第一次 VSYNC 为 1，hot_restart 时接着上一次流往下数）；事件 timestamp 即中断时刻，与 buffer 时间戳同一时钟
+ * - VIDEO_CAP_EVENT_DMA_START：一个 buffer 挂上 DMA engine，FPGA 从下一个 SOF 起写进这个 buffer。
+ *   VSYNC 门控模式下就是刚过去那次 VSYNC 的这一帧；pipeline/ring 模式提前挂上，
+ *   真正开始写要等前面已挂上的 buffer 收完
+ * 订阅时 id=0，队列溢出时丢最老的。FRAME_SYNC 跟着 VSYNC 中断走：流打开期间一直有，
+ * hot_restart 下 STREAMOFF 后中断不关，也会继续发。
+ */
+#define VIDEO_CAP_EVENT_DMA_START (V4L2_EVENT_PRIVATE_START + 2)
+
+/*
+ * - index：挂上的 vb2 buffer index
+ * - sequence：没有丢帧/出错时这个 buffer 完成后将带上的 v4l2_buffer.sequence
+ * - vsync：挂上时的 VSYNC 计数（与 FRAME_SYNC 的 frame_sequence 同源）
+ */
+struct video_cap_event_dma {
+	__u32 index;
+	__u32 sequence;
+	__u32 vsync;
+	__u32 reserved;
+};
+
+/*
+ * 每帧元数据（meta_node 模块参数）：每个视频节点旁边多一个 V4L2_BUF_TYPE_META_CAPTURE 节点，
+ * 格式 V4L2_META_FMT_VIDEO_CAP，每个 buffer 一个 struct video_cap_meta。
+ * 视频节点每归还一个 buffer（DONE 或 ERROR，STREAMOFF 取消的除外）就填一个元数据 buffer，
+ * 元数据 buffer 的 sequence/timestamp 与对应视频 buffer 相同；没有排队的元数据 buffer 时这一帧的元数据丢弃。
+ */
+#define V4L2_META_FMT_VIDEO_CAP v4l2_fourcc('V', 'C', 'M', 'D')
+
+#define VIDEO_CAP_META_F_ERROR          (1U << 0) /* 视频 buffer 以 ERROR 归还 */
+#define VIDEO_CAP_META_F_TRIMMED        (1U << 1) /* DMA 长度裁剪到 sizeimage（buffer 比帧大） */
+#define VIDEO_CAP_META_F_TS_FALLBACK    (1U << 2) /* 找不到开始这一帧的 VSYNC，vsync_ns 退回 done_ns */
+#define VIDEO_CAP_META_F_FIFO_OVERFLOW  (1U << 3) /* STATUS/CH_STATUS 报 FIFO 溢出 */
+#define VIDEO_CAP_META_F_FIFO_UNDERFLOW (1U << 4) /* IRQ_STATUS 报欠流 */
+#define VIDEO_CAP_META_F_NO_HW_COUNT    (1U << 5) /* FPGA 没有帧计数寄存器，hw_frame_count 无效 */
+
+/*
+ * - sequence/index：对应视频 buffer 的 v4l2_buffer.sequence / index
+ *   （ERROR 帧不占 sequence，这里填下一个 DONE 帧将拿到的序号）
+ * - vsync_ns/submit_ns/done_ns：CLOCK_MONOTONIC；开始这一帧的 VSYNC、挂上 engine、DMA 完成回调
+ * - bytes：DMA 实际传输的字节数
+ * - status/irq_status：完成时读到的 STATUS（per-channel 寄存器时为 CH_STATUS）/ IRQ_STATUS 原值
+ * - hw_frame_count：FPGA 帧计数寄存器
+ */
+struct video_cap_meta {
+	__u32 sequence;
+	__u32 flags;
+	__u64 vsync_ns;
+	__u64 submit_ns;
+	__u64 done_ns;
+	__u32 bytes;
+	__u32 index;
+	__u32 status;
+	__u32 irq_status;
+	__u32 hw_frame_count;
+	__u32 reserved;
+};
+
+#endif /* __VIDEO_CAP_PCIE_V4L2_UAPI_H__ */
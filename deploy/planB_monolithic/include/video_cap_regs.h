@@ -31,7 +31,8 @@
 
 /* 视频配置 */
 #define REG_VID_FORMAT 0x0100     /* RW: 视频格式 (ADDR_VID_FMT) */
-#define REG_VID_RESOLUTION 0x0104 /* RO: 分辨率 (ADDR_VID_RES) */
+#define REG_VID_RESOLUTION 0x0104 /* RO: 实测分辨率 {height, width}，0=无信号 (ADDR_VID_RES) */
+#define REG_VID_FRAME_PERIOD 0x0108 /* RO: 实测帧周期 us，0=无信号 (ADDR_VID_PERIOD) */
 
 /* 帧缓存地址 */
 #define REG_BUF_ADDR0 0x0200 /* RW: 帧缓存地址0 */
@@ -109,6 +110,19 @@
 #define REG_CH_OFF_CONTROL    0x00u
 #define REG_CH_OFF_VID_FORMAT 0x04u
 #define REG_CH_OFF_STATUS     0x08u
+#define REG_CH_OFF_FRAME_COUNT 0x0Cu /* 预留：per-channel 帧计数（未实现时读回 0xDEADBEEF） */
+
+/* register_bank 对未实现地址的读回值 */
+#define REG_UNMAPPED_VALUE 0xDEADBEEFu
+
+/*
+ * REG_VID_RESOLUTION 位定义
+ * - 旧 bitstream 固定读回 1080p，且 REG_VID_FRAME_PERIOD 读回 REG_UNMAPPED_VALUE
+ */
+#define VID_RES_WIDTH_MASK  0x0000FFFFu
+#define VID_RES_WIDTH_SHIFT 0
+#define VID_RES_HEIGHT_MASK  0xFFFF0000u
+#define VID_RES_HEIGHT_SHIFT 16
 
 /*
  * REG_VID_CONTROL 位定义
@@ -4,7 +4,7 @@ set -euo pipefail
 make
 
 # V4L2/vb2 dependencies are usually modules; load them first to avoid "Unknown symbol" on insmod.
-sudo modprobe -a videodev videobuf2_common videobuf2_v4l2 videobuf2_dma_sg || true
+sudo modprobe -a videodev videobuf2_common videobuf2_v4l2 videobuf2_dma_sg videobuf2_dma_contig || true
 
 # Example parameters:
 # - c2h_channel: XDMA C2H channel index
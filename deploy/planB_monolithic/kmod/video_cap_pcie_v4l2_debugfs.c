@@ -0,0 +1,293 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * video_cap_pcie_v4l2_debugfs.c
+ *
+ * 每个 /dev/videoX 一个 debugfs 目录：/sys/kernel/debug/video_cap_pcie_v4l2/videoN/
+ * - latency：每帧流水线各段延迟的 log2 直方图 + count/mean/p50/p99/max
+ *   （段的定义见 enum video_cap_lat_id）
+ * - stats：struct video_cap_stats 的全部计数器（64-bit 原值，不经过 V4L2 control 截断）
+ * - reset：写任意内容清空直方图（计数器不清，保持单调）
+ * - numa：设备所在 NUMA 节点，采集 work / libxdma 完成线程所在 CPU，帧 buffer 页的节点分布
+ * - qos：链路预算、各路已登记的带宽、这一路的登记值/优先级/当前降帧系数
+ *
+ * 直方图只用原子量，记录方可以在 ISR / 完成回调 / work 任意上下文，读方不加锁；
+ * 读到的各 bucket 之间不是严格的同一时刻快照，统计用途足够。
+ */
+
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+
+#include "libxdma_api.h"
+
+#include "video_cap_pcie_v4l2_priv.h"
+
+static struct dentry *video_cap_debugfs_root;
+
+static const char *const video_cap_lat_names[VIDEO_CAP_LAT_NUM] = {
+	[VIDEO_CAP_LAT_VSYNC_WAKE] = "vsync_wake",
+	[VIDEO_CAP_LAT_WAKE_SUBMIT] = "wake_submit",
+	[VIDEO_CAP_LAT_SUBMIT_DONE] = "submit_done",
+	[VIDEO_CAP_LAT_DONE_VB2] = "done_vb2",
+	[VIDEO_CAP_LAT_QBUF_FILL] = "qbuf_fill",
+	[VIDEO_CAP_LAT_RECOVER] = "recover",
+};
+
+/* stats 文件的输出顺序与 struct video_cap_stats 一致 */
+#define VIDEO_CAP_STAT(name) { #name, offsetof(struct video_cap_stats, name) }
+
+static const struct {
+	const char *name;
+	size_t off;
+} video_cap_stat_fields[] = {
+	VIDEO_CAP_STAT(vsync_isr),
+	VIDEO_CAP_STAT(vsync_wait),
+	VIDEO_CAP_STAT(vsync_timeout),
+	VIDEO_CAP_STAT(dma_submit),
+	VIDEO_CAP_STAT(dma_error),
+	VIDEO_CAP_STAT(dma_short),
+	VIDEO_CAP_STAT(dma_trim),
+	VIDEO_CAP_STAT(chain_build_fail),
+	VIDEO_CAP_STAT(frame_drop),
+	VIDEO_CAP_STAT(poll_hit),
+	VIDEO_CAP_STAT(poll_miss),
+	VIDEO_CAP_STAT(vsync_ts_miss),
+	VIDEO_CAP_STAT(slice_event),
+	VIDEO_CAP_STAT(meta_drop),
+	VIDEO_CAP_STAT(desc_per_frame),
+	VIDEO_CAP_STAT(source_change),
+	VIDEO_CAP_STAT(recover),
+	VIDEO_CAP_STAT(recover_us),
+	VIDEO_CAP_STAT(superseded),
+	VIDEO_CAP_STAT(sync_event),
+	VIDEO_CAP_STAT(qos_throttle),
+	VIDEO_CAP_STAT(qos_skip),
+};
+
+/* 函数：记录一段延迟 */
+void video_cap_lat_record(struct video_cap_dev *dev, enum video_cap_lat_id id, u64 ns)
+{
+	struct video_cap_hist *h = &dev->lat[id];
+	unsigned int b = ns ? min_t(unsigned int, fls64(ns) - 1, VIDEO_CAP_HIST_BUCKETS - 1) : 0;
+	s64 old = atomic64_read(&h->max_ns);
+
+	atomic64_inc(&h->bucket[b]);
+	atomic64_inc(&h->count);
+	atomic64_add(ns, &h->sum_ns);
+
+	while ((s64)ns > old) {
+		s64 cur = atomic64_cmpxchg(&h->max_ns, old, ns);
+
+		if (cur == old)
+			break;
+		old = cur;
+	}
+}
+
+/*
+ * 百分位：累计计数第一次达到 count*pct/100 的 bucket 的上界（不超过 max），
+ * log2 分档下结果最多偏大一倍，够用来判断延迟落在哪个量级。
+ */
+static u64 video_cap_hist_pct(const u64 *bucket, u64 count, u64 max, unsigned int pct)
+{
+	u64 target = div_u64(count * pct + 99, 100);
+	u64 acc = 0;
+	unsigned int i;
+
+	for (i = 0; i < VIDEO_CAP_HIST_BUCKETS; i++) {
+		acc += bucket[i];
+		if (acc >= target)
+			return (i + 1 < VIDEO_CAP_HIST_BUCKETS) ? min(BIT_ULL(i + 1) - 1, max) : max;
+	}
+	return max;
+}
+
+/* 函数：latency 文件内容 */
+static int video_cap_latency_show(struct seq_file *s, void *unused)
+{
+	struct video_cap_dev *dev = s->private;
+	u64 bucket[VIDEO_CAP_HIST_BUCKETS];
+	unsigned int id, i;
+
+	seq_printf(s, "%-12s %10s %10s %10s %10s %10s\n", "interval", "count", "mean_ns",
+		   "p50_ns", "p99_ns", "max_ns");
+
+	for (id = 0; id < VIDEO_CAP_LAT_NUM; id++) {
+		struct video_cap_hist *h = &dev->lat[id];
+		u64 count = 0, max = atomic64_read(&h->max_ns);
+		u64 sum = atomic64_read(&h->sum_ns);
+
+		for (i = 0; i < VIDEO_CAP_HIST_BUCKETS; i++) {
+			bucket[i] = atomic64_read(&h->bucket[i]);
+			count += bucket[i];
+		}
+
+		seq_printf(s, "%-12s %10llu %10llu %10llu %10llu %10llu\n",
+			   video_cap_lat_names[id], count, count ? div64_u64(sum, count) : 0,
+			   count ? video_cap_hist_pct(bucket, count, max, 50) : 0,
+			   count ? video_cap_hist_pct(bucket, count, max, 99) : 0, max);
+	}
+
+	for (id = 0; id < VIDEO_CAP_LAT_NUM; id++) {
+		struct video_cap_hist *h = &dev->lat[id];
+
+		seq_printf(s, "\n%s:\n", video_cap_lat_names[id]);
+		for (i = 0; i < VIDEO_CAP_HIST_BUCKETS; i++) {
+			u64 n = atomic64_read(&h->bucket[i]);
+
+			if (!n)
+				continue;
+			if (i + 1 < VIDEO_CAP_HIST_BUCKETS)
+				seq_printf(s, "  [%12llu, %12llu) %llu\n", i ? BIT_ULL(i) : 0,
+					   BIT_ULL(i + 1), n);
+			else
+				seq_printf(s, "  [%12llu,          inf) %llu\n", BIT_ULL(i), n);
+		}
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(video_cap_latency);
+
+/* 函数：stats 文件内容 */
+static int video_cap_stats_show(struct seq_file *s, void *unused)
+{
+	struct video_cap_dev *dev = s->private;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(video_cap_stat_fields); i++) {
+		atomic64_t *v = (atomic64_t *)((char *)&dev->stats + video_cap_stat_fields[i].off);
+
+		seq_printf(s, "%-16s %llu\n", video_cap_stat_fields[i].name,
+			   (unsigned long long)atomic64_read(v));
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(video_cap_stats);
+
+/* 函数：numa 文件内容 */
+static int video_cap_numa_show(struct seq_file *s, void *unused)
+{
+	struct video_cap_dev *dev = s->private;
+	int cpu;
+
+	seq_printf(s, "node             %d\n", dev_to_node(&dev->pdev->dev));
+	if (dev->work_cpu == WORK_CPU_UNBOUND)
+		seq_puts(s, "work_cpu         unbound\n");
+	else
+		seq_printf(s, "work_cpu         %d (node %d%s)\n", dev->work_cpu,
+			   cpu_to_node(dev->work_cpu), cpu_online(dev->work_cpu) ? "" : ", offline");
+
+	if (dev->cap_worker)
+		seq_printf(s, "worker           %s %u\n", dev->rt_policy == SCHED_RR ? "rr" : "fifo",
+			   dev->rt_prio);
+	else
+		seq_puts(s, "worker           cap_wq\n");
+	seq_printf(s, "irq_affinity     %s\n", dev->irq_hint ? "work_cpu" : "default");
+
+	/* poll_mode 才有完成线程，否则完成在 engine 中断所在的 CPU 上处理 */
+	cpu = xdma_engine_cmpl_cpu(dev->xdev, dev->c2h_channel, false);
+	if (cpu < 0)
+		seq_printf(s, "cmpl_cpu c2h%-4u irq\n", dev->c2h_channel);
+	else
+		seq_printf(s, "cmpl_cpu c2h%-4u %d (node %d)\n", dev->c2h_channel, cpu,
+			   cpu_to_node(cpu));
+
+	if (dev->dma_contig) {
+		seq_puts(s, "buffer_pages     dma_contig (device node)\n");
+	} else {
+		seq_printf(s, "buffer_pages     local %ld remote %ld\n",
+			   atomic_long_read(&dev->pages_local), atomic_long_read(&dev->pages_remote));
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(video_cap_numa);
+
+/* 函数：qos 文件内容（MB/s = 10^6 B/s） */
+static int video_cap_qos_show(struct seq_file *s, void *unused)
+{
+	struct video_cap_dev *dev = s->private;
+	struct video_cap_multi *m = dev->multi;
+
+	if (!m->qos_enabled) {
+		seq_puts(s, "link_budget      off\n");
+		return 0;
+	}
+	if (m->qos_link_bps)
+		seq_printf(s, "link_budget      %llu MB/s\n", div_u64(m->qos_link_bps, 1000000));
+	else
+		seq_puts(s, "link_budget      unknown\n");
+	seq_printf(s, "reserved         %llu MB/s\n", div_u64(READ_ONCE(m->qos_used_bps), 1000000));
+	seq_printf(s, "stream           %llu MB/s\n", div_u64(READ_ONCE(dev->qos_bps), 1000000));
+	seq_printf(s, "priority         %u\n", READ_ONCE(dev->qos_prio));
+	seq_printf(s, "capture          1/%u\n", READ_ONCE(dev->qos_div));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(video_cap_qos);
+
+/* 函数：reset 文件写入，清空全部直方图 */
+static ssize_t video_cap_reset_write(struct file *file, const char __user *ubuf, size_t len,
+				     loff_t *ppos)
+{
+	struct video_cap_dev *dev = file->private_data;
+	unsigned int id, i;
+
+	for (id = 0; id < VIDEO_CAP_LAT_NUM; id++) {
+		struct video_cap_hist *h = &dev->lat[id];
+
+		for (i = 0; i < VIDEO_CAP_HIST_BUCKETS; i++)
+			atomic64_set(&h->bucket[i], 0);
+		atomic64_set(&h->count, 0);
+		atomic64_set(&h->sum_ns, 0);
+		atomic64_set(&h->max_ns, 0);
+	}
+	return len;
+}
+
+static const struct file_operations video_cap_reset_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = video_cap_reset_write,
+	.llseek = noop_llseek,
+};
+
+/* 函数：创建模块 debugfs 根目录 */
+void video_cap_debugfs_init(void)
+{
+	video_cap_debugfs_root = debugfs_create_dir(DRV_NAME, NULL);
+}
+
+/* 函数：删除模块 debugfs 根目录 */
+void video_cap_debugfs_exit(void)
+{
+	debugfs_remove_recursive(video_cap_debugfs_root);
+	video_cap_debugfs_root = NULL;
+}
+
+/* 函数：创建 /dev/videoX 的 debugfs 子目录（debugfs 不可用时静默跳过） */
+void video_cap_debugfs_register(struct video_cap_dev *dev)
+{
+	char name[16];
+
+	if (IS_ERR_OR_NULL(video_cap_debugfs_root))
+		return;
+
+	snprintf(name, sizeof(name), "video%d", dev->vdev.num);
+	dev->debugfs_dir = debugfs_create_dir(name, video_cap_debugfs_root);
+	debugfs_create_file("latency", 0444, dev->debugfs_dir, dev, &video_cap_latency_fops);
+	debugfs_create_file("stats", 0444, dev->debugfs_dir, dev, &video_cap_stats_fops);
+	debugfs_create_file("reset", 0200, dev->debugfs_dir, dev, &video_cap_reset_fops);
+	debugfs_create_file("numa", 0444, dev->debugfs_dir, dev, &video_cap_numa_fops);
+	debugfs_create_file("qos", 0444, dev->debugfs_dir, dev, &video_cap_qos_fops);
+}
+
+/* 函数：删除 /dev/videoX 的 debugfs 子目录 */
+void video_cap_debugfs_unregister(struct video_cap_dev *dev)
+{
+	debugfs_remove_recursive(dev->debugfs_dir);
+	dev->debugfs_dir = NULL;
+}
@@ -7,7 +7,7 @@
  * - 通过 V4L2 暴露一个未压缩的视频采集设备：/dev/videoX
  *
  * 数据通路（每帧）：
- *   VSYNC（user IRQ）-> 唤醒采集线程 -> XDMA C2H DMA 写入 vb2 buffer
+ *   VSYNC（user IRQ）-> 调度采集 work -> XDMA C2H DMA 写入 vb2 buffer
  *   -> vb2_buffer_done() -> 用户态 mmap/read 取帧
  *
  * 说明：
@@ -15,9 +15,16 @@
  */
 
 #include <linux/bitops.h>
+#include <linux/cpumask.h>
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
 #include <linux/minmax.h>
 #include <linux/module.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
 
 #include "libxdma.h"
 #include "libxdma_api.h"
@@ -49,6 +56,127 @@ static unsigned int vsync_timeout_ms = 1000;
 module_param(vsync_timeout_ms, uint, 0644);
 MODULE_PARM_DESC(vsync_timeout_ms, "VSYNC wait timeout in ms (default 1000)");
 
+static unsigned int pipeline_depth;
+module_param(pipeline_depth, uint, 0644);
+MODULE_PARM_DESC(pipeline_depth,
+		 "Frames kept armed on the C2H engine (0 = one frame per VSYNC, max 8)");
+
+static unsigned int poll_us;
+module_param(poll_us, uint, 0644);
+MODULE_PARM_DESC(poll_us,
+		 "Busy-poll window in us before the predicted end of frame (0 = interrupts only, pipeline mode)");
+
+static bool ring_mode;
+module_param(ring_mode, bool, 0644);
+MODULE_PARM_DESC(ring_mode,
+		 "Run the C2H engine continuously on a cyclic descriptor ring (overrides pipeline_depth)");
+
+static bool dma_contig;
+module_param(dma_contig, bool, 0644);
+MODULE_PARM_DESC(dma_contig,
+		 "Allocate frame buffers with vb2-dma-contig (one DMA segment per frame, needs CMA/IOMMU)");
+
+static bool iova_merge = true;
+module_param(iova_merge, bool, 0644);
+MODULE_PARM_DESC(iova_merge,
+		 "Let the IOMMU map each vb2-dma-sg buffer as one IOVA segment (one descriptor per frame, off while slices > 1)");
+
+static unsigned int overrun_policy;
+module_param(overrun_policy, uint, 0644);
+MODULE_PARM_DESC(overrun_policy,
+		 "No buffer queued: 0 = stall the C2H engine, 1 = drain the frame into a scratch buffer (dropped, sequence gap)");
+
+static bool meta_node;
+module_param(meta_node, bool, 0644);
+MODULE_PARM_DESC(meta_node,
+		 "Register a per-frame metadata node (V4L2 META_CAPTURE) next to each /dev/videoX");
+
+static unsigned int slices;
+module_param(slices, uint, 0644);
+MODULE_PARM_DESC(slices,
+		 "Split each frame into N slices with a lines-ready event per slice (0/1 = off, max 16)");
+
+static bool numa_local = true;
+module_param(numa_local, bool, 0644);
+MODULE_PARM_DESC(numa_local,
+		 "Run each channel's capture work on a CPU of the card's NUMA node (0 = wherever it is kicked)");
+
+/* 以下三个按 /dev/videoX 顺序逐路给，逗号分隔，例如 rt_prio=80,80 cap_cpu=2,3 */
+static int cap_cpu[XDMA_USER_IRQ_MAX] = { [0 ... XDMA_USER_IRQ_MAX - 1] = -1 };
+module_param_array(cap_cpu, int, NULL, 0644);
+MODULE_PARM_DESC(cap_cpu,
+		 "Per channel: CPU for the capture work and its IRQs (-1 = numa_local choice)");
+
+static unsigned int rt_prio[XDMA_USER_IRQ_MAX];
+module_param_array(rt_prio, uint, NULL, 0644);
+MODULE_PARM_DESC(rt_prio,
+		 "Per channel: run capture in a dedicated real-time kthread at this priority (1..99, 0 = shared high-priority workqueue)");
+
+static unsigned int rt_policy[XDMA_USER_IRQ_MAX];
+module_param_array(rt_policy, uint, NULL, 0644);
+MODULE_PARM_DESC(rt_policy,
+		 "Per channel: policy of the rt_prio kthread (1 = SCHED_FIFO, default; 2 = SCHED_RR)");
+
+static unsigned int qos_budget_pct = 80;
+module_param(qos_budget_pct, uint, 0644);
+MODULE_PARM_DESC(qos_budget_pct,
+		 "Share of the negotiated PCIe link bandwidth STREAMON may reserve across channels (0 = no bandwidth QoS)");
+
+static unsigned int qos_link_mbps;
+module_param(qos_link_mbps, uint, 0644);
+MODULE_PARM_DESC(qos_link_mbps,
+		 "Measured usable C2H bandwidth in Mb/s, used as the budget as is (0 = negotiated link x qos_budget_pct)");
+
+static bool irq_affinity = true;
+module_param(irq_affinity, bool, 0644);
+MODULE_PARM_DESC(irq_affinity,
+		 "Steer each channel's VSYNC user IRQ and C2H engine MSI-X vectors to its capture CPU");
+
+static unsigned int src_poll_ms = 100;
+module_param(src_poll_ms, uint, 0644);
+MODULE_PARM_DESC(src_poll_ms,
+		 "Poll the FPGA input timing every N ms, raise SOURCE_CHANGE on change (0 = fixed 1080p)");
+
+static bool dma_recover = true;
+module_param(dma_recover, bool, 0644);
+MODULE_PARM_DESC(dma_recover,
+		 "On a DMA error/timeout reset the C2H engine and the FPGA bridge and resync in-stream (0 = only return ERROR buffers)");
+
+static bool hot_restart;
+module_param(hot_restart, bool, 0644);
+MODULE_PARM_DESC(hot_restart,
+		 "Keep IRQ, FPGA enable, warm-up buffer and C2H ring across STREAMOFF so STREAMON returns at once (needs per-channel regs)");
+
+/*
+ * 把本路 VSYNC user IRQ 和 C2H engine 的 MSI-X 向量放到 work_cpu 上（affinity + hint，irqbalance 照 hint 放）：
+ * VSYNC ISR、engine 中断以及它 schedule_work 出来的完成处理都在采集 work 所在的 CPU 上，kick 不跨核。
+ * 共用 MSI/legacy 中断时没有独立向量，什么都不做。free_irq 前必须清掉（set=false）。
+ */
+/* 函数：设置/清除本路中断的 affinity hint */
+static void video_cap_irq_affinity(struct video_cap_dev *dev, bool set)
+{
+	const struct cpumask *mask = set ? cpumask_of(dev->work_cpu) : NULL;
+	int irq[2];
+	int n = 0;
+
+	if (set == dev->irq_hint)
+		return;
+
+	irq[n++] = xdma_user_irq_line(dev->xdev, dev->irq_index);
+	irq[n++] = xdma_engine_irq_line(dev->xdev, dev->c2h_channel, false);
+
+	while (n-- > 0) {
+		if (irq[n] <= 0)
+			continue;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+		irq_set_affinity_and_hint(irq[n], mask);
+#else
+		irq_set_affinity_hint(irq[n], mask);
+#endif
+	}
+	dev->irq_hint = set;
+}
+
 /*
  * 多通道映射约定：
  * - 第 i 路 /dev/videoX 使用：c2h_channel + i
@@ -88,7 +216,8 @@ static int video_cap_pci_probe(struct pci_dev *pdev, const struct pci_device_id
 		return -EINVAL;
 	}
 
-	m = kzalloc(sizeof(*m), GFP_KERNEL);
+	/* 驱动自己的结构体都放在板卡所在的 NUMA 节点上（完成回调里每帧都要访问） */
+	m = kzalloc_node(sizeof(*m), GFP_KERNEL, dev_to_node(&pdev->dev));
 	if (!m)
 		return -ENOMEM;
 
@@ -116,8 +245,18 @@ static int video_cap_pci_probe(struct pci_dev *pdev, const struct pci_device_id
 		goto err_xdma;
 	}
 	m->user_regs = m->xdev->bar[m->xdev->user_bar_idx];
+	/*
+	 * PCI 设备默认 max_seg_size 只有 64KB：IOMMU 把 vb2-dma-sg 的散页映射成一段连续 IOVA 后，
+	 * dma_map_sg 仍按 64KB 切成多个 sg 段，1080p XR24 一帧 128 个描述符。放开后一帧一段
+	 * （libxdma 再按 desc_blen_max 切，跨 4GB IOVA 边界时多一段）。无 IOMMU 时段数只取决于物理页是否相邻。
+	 * 开 slices 时保留 64KB 段：分片中断只能打在描述符边界上。
+	 */
+	if (iova_merge && slices < 2)
+		dma_set_max_seg_size(&pdev->dev, UINT_MAX);
 	/* 尝试检测 per-channel 寄存器窗口（失败也没关系，走 legacy 全局寄存器） */
 	(void)video_cap_detect_per_channel_regs(m);
+	(void)video_cap_src_init(m, src_poll_ms);
+	video_cap_qos_init(m, qos_link_mbps, qos_budget_pct);
 
 	if (c2h_max <= 0) {
 		dev_err(&pdev->dev, "no C2H channels reported by XDMA (c2h_max=%d)\n", c2h_max);
@@ -171,13 +310,27 @@ static int video_cap_pci_probe(struct pci_dev *pdev, const struct pci_device_id
 		want = min(want, avail);
 	}
 
+	if (hot_restart && !m->has_per_ch_regs)
+		dev_warn(&pdev->dev, "hot_restart needs per-channel CTRL regs, ignored\n");
+
 	m->num_devs = want;
-	m->devs = kcalloc(want, sizeof(*m->devs), GFP_KERNEL);
+	m->devs = kcalloc_node(want, sizeof(*m->devs), GFP_KERNEL, dev_to_node(&pdev->dev));
 	if (!m->devs) {
 		ret = -ENOMEM;
 		goto err_xdma;
 	}
 
+	/*
+	 * 采集状态机跑在一个共用的高优先级 workqueue 上，不再每路一个 kthread。
+	 * hybrid 忙等会占住 worker 最多 2*poll_us，CPU_INTENSIVE 让同一 CPU 上其他通道的 work 不被它挡住。
+	 * 绑定型 workqueue：dev->work_cpu 固定时 work 就在那个 CPU 上跑（numa_local）。
+	 */
+	m->cap_wq = alloc_workqueue("%s", WQ_HIGHPRI | WQ_CPU_INTENSIVE, 0, DRV_NAME);
+	if (!m->cap_wq) {
+		ret = -ENOMEM;
+		goto err_devs;
+	}
+
 	ret = v4l2_device_register(&pdev->dev, &m->v4l2_dev);
 	if (ret) {
 		dev_err(&pdev->dev, "v4l2_device_register failed: %d\n", ret);
@@ -188,7 +341,7 @@ static int video_cap_pci_probe(struct pci_dev *pdev, const struct pci_device_id
 	for (i = 0; i < want; i++) {
 		u32 bit;
 
-		dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+		dev = kzalloc_node(sizeof(*dev), GFP_KERNEL, dev_to_node(&pdev->dev));
 		if (!dev) {
 			ret = -ENOMEM;
 			goto err_loop;
@@ -203,21 +356,67 @@ static int video_cap_pci_probe(struct pci_dev *pdev, const struct pci_device_id
 		mutex_init(&dev->lock);
 		spin_lock_init(&dev->qlock);
 		INIT_LIST_HEAD(&dev->buf_list);
-		init_waitqueue_head(&dev->wq);
+		INIT_LIST_HEAD(&dev->armed_list);
 		init_waitqueue_head(&dev->vsync_wq);
+		video_cap_capture_init(dev);
 		atomic64_set(&dev->vsync_seq, 0);
+		atomic_set(&dev->ev_frame_sync, 0);
+		atomic_set(&dev->ev_dma_start, 0);
 		dev->vsync_timeout_ms = vsync_timeout_ms;
 
 		dev->width = VIDEO_WIDTH_DEFAULT;
 		dev->height = VIDEO_HEIGHT_DEFAULT;
+		if (m->src_detect && m->src.width) {
+			dev->width = m->src.width;
+			dev->height = m->src.height;
+		}
 		dev->pixfmt = V4L2_PIX_FMT_XBGR32;
 		dev->bytesperline = dev->width * 4;
 		dev->sizeimage = dev->width * dev->height * 4;
 
 		dev->test_pattern = test_pattern;
+		dev->dma_contig = dma_contig;
+		dev->meta_node = meta_node;
 		dev->skip = skip;
+		dev->pipeline_depth = min(pipeline_depth, VIDEO_CAP_PIPELINE_MAX);
+		dev->ring_mode = ring_mode;
+		dev->poll_us = min(poll_us, VIDEO_CAP_POLL_US_MAX);
+		dev->slices = min(slices, VIDEO_CAP_SLICES_MAX);
+		dev->overrun_policy = min(overrun_policy, VIDEO_CAP_OVERRUN_DRAIN);
+		dev->dma_recover = dma_recover;
+		/* 只有 per-channel CTRL 时 bridge 才能在各路之间独立保持使能 */
+		dev->hot_restart = hot_restart && m->has_per_ch_regs;
 		dev->c2h_channel = c2h_channel + i;
 		dev->irq_index = irq_index + i;
+		/*
+		 * 各路 work 分到设备节点上不同的 CPU；节点未知（单路机器/BIOS 没报）时不固定。
+		 * cap_cpu 指定了就用它
+		 */
+		dev->work_cpu = WORK_CPU_UNBOUND;
+		if (cap_cpu[i] >= 0) {
+			if (cap_cpu[i] < nr_cpu_ids && cpu_possible(cap_cpu[i]))
+				dev->work_cpu = cap_cpu[i];
+			else
+				dev_warn(&pdev->dev, "cap_cpu=%d for channel %u is not a CPU, ignored\n",
+					 cap_cpu[i], i);
+		}
+		if (dev->work_cpu == WORK_CPU_UNBOUND && numa_local &&
+		    dev_to_node(&pdev->dev) != NUMA_NO_NODE)
+			dev->work_cpu = cpumask_local_spread(i, dev_to_node(&pdev->dev));
+
+		/* 起不来实时线程不算 probe 失败，退回共用的 cap_wq */
+		if (rt_prio[i]) {
+			int policy = rt_policy[i] == SCHED_RR ? SCHED_RR : SCHED_FIFO;
+
+			ret = video_cap_capture_rt(dev, policy, min(rt_prio[i], MAX_RT_PRIO - 1U));
+			if (ret)
+				dev_warn(&pdev->dev,
+					 "real-time capture thread for channel %u failed (%d), using the workqueue\n",
+					 i, ret);
+			ret = 0;
+		}
+		if (irq_affinity && dev->work_cpu != WORK_CPU_UNBOUND)
+			video_cap_irq_affinity(dev, true);
 
 		/*
 		 * user_irq_mask 用于 enable/disable/注销 handler：
@@ -242,17 +441,26 @@ static int video_cap_pci_probe(struct pci_dev *pdev, const struct pci_device_id
 
 		m->devs[i] = dev;
 
-		dev_info(&pdev->dev, DRV_NAME ": registered /dev/video%d (pci=%s c2h=%u irq=%u)\n",
-			 dev->vdev.num, pci_name(pdev), dev->c2h_channel, dev->irq_index);
+		dev_info(&pdev->dev, DRV_NAME ": registered /dev/video%d (pci=%s c2h=%u irq=%u node=%d)\n",
+			 dev->vdev.num, pci_name(pdev), dev->c2h_channel, dev->irq_index,
+			 dev_to_node(&pdev->dev));
+		if (dev->meta_registered)
+			dev_info(&pdev->dev, DRV_NAME ": registered metadata node /dev/video%d\n",
+				 dev->meta_vdev.num);
 		video_cap_stats_dump(dev, "probe");
 		dev = NULL;
 	}
 
+	/* 所有 /dev/videoX 都注册好之后才开始轮询输入时序（src_work 会给每一路发事件） */
+	if (m->src_detect)
+		schedule_delayed_work(&m->src_work, msecs_to_jiffies(m->src_poll_ms));
 	return 0;
 
 err_loop:
 	if (dev) {
 		xdma_user_isr_register(m->xdev, (u32)BIT(dev->irq_index), NULL, NULL);
+		video_cap_irq_affinity(dev, false);
+		video_cap_capture_exit(dev);
 		kfree(dev);
 		dev = NULL;
 	}
@@ -266,14 +474,19 @@ err_loop:
 			continue;
 		if (d->streaming)
 			video_cap_stop_streaming(&d->vb_queue);
+		video_cap_capture_release(d);
 		video_cap_unregister_v4l2(d);
 		xdma_user_isr_register(m->xdev, d->user_irq_mask, NULL, NULL);
+		video_cap_irq_affinity(d, false);
+		video_cap_capture_exit(d);
+		video_cap_qos_unlink(m, i);
 		kfree(d);
-		m->devs[i] = NULL;
 	}
 	if (v4l2_registered)
 		v4l2_device_unregister(&m->v4l2_dev);
 err_devs:
+	if (m->cap_wq)
+		destroy_workqueue(m->cap_wq);
 	kfree(m->devs);
 	m->devs = NULL;
 err_xdma:
@@ -291,7 +504,7 @@ err_out:
 
 /*
  * PCI remove：
- * - 逐个停止 streaming（若正在采集）
+ * - 逐个停止 streaming（若正在采集），释放 hot_restart 保留的资源
  * - 注销 /dev/videoX
  * - 注销 user IRQ handler 并关闭 XDMA
  */
@@ -303,6 +516,9 @@ static void video_cap_pci_remove(struct pci_dev *pdev)
 	if (!m)
 		return;
 
+	/* 先停输入时序轮询，它会访问各路 dev */
+	cancel_delayed_work_sync(&m->src_work);
+
 	for (i = 0; i < m->num_devs; i++) {
 		struct video_cap_dev *dev = m->devs ? m->devs[i] : NULL;
 
@@ -310,10 +526,18 @@ static void video_cap_pci_remove(struct pci_dev *pdev)
 			continue;
 		if (dev->streaming)
 			video_cap_stop_streaming(&dev->vb_queue);
+		/* hot_restart：STREAMOFF 之后仍开着的 IRQ/bridge 和保留的 DMA 资源 */
+		video_cap_capture_release(dev);
 		video_cap_unregister_v4l2(dev);
-		if (m->xdev)
+		if (m->xdev) {
 			xdma_user_isr_register(m->xdev, dev->user_irq_mask, NULL, NULL);
+			/* 之后 xdma_device_close 会 free_irq，hint 要先清掉 */
+			video_cap_irq_affinity(dev, false);
+		}
+		video_cap_capture_exit(dev);
 		video_cap_stats_dump(dev, "remove");
+		/* 其余还在采集的路丢帧时会遍历 devs[] */
+		video_cap_qos_unlink(m, i);
 		kfree(dev);
 	}
 
@@ -324,6 +548,9 @@ static void video_cap_pci_remove(struct pci_dev *pdev)
 		m->xdev = NULL;
 	}
 
+	/* 各路已 STREAMOFF，work 都已取消 */
+	if (m->cap_wq)
+		destroy_workqueue(m->cap_wq);
 	v4l2_device_unregister(&m->v4l2_dev);
 	kfree(m->devs);
 	pci_set_drvdata(pdev, NULL);
@@ -345,8 +572,28 @@ static struct pci_driver video_cap_pci_driver = {
 	.remove = video_cap_pci_remove,
 };
 
-module_pci_driver(video_cap_pci_driver);
+/* 函数：模块加载，debugfs 根目录要先于 probe 建好 */
+static int __init video_cap_init(void)
+{
+	int ret;
+
+	video_cap_debugfs_init();
+	ret = pci_register_driver(&video_cap_pci_driver);
+	if (ret)
+		video_cap_debugfs_exit();
+	return ret;
+}
+
+/* 函数：模块卸载 */
+static void __exit video_cap_exit(void)
+{
+	pci_unregister_driver(&video_cap_pci_driver);
+	video_cap_debugfs_exit();
+}
+
+module_init(video_cap_init);
+module_exit(video_cap_exit);
 
 MODULE_DESCRIPTION("Monolithic PCIe V4L2 capture driver (integrated XDMA core)");
 MODULE_LICENSE("GPL");
-MODULE_SOFTDEP("pre: videodev videobuf2_common videobuf2_v4l2 videobuf2_dma_sg");
+MODULE_SOFTDEP("pre: videodev videobuf2_common videobuf2_v4l2 videobuf2_dma_sg videobuf2_vmalloc");
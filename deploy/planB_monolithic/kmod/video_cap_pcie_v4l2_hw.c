@@ -7,9 +7,13 @@
  * - 读取 REG_CAPS，判断是否支持 per-channel 寄存器窗口
  * - 计算每个通道的寄存器偏移（stride）
  * - 写入 CTRL/VID_FORMAT，控制 FPGA 采集与像素格式
+ * - 轮询 FPGA 实测的输入时序（VID_RES/VID_PERIOD），变化时通知各路 /dev/videoX
  */
 
 #include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
 
 #include "video_cap_regs.h"
 
@@ -87,6 +91,124 @@ u32 video_cap_ch_reg_off(struct video_cap_dev *dev, u32 ch_off)
 	return REG_CH_BASE + (dev->c2h_channel * stride) + ch_off;
 }
 
+/*
+ * 读取 FPGA 实测的输入时序：
+ * - 旧 bitstream 没有 REG_VID_FRAME_PERIOD（读回 REG_UNMAPPED_VALUE）：返回 -EOPNOTSUPP
+ * - 无信号、或读到不合理的值（含设备掉线时的全 1、宽度不按 8 对齐）：t 全部填 0
+ */
+/* 函数：读取实测输入时序（REG_VID_RESOLUTION / REG_VID_FRAME_PERIOD） */
+int video_cap_read_timing(struct video_cap_multi *m, struct video_cap_timing *t)
+{
+	u32 res;
+	u32 period;
+
+	if (!m->user_regs)
+		return -ENODEV;
+
+	period = ioread32((u8 __iomem *)m->user_regs + REG_VID_FRAME_PERIOD);
+	if (period == REG_UNMAPPED_VALUE)
+		return -EOPNOTSUPP;
+	res = ioread32((u8 __iomem *)m->user_regs + REG_VID_RESOLUTION);
+
+	t->width = (res & VID_RES_WIDTH_MASK) >> VID_RES_WIDTH_SHIFT;
+	t->height = (res & VID_RES_HEIGHT_MASK) >> VID_RES_HEIGHT_SHIFT;
+	t->period_us = period;
+
+	/* 宽度打不满整 beat（例如 1366）FPGA 给不出帧尾，按无信号处理，各路保持原格式 */
+	if (!period || t->width < VIDEO_CAP_SRC_MIN || t->width > VIDEO_CAP_SRC_WIDTH_MAX ||
+	    (t->width % VIDEO_CAP_SRC_WIDTH_ALIGN) || t->height < VIDEO_CAP_SRC_MIN ||
+	    t->height > VIDEO_CAP_SRC_HEIGHT_MAX)
+		memset(t, 0, sizeof(*t));
+	return 0;
+}
+
+/* 帧周期变化超过 1/64 才算时序变化（FPGA 按 us 计数，相邻帧会差 1us） */
+static bool video_cap_period_changed(u32 old, u32 now)
+{
+	if (!old || !now)
+		return old != now;
+	return abs((s64)now - (s64)old) > old / 64;
+}
+
+/*
+ * src_work：每 src_poll_ms 读一次实测时序（两次 MMIO 读，不在采集路径上）。
+ * 分辨率变了、帧率明显变了、信号丢了/回来了，都给每一路发一次 SOURCE_CHANGE。
+ */
+/* 函数：输入时序轮询 */
+static void video_cap_src_work_fn(struct work_struct *work)
+{
+	struct video_cap_multi *m =
+		container_of(to_delayed_work(work), struct video_cap_multi, src_work);
+	struct video_cap_timing old;
+	struct video_cap_timing t;
+	unsigned int i;
+
+	if (video_cap_read_timing(m, &t))
+		goto out;
+
+	spin_lock(&m->src_lock);
+	old = m->src;
+	m->src = t;
+	spin_unlock(&m->src_lock);
+
+	if (t.width == old.width && t.height == old.height &&
+	    !video_cap_period_changed(old.period_us, t.period_us))
+		goto out;
+
+	dev_info(&m->pdev->dev, "source changed: %ux%u period=%uus (was %ux%u period=%uus)\n",
+		 t.width, t.height, t.period_us, old.width, old.height, old.period_us);
+	for (i = 0; i < m->num_devs; i++) {
+		if (m->devs[i])
+			video_cap_source_event(m->devs[i], &t);
+	}
+
+out:
+	schedule_delayed_work(&m->src_work, msecs_to_jiffies(m->src_poll_ms));
+}
+
+/*
+ * 初始化输入时序检测：
+ * - poll_ms=0 或旧 bitstream：不启用，格式固定到默认分辨率
+ * - 启用时先读一次，probe 用它作为各路的初始格式
+ */
+/* 函数：初始化输入时序检测 */
+bool video_cap_src_init(struct video_cap_multi *m, unsigned int poll_ms)
+{
+	struct video_cap_timing t;
+	int ret;
+
+	spin_lock_init(&m->src_lock);
+	INIT_DELAYED_WORK(&m->src_work, video_cap_src_work_fn);
+	m->src_detect = false;
+	if (!poll_ms)
+		return false;
+
+	ret = video_cap_read_timing(m, &t);
+	if (ret) {
+		dev_info(&m->pdev->dev, "no input timing registers (%d), fixed %ux%u\n", ret,
+			 VIDEO_WIDTH_DEFAULT, VIDEO_HEIGHT_DEFAULT);
+		return false;
+	}
+
+	m->src = t;
+	m->src_poll_ms = poll_ms;
+	m->src_detect = true;
+	dev_info(&m->pdev->dev, "source: %ux%u period=%uus\n", t.width, t.height, t.period_us);
+	return true;
+}
+
+/* 函数：读取最近一次实测时序（ioctl 路径用，不碰寄存器） */
+bool video_cap_src_timing(struct video_cap_multi *m, struct video_cap_timing *t)
+{
+	if (!m->src_detect)
+		return false;
+
+	spin_lock(&m->src_lock);
+	*t = m->src;
+	spin_unlock(&m->src_lock);
+	return true;
+}
+
 /* 将 V4L2 pixelformat 映射到 FPGA 寄存器里的视频格式枚举（VID_FMT_*） */
 static u32 video_cap_pixfmt_to_fpga_vid_fmt(u32 pixfmt)
 {
@@ -154,6 +276,31 @@ int video_cap_enable(struct video_cap_dev *dev, bool enable)
 	return 0;
 }
 
+/*
+ * DMA 出错恢复用：CTRL_SOFT_RESET 是自清除脉冲，清空本路 bridge 的视频/C2H FIFO 和行计数，
+ * bridge 从下一个 SOF 重新开始送帧。CTRL_ENABLE/TEST_MODE 按当前配置一起写回，采集不中断。
+ */
+/* 函数：脉冲本路 bridge 的软复位 */
+void video_cap_soft_reset(struct video_cap_dev *dev)
+{
+	u32 ctrl = CTRL_ENABLE | CTRL_SOFT_RESET;
+	u32 off;
+
+	if (!dev->user_regs)
+		return;
+
+	if (dev->test_pattern)
+		ctrl |= CTRL_TEST_MODE;
+
+	if (dev->multi && dev->multi->has_per_ch_regs)
+		off = video_cap_ch_reg_off(dev, REG_CH_OFF_CONTROL);
+	else
+		off = REG_CONTROL;
+	video_cap_reg_write32(dev, off, ctrl);
+	/* 读回一次把 posted write 推到 FPGA，之后再重新挂 DMA */
+	(void)video_cap_reg_read32(dev, off);
+}
+
 /* 初始化统计计数器（用于 dmesg 打印 / V4L2 volatile ctrl） */
 void video_cap_stats_init(struct video_cap_dev *dev)
 {
@@ -164,18 +311,48 @@ void video_cap_stats_init(struct video_cap_dev *dev)
 	atomic64_set(&dev->stats.dma_error, 0);
 	atomic64_set(&dev->stats.dma_short, 0);
 	atomic64_set(&dev->stats.dma_trim, 0);
+	atomic64_set(&dev->stats.chain_build_fail, 0);
+	atomic64_set(&dev->stats.frame_drop, 0);
+	atomic64_set(&dev->stats.poll_hit, 0);
+	atomic64_set(&dev->stats.poll_miss, 0);
+	atomic64_set(&dev->stats.vsync_ts_miss, 0);
+	atomic64_set(&dev->stats.slice_event, 0);
+	atomic64_set(&dev->stats.meta_drop, 0);
+	atomic64_set(&dev->stats.desc_per_frame, 0);
+	atomic64_set(&dev->stats.source_change, 0);
+	atomic64_set(&dev->stats.recover, 0);
+	atomic64_set(&dev->stats.recover_us, 0);
+	atomic64_set(&dev->stats.superseded, 0);
+	atomic64_set(&dev->stats.sync_event, 0);
+	atomic64_set(&dev->stats.qos_throttle, 0);
+	atomic64_set(&dev->stats.qos_skip, 0);
 }
 
 /* 打印当前统计计数器（用于 probe/streamoff/remove 观察运行情况） */
 void video_cap_stats_dump(struct video_cap_dev *dev, const char *tag)
 {
 	dev_info(&dev->pdev->dev,
-		 "%s: vsync_isr=%lld vsync_wait=%lld vsync_timeout=%lld dma_submit=%lld dma_error=%lld dma_short=%lld dma_trim=%lld\n",
+		 "%s: vsync_isr=%lld vsync_wait=%lld vsync_timeout=%lld dma_submit=%lld dma_error=%lld dma_short=%lld dma_trim=%lld chain_build_fail=%lld frame_drop=%lld poll_hit=%lld poll_miss=%lld vsync_ts_miss=%lld slice_event=%lld meta_drop=%lld desc_per_frame=%lld source_change=%lld recover=%lld recover_us=%lld superseded=%lld sync_event=%lld qos_throttle=%lld qos_skip=%lld\n",
 		 tag, (long long)atomic64_read(&dev->stats.vsync_isr),
 		 (long long)atomic64_read(&dev->stats.vsync_wait),
 		 (long long)atomic64_read(&dev->stats.vsync_timeout),
 		 (long long)atomic64_read(&dev->stats.dma_submit),
 		 (long long)atomic64_read(&dev->stats.dma_error),
 		 (long long)atomic64_read(&dev->stats.dma_short),
-		 (long long)atomic64_read(&dev->stats.dma_trim));
+		 (long long)atomic64_read(&dev->stats.dma_trim),
+		 (long long)atomic64_read(&dev->stats.chain_build_fail),
+		 (long long)atomic64_read(&dev->stats.frame_drop),
+		 (long long)atomic64_read(&dev->stats.poll_hit),
+		 (long long)atomic64_read(&dev->stats.poll_miss),
+		 (long long)atomic64_read(&dev->stats.vsync_ts_miss),
+		 (long long)atomic64_read(&dev->stats.slice_event),
+		 (long long)atomic64_read(&dev->stats.meta_drop),
+		 (long long)atomic64_read(&dev->stats.desc_per_frame),
+		 (long long)atomic64_read(&dev->stats.source_change),
+		 (long long)atomic64_read(&dev->stats.recover),
+		 (long long)atomic64_read(&dev->stats.recover_us),
+		 (long long)atomic64_read(&dev->stats.superseded),
+		 (long long)atomic64_read(&dev->stats.sync_event),
+		 (long long)atomic64_read(&dev->stats.qos_throttle),
+		 (long long)atomic64_read(&dev->stats.qos_skip));
 }
@@ -0,0 +1,327 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * video_cap_pcie_v4l2_meta.c
+ *
+ * 每帧元数据节点（meta_node=1）：每个 /dev/videoX 旁边再注册一个 V4L2_BUF_TYPE_META_CAPTURE 节点，
+ * 视频 buffer 归还时顺带填一个 struct video_cap_meta（格式定义见 video_cap_pcie_v4l2_uapi.h）：
+ * - VSYNC / DMA 挂上 engine / DMA 完成三个时间戳、实际字节数、是否裁剪过 DMA 长度
+ * - 完成时的 STATUS（或 CH_STATUS）/ IRQ_STATUS 与 FPGA 帧计数寄存器
+ *
+ * 元数据节点有自己的 vb2_queue（vmalloc，MMAP/READ），与视频节点各自 STREAMON/STREAMOFF；
+ * 填写发生在 DMA 完成回调里（原子上下文），没有排队的元数据 buffer 时这一帧的元数据计入 meta_drop。
+ */
+
+#include <linux/module.h>
+
+#include <media/v4l2-ioctl.h>
+#include <media/videobuf2-vmalloc.h>
+
+#include "video_cap_pcie_v4l2_priv.h"
+#include "video_cap_regs.h"
+
+/* 元数据 buffer 封装：vb2_v4l2_buffer + meta_list 节点 */
+struct video_cap_meta_buffer {
+	struct vb2_v4l2_buffer vb;
+	struct list_head list;
+};
+
+/*
+ * 读取完成时的 FPGA 状态（原子上下文，只有 MMIO 读）：
+ * per-channel 寄存器窗口可用时读本通道的 CH_STATUS / CH_FRAME_COUNT，否则读全局 STATUS / DBG_FRAME_COUNT。
+ * 帧计数寄存器读回 REG_UNMAPPED_VALUE 表示当前 bitstream 没有实现。
+ */
+/* 函数：采样 STATUS/IRQ_STATUS/帧计数 */
+static void video_cap_meta_hw_sample(struct video_cap_dev *dev, struct video_cap_meta *meta)
+{
+	u32 count;
+
+	if (dev->multi->has_per_ch_regs) {
+		meta->status = video_cap_reg_read32(dev, video_cap_ch_reg_off(dev, REG_CH_OFF_STATUS));
+		count = video_cap_reg_read32(dev, video_cap_ch_reg_off(dev, REG_CH_OFF_FRAME_COUNT));
+	} else {
+		meta->status = video_cap_reg_read32(dev, REG_STATUS);
+		count = video_cap_reg_read32(dev, REG_DBG_FRAME_COUNT);
+	}
+	meta->irq_status = video_cap_reg_read32(dev, REG_IRQ_STATUS);
+
+	if (count == REG_UNMAPPED_VALUE)
+		meta->flags |= VIDEO_CAP_META_F_NO_HW_COUNT;
+	else
+		meta->hw_frame_count = count;
+
+	if (meta->status != REG_UNMAPPED_VALUE && (meta->status & STS_FIFO_OVERFLOW))
+		meta->flags |= VIDEO_CAP_META_F_FIFO_OVERFLOW;
+	if (meta->irq_status != REG_UNMAPPED_VALUE && (meta->irq_status & IRQ_OVERFLOW))
+		meta->flags |= VIDEO_CAP_META_F_FIFO_OVERFLOW;
+	if (meta->irq_status != REG_UNMAPPED_VALUE && (meta->irq_status & IRQ_UNDERFLOW))
+		meta->flags |= VIDEO_CAP_META_F_FIFO_UNDERFLOW;
+}
+
+/*
+ * 视频 buffer 归还前调用（DMA 完成回调，持有 engine->lock）：
+ * 取一个已排队的元数据 buffer 填好并 DONE。必须在视频 buffer 的 vb2_buffer_done() 之前调用，
+ * 之后 buf 可能已经被用户态 DQBUF/QBUF。
+ * 摘 buffer 到 vb2_buffer_done() 全程持有 meta_qlock：元数据 STREAMOFF 在同一把锁下关开关，
+ * 返回后不会再有回调手里拿着它的 buffer。寄存器采样放在锁外。
+ */
+/* 函数：为一帧视频填写并交付元数据 */
+void video_cap_meta_frame(struct video_cap_dev *dev, struct video_cap_buffer *buf,
+			  enum vb2_buffer_state state, ssize_t n, u64 done_ns)
+{
+	struct video_cap_meta_buffer *mbuf;
+	struct video_cap_meta meta = {};
+	unsigned long flags;
+
+	if (!READ_ONCE(dev->meta_streaming))
+		return;
+
+	meta.index = buf->vb.vb2_buf.index;
+	meta.submit_ns = buf->submit_ns;
+	meta.done_ns = done_ns;
+	meta.bytes = n > 0 ? (u32)n : 0;
+	if (buf->trimmed)
+		meta.flags |= VIDEO_CAP_META_F_TRIMMED;
+
+	if (state == VB2_BUF_STATE_DONE) {
+		meta.sequence = buf->vb.sequence;
+		meta.vsync_ns = buf->vb.vb2_buf.timestamp;
+		if (meta.vsync_ns == done_ns)
+			meta.flags |= VIDEO_CAP_META_F_TS_FALLBACK;
+	} else {
+		meta.sequence = dev->sequence;
+		meta.flags |= VIDEO_CAP_META_F_ERROR;
+	}
+
+	video_cap_meta_hw_sample(dev, &meta);
+
+	spin_lock_irqsave(&dev->meta_qlock, flags);
+	if (!dev->meta_streaming || list_empty(&dev->meta_list)) {
+		spin_unlock_irqrestore(&dev->meta_qlock, flags);
+		atomic64_inc(&dev->stats.meta_drop);
+		return;
+	}
+	mbuf = list_first_entry(&dev->meta_list, struct video_cap_meta_buffer, list);
+	list_del(&mbuf->list);
+
+	memcpy(vb2_plane_vaddr(&mbuf->vb.vb2_buf, 0), &meta, sizeof(meta));
+	mbuf->vb.sequence = meta.sequence;
+	mbuf->vb.field = V4L2_FIELD_NONE;
+	mbuf->vb.vb2_buf.timestamp = meta.vsync_ns ? meta.vsync_ns : done_ns;
+	vb2_set_plane_payload(&mbuf->vb.vb2_buf, 0, sizeof(meta));
+	vb2_buffer_done(&mbuf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+	spin_unlock_irqrestore(&dev->meta_qlock, flags);
+}
+
+/* vb2 回调：元数据 buffer 固定一个 plane，大小为 struct video_cap_meta */
+static int video_cap_meta_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers,
+				      unsigned int *nplanes, unsigned int sizes[],
+				      struct device *alloc_devs[])
+{
+	(void)vq;
+	(void)nbuffers;
+	(void)alloc_devs;
+
+	if (*nplanes)
+		return sizes[0] < sizeof(struct video_cap_meta) ? -EINVAL : 0;
+
+	*nplanes = 1;
+	sizes[0] = sizeof(struct video_cap_meta);
+	return 0;
+}
+
+/* vb2 回调：检查元数据 buffer 大小 */
+static int video_cap_meta_buf_prepare(struct vb2_buffer *vb)
+{
+	if (vb2_plane_size(vb, 0) < sizeof(struct video_cap_meta))
+		return -EINVAL;
+
+	vb2_set_plane_payload(vb, 0, sizeof(struct video_cap_meta));
+	return 0;
+}
+
+/* vb2 回调：QBUF 的元数据 buffer 挂到 meta_list，等下一帧视频完成时填写 */
+static void video_cap_meta_buf_queue(struct vb2_buffer *vb)
+{
+	struct video_cap_dev *dev = vb2_get_drv_priv(vb->vb2_queue);
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct video_cap_meta_buffer *mbuf = container_of(vbuf, struct video_cap_meta_buffer, vb);
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->meta_qlock, flags);
+	list_add_tail(&mbuf->list, &dev->meta_list);
+	spin_unlock_irqrestore(&dev->meta_qlock, flags);
+}
+
+/* vb2 回调：元数据 STREAMON（只打开开关，与视频节点是否在采集无关） */
+static int video_cap_meta_start_streaming(struct vb2_queue *vq, unsigned int count)
+{
+	struct video_cap_dev *dev = vb2_get_drv_priv(vq);
+	unsigned long flags;
+
+	(void)count;
+
+	spin_lock_irqsave(&dev->meta_qlock, flags);
+	dev->meta_streaming = true;
+	spin_unlock_irqrestore(&dev->meta_qlock, flags);
+	return 0;
+}
+
+/* vb2 回调：元数据 STREAMOFF，关开关并以 ERROR 归还 meta_list 上所有 buffers */
+static void video_cap_meta_stop_streaming(struct vb2_queue *vq)
+{
+	struct video_cap_dev *dev = vb2_get_drv_priv(vq);
+	struct video_cap_meta_buffer *mbuf, *tmp;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&dev->meta_qlock, flags);
+	dev->meta_streaming = false;
+	list_splice_init(&dev->meta_list, &list);
+	spin_unlock_irqrestore(&dev->meta_qlock, flags);
+
+	list_for_each_entry_safe(mbuf, tmp, &list, list) {
+		list_del(&mbuf->list);
+		vb2_buffer_done(&mbuf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+}
+
+static const struct vb2_ops video_cap_meta_vb2_ops = {
+	.queue_setup = video_cap_meta_queue_setup,
+	.buf_prepare = video_cap_meta_buf_prepare,
+	.buf_queue = video_cap_meta_buf_queue,
+	.start_streaming = video_cap_meta_start_streaming,
+	.stop_streaming = video_cap_meta_stop_streaming,
+	.wait_prepare = vb2_ops_wait_prepare,
+	.wait_finish = vb2_ops_wait_finish,
+};
+
+/* V4L2：上报元数据节点能力 */
+static int video_cap_meta_querycap(struct file *file, void *priv, struct v4l2_capability *cap)
+{
+	struct video_cap_dev *dev = video_drvdata(file);
+
+	(void)priv;
+
+	strscpy(cap->driver, DRV_NAME, sizeof(cap->driver));
+	strscpy(cap->card, "PCIe Video Capture metadata", sizeof(cap->card));
+	strscpy(cap->bus_info, pci_name(dev->pdev), sizeof(cap->bus_info));
+	cap->device_caps = V4L2_CAP_META_CAPTURE | V4L2_CAP_STREAMING | V4L2_CAP_READWRITE;
+	cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+	return 0;
+}
+
+/* V4L2：枚举元数据格式（只有 V4L2_META_FMT_VIDEO_CAP） */
+static int video_cap_meta_enum_fmt(struct file *file, void *priv, struct v4l2_fmtdesc *f)
+{
+	(void)file;
+	(void)priv;
+
+	if (f->index != 0)
+		return -EINVAL;
+
+	f->pixelformat = V4L2_META_FMT_VIDEO_CAP;
+	strscpy(f->description, "video_cap per-frame metadata", sizeof(f->description));
+	return 0;
+}
+
+/* V4L2：元数据格式固定，g/s/try_fmt 都返回同一个 */
+static int video_cap_meta_g_fmt(struct file *file, void *priv, struct v4l2_format *f)
+{
+	(void)file;
+	(void)priv;
+
+	f->fmt.meta.dataformat = V4L2_META_FMT_VIDEO_CAP;
+	f->fmt.meta.buffersize = sizeof(struct video_cap_meta);
+	return 0;
+}
+
+static const struct v4l2_ioctl_ops video_cap_meta_ioctl_ops = {
+	.vidioc_querycap = video_cap_meta_querycap,
+
+	.vidioc_enum_fmt_meta_cap = video_cap_meta_enum_fmt,
+	.vidioc_g_fmt_meta_cap = video_cap_meta_g_fmt,
+	.vidioc_s_fmt_meta_cap = video_cap_meta_g_fmt,
+	.vidioc_try_fmt_meta_cap = video_cap_meta_g_fmt,
+
+	.vidioc_reqbufs = vb2_ioctl_reqbufs,
+	.vidioc_create_bufs = vb2_ioctl_create_bufs,
+	.vidioc_prepare_buf = vb2_ioctl_prepare_buf,
+	.vidioc_querybuf = vb2_ioctl_querybuf,
+	.vidioc_qbuf = vb2_ioctl_qbuf,
+	.vidioc_dqbuf = vb2_ioctl_dqbuf,
+	.vidioc_streamon = vb2_ioctl_streamon,
+	.vidioc_streamoff = vb2_ioctl_streamoff,
+};
+
+static const struct v4l2_file_operations video_cap_meta_fops = {
+	.owner = THIS_MODULE,
+	.open = v4l2_fh_open,
+	.release = vb2_fop_release,
+	.read = vb2_fop_read,
+	.poll = vb2_fop_poll,
+	.mmap = vb2_fop_mmap,
+	.unlocked_ioctl = video_ioctl2,
+};
+
+/*
+ * 注册 /dev/videoX 的元数据节点（video_cap_register_v4l2 里、视频节点注册之后调用）：
+ * 名字为 video_cap_c2h%u_meta，与视频节点挂在同一个 v4l2_device 下。
+ */
+int video_cap_register_meta(struct video_cap_dev *dev)
+{
+	int ret;
+
+	mutex_init(&dev->meta_lock);
+	spin_lock_init(&dev->meta_qlock);
+	INIT_LIST_HEAD(&dev->meta_list);
+
+	dev->meta_queue.type = V4L2_BUF_TYPE_META_CAPTURE;
+	dev->meta_queue.io_modes = VB2_MMAP | VB2_READ;
+	dev->meta_queue.drv_priv = dev;
+	dev->meta_queue.buf_struct_size = sizeof(struct video_cap_meta_buffer);
+	dev->meta_queue.ops = &video_cap_meta_vb2_ops;
+	dev->meta_queue.mem_ops = &vb2_vmalloc_memops;
+	dev->meta_queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC |
+					  V4L2_BUF_FLAG_TSTAMP_SRC_SOE;
+	dev->meta_queue.lock = &dev->meta_lock;
+	dev->meta_queue.dev = &dev->pdev->dev;
+
+	ret = vb2_queue_init(&dev->meta_queue);
+	if (ret) {
+		dev_err(&dev->pdev->dev, "meta vb2_queue_init failed: %d\n", ret);
+		return ret;
+	}
+
+	dev->meta_vdev.v4l2_dev = &dev->multi->v4l2_dev;
+	dev->meta_vdev.fops = &video_cap_meta_fops;
+	dev->meta_vdev.ioctl_ops = &video_cap_meta_ioctl_ops;
+	dev->meta_vdev.queue = &dev->meta_queue;
+	dev->meta_vdev.lock = &dev->meta_lock;
+	dev->meta_vdev.release = video_device_release_empty;
+	dev->meta_vdev.device_caps = V4L2_CAP_META_CAPTURE | V4L2_CAP_STREAMING |
+				     V4L2_CAP_READWRITE;
+
+	snprintf(dev->meta_vdev.name, sizeof(dev->meta_vdev.name), "video_cap_c2h%u_meta",
+		 dev->c2h_channel);
+	video_set_drvdata(&dev->meta_vdev, dev);
+
+	ret = video_register_device(&dev->meta_vdev, VFL_TYPE_VIDEO, -1);
+	if (ret) {
+		dev_err(&dev->pdev->dev, "meta video_register_device failed: %d\n", ret);
+		return ret;
+	}
+
+	dev->meta_registered = true;
+	return 0;
+}
+
+/* 注销元数据节点（视频节点注销之前调用，此时视频侧已 STREAMOFF） */
+void video_cap_unregister_meta(struct video_cap_dev *dev)
+{
+	if (!dev->meta_registered)
+		return;
+
+	video_unregister_device(&dev->meta_vdev);
+	dev->meta_registered = false;
+}
@@ -1,9 +1,11 @@
 // SPDX-License-Identifier: GPL-2.0
 #pragma once
 
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/kthread.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/mutex.h>
 #include <linux/pci.h>
 #include <linux/scatterlist.h>
@@ -11,6 +13,7 @@
 #include <linux/timekeeping.h>
 #include <linux/types.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <linux/videodev2.h>
 
@@ -18,18 +21,44 @@
 #include <media/v4l2-device.h>
 #include <media/videobuf2-v4l2.h>
 
-struct xdma_dev;
+#include "libxdma.h"
+#include "video_cap_pcie_v4l2_uapi.h"
 
 #define DRV_NAME "video_cap_pcie_v4l2"
 
 /*
- * 默认视频参数（当前驱动会把 TRY_FMT/S_FMT 固定到这些默认值，属于 bring-up 取舍）
- * 后续如果要支持动态分辨率/帧率，需要扩展 FPGA 侧以及驱动的寄存器/校验逻辑。
+ * 默认视频参数：FPGA 不提供实测时序（旧 bitstream 或 src_poll_ms=0）时 TRY_FMT/S_FMT 固定到这些值，
+ * 否则分辨率/帧率取 REG_VID_RESOLUTION / REG_VID_FRAME_PERIOD 的实测值（见 video_cap_src_init()）
  */
 #define VIDEO_WIDTH_DEFAULT  1920
 #define VIDEO_HEIGHT_DEFAULT 1080
 #define VIDEO_FRAME_RATE_60  60
 #define XDMA_USER_IRQ_MAX    16U
+/* pipeline 模式下同时挂在 C2H engine 上的最大帧数（实际还受 XDMA 描述符环容量限制） */
+#define VIDEO_CAP_PIPELINE_MAX 8U
+/* VSYNC 时间戳环的槽数（2 的幂）：ISR 单写者，读者无锁按序号校验 */
+#define VIDEO_CAP_VSYNC_RING 16U
+/* hybrid 完成模式的忙等窗口上限（us） */
+#define VIDEO_CAP_POLL_US_MAX 2000U
+/* 分片交付：一帧最多切成的分片数（每个分片边界一次描述符完成中断） */
+#define VIDEO_CAP_SLICES_MAX 16U
+/* 用户态来不及 QBUF 时的处理（overrun_policy）：停住 engine / DMA 进 scratch 丢帧 */
+#define VIDEO_CAP_OVERRUN_STALL 0U
+#define VIDEO_CAP_OVERRUN_DRAIN 1U
+/* 实测分辨率的合理范围，超出按无信号处理（bridge 的每帧行数是 12 bit） */
+#define VIDEO_CAP_SRC_MIN        64U
+#define VIDEO_CAP_SRC_WIDTH_MAX  8192U
+#define VIDEO_CAP_SRC_HEIGHT_MAX 4095U
+/*
+ * bridge 把 4 个 32-bit word 拼成一个 128-bit beat，每行 word 数不是 4 的倍数时帧尾对不上 beat。
+ * XBGR32 一像素一个 word、YUYV 两像素一个 word，多路格式可以不同，统一要求宽度按 8 对齐
+ */
+#define VIDEO_CAP_SRC_WIDTH_ALIGN 8U
+/* 带宽 QoS：最大降帧系数（每 N 帧采 1 帧）/ 两次降级的最小间隔 / 拥塞停多久恢复一级 / 最高优先级 */
+#define VIDEO_CAP_QOS_DIV_MAX   8U
+#define VIDEO_CAP_QOS_HOLD_MS   250U
+#define VIDEO_CAP_QOS_RELAX_MS  2000U
+#define VIDEO_CAP_QOS_PRIO_MAX  7
 
 /*
  * 自定义 V4L2 controls ID：
@@ -42,12 +71,23 @@ struct xdma_dev;
 #define V4L2_CID_VIDEO_CAP_VSYNC_TIMEOUT_MS (V4L2_CID_USER_BASE + 0xF2)
 #define V4L2_CID_VIDEO_CAP_VSYNC_TIMEOUT    (V4L2_CID_USER_BASE + 0xF3)
 #define V4L2_CID_VIDEO_CAP_DMA_ERROR        (V4L2_CID_USER_BASE + 0xF4)
+#define V4L2_CID_VIDEO_CAP_POLL_US          (V4L2_CID_USER_BASE + 0xF5)
+#define V4L2_CID_VIDEO_CAP_DESC_PER_FRAME   (V4L2_CID_USER_BASE + 0xF6)
+#define V4L2_CID_VIDEO_CAP_LOW_LATENCY      (V4L2_CID_USER_BASE + 0xF7)
+#define V4L2_CID_VIDEO_CAP_SUPERSEDED       (V4L2_CID_USER_BASE + 0xF8)
+#define V4L2_CID_VIDEO_CAP_QOS_PRIORITY     (V4L2_CID_USER_BASE + 0xF9)
 
 #ifndef V4L2_PIX_FMT_XBGR32
 /* v4l2-ctl shows 'XR24' for 32-bit BGRX. */
 #define V4L2_PIX_FMT_XBGR32 v4l2_fourcc('X', 'R', '2', '4')
 #endif
 
+/* 一次 VSYNC：seq=0 表示该槽正在被 ISR 改写 */
+struct video_cap_vsync_stamp {
+	u64 seq;
+	u64 ts_ns;
+};
+
 struct video_cap_stats {
 	atomic64_t vsync_isr;
 	atomic64_t vsync_wait;
@@ -56,12 +96,90 @@ struct video_cap_stats {
 	atomic64_t dma_error;
 	atomic64_t dma_short;
 	atomic64_t dma_trim;
+	atomic64_t chain_build_fail;
+	atomic64_t frame_drop;
+	atomic64_t poll_hit;
+	atomic64_t poll_miss;
+	atomic64_t vsync_ts_miss;
+	atomic64_t slice_event;
+	atomic64_t meta_drop;
+	atomic64_t desc_per_frame; /* 最近一次预建链/逐帧提交的描述符数（不是累计值） */
+	atomic64_t source_change;
+	atomic64_t recover;    /* dma_recover 复位 engine/bridge 的次数 */
+	atomic64_t recover_us; /* 累计恢复耗时（出错 -> 恢复后第一帧 DONE），即丢失的视频时长 */
+	atomic64_t superseded; /* 低延时模式：完成了但被更新的帧顶掉、没交给用户的帧数 */
+	atomic64_t sync_event; /* 发出的 FRAME_SYNC / DMA_START 事件数 */
+	atomic64_t qos_throttle; /* 带宽 QoS 选中这一路降一级的次数 */
+	atomic64_t qos_skip;     /* VSYNC 门控模式下因降帧没挂的帧数 */
+};
+
+/* FPGA 实测的输入时序（REG_VID_RESOLUTION / REG_VID_FRAME_PERIOD），全 0 = 无信号 */
+struct video_cap_timing {
+	u32 width;
+	u32 height;
+	u32 period_us;
 };
 
-/* vb2 buffer 封装：vb2_v4l2_buffer + 链表节点 */
+/*
+ * 每帧流水线各段的延迟（debugfs latency，见 video_cap_pcie_v4l2_debugfs.c）：
+ * log2 直方图，bucket[i] 统计 [2^i, 2^(i+1)) ns，最后一档收下所有更大的值
+ */
+enum video_cap_lat_id {
+	VIDEO_CAP_LAT_VSYNC_WAKE,  /* VSYNC ISR -> 采集 work 运行（VSYNC 门控模式） */
+	VIDEO_CAP_LAT_WAKE_SUBMIT, /* 采集 work 运行 -> 挂上 engine */
+	VIDEO_CAP_LAT_SUBMIT_DONE, /* 挂上 engine -> DMA 完成中断 */
+	VIDEO_CAP_LAT_DONE_VB2,    /* DMA 完成中断 -> vb2_buffer_done */
+	VIDEO_CAP_LAT_QBUF_FILL,   /* QBUF -> 挂上 engine 开始填充 */
+	VIDEO_CAP_LAT_RECOVER,     /* DMA 出错 -> 恢复后第一帧 DONE（每次恢复一个样本） */
+	VIDEO_CAP_LAT_NUM,
+};
+
+/* DMA 出错后的恢复状态（dma_recover=1，见 video_cap_recover_request()） */
+enum video_cap_recover_state {
+	VIDEO_CAP_RECOVER_IDLE,
+	VIDEO_CAP_RECOVER_PENDING, /* 已发现错误，等采集 work 复位 engine/bridge */
+	VIDEO_CAP_RECOVER_RESYNC,  /* 已复位，等下一帧完整 DONE */
+};
+
+#define VIDEO_CAP_HIST_BUCKETS 32U
+
+struct video_cap_hist {
+	atomic64_t bucket[VIDEO_CAP_HIST_BUCKETS];
+	atomic64_t count;
+	atomic64_t sum_ns;
+	atomic64_t max_ns;
+};
+
+/*
+ * vb2 buffer 封装：vb2_v4l2_buffer + 链表节点
+ * - lnode：QBUF 时无锁挂到 dev->incoming，消费方在 qlock 下按序并进 buf_list
+ * - list：在 buf_list（等待提交）或 armed_list（已提交给 XDMA）上
+ * - cb：pipeline 模式下 nowait 提交的回调句柄
+ * - chain：buf_init 时按 sizeimage 预建的 XDMA 描述符链（NULL 时走逐帧建 request 的旧路径）
+ * - slice_desc[0..slice_cnt)：第 i+1 个分片边界落地时链上已完成的描述符数（xdma_chain_mark 返回值）
+ * - slices_done：本帧已经发过事件的分片数，每次挂上 engine 时清零
+ * - contig_sgt/contig_sg：dma_contig 模式下由 video_cap_buf_sgt() 封装的 sg_table
+ * - submit_ns/trimmed：最近一次挂上 engine 的时刻、DMA 长度是否比 buffer 短（每帧元数据用）
+ * - qbuf_ns：QBUF 的时刻（latency 直方图用）
+ * - pages_local/pages_remote：buf_init 时这个 buffer 在设备 NUMA 节点上/外的页数（debugfs numa）
+ */
 struct video_cap_buffer {
 	struct vb2_v4l2_buffer vb;
+	struct llist_node lnode;
 	struct list_head list;
+	struct xdma_io_cb cb;
+	struct video_cap_dev *dev;
+	struct xdma_chain *chain;
+	unsigned int slice_desc[VIDEO_CAP_SLICES_MAX - 1];
+	unsigned int slice_cnt;
+	unsigned int slices_done;
+	struct sg_table contig_sgt;
+	struct scatterlist contig_sg[VIDEO_CAP_SLICES_MAX];
+	u64 submit_ns;
+	u64 qbuf_ns;
+	unsigned long pages_local;
+	unsigned long pages_remote;
+	bool trimmed;
 };
 
 struct video_cap_multi;
@@ -71,9 +189,16 @@ struct video_cap_multi;
  * - dev->c2h_channel：对应 XDMA 的 C2H engine index
  * - dev->irq_index：对应 XDMA 的 user IRQ bit index（用作 VSYNC）
  *
- * 采集模型：
- * - 用户态 QBUF -> 进入 buf_list
- * - 采集线程等待 VSYNC -> 发起一次整帧 DMA -> vb2_buffer_done()
+ * 采集模型（没有每路一个的采集线程，状态机由 VSYNC ISR / DMA 完成回调 / QBUF 调度 cap_work 推进）：
+ * - 用户态 QBUF -> 无锁挂到 incoming，采集 work / ring refill 在 qlock 下并进 buf_list
+ * - pipeline_depth=0：VSYNC ISR 调度 work，engine 空闲时 nowait 挂一帧 -> 完成回调 vb2_buffer_done()
+ * - pipeline_depth>0：work 保持最多 N 个 buffer 挂在 engine 上（nowait 提交），
+ *   DMA 完成回调里直接 vb2_buffer_done() 并调度 work 补位，帧对齐依赖 FPGA bridge 在 SOF 处 arm
+ * - ring_mode：C2H engine 在自环描述符环上连续运行，不再逐帧启停；
+ *   帧完成中断里归还 buffer 并把下一个已排队 buffer 换进空出的槽，
+ *   没有 buffer 可用时该槽落到 scratch（warm-up 缓冲区），这一帧计为 frame_drop
+ * - overrun_policy=drain（非 ring 模式）：engine 上没有 buffer 时同样把帧 DMA 进 scratch，
+ *   FPGA bridge 的 FIFO 不会溢出，丢掉的帧计为 frame_drop 并占用一个 sequence
  */
 struct video_cap_dev {
 	struct video_cap_multi *multi;
@@ -88,23 +213,143 @@ struct video_cap_dev {
 	struct v4l2_ctrl *ctrl_skip;
 	struct v4l2_ctrl *ctrl_stat_vsync_timeout;
 	struct v4l2_ctrl *ctrl_stat_dma_error;
+	struct v4l2_ctrl *ctrl_stat_desc_per_frame;
+	struct v4l2_ctrl *ctrl_stat_superseded;
 	struct vb2_queue vb_queue;
 
 	struct mutex lock;
 	spinlock_t qlock;
 	struct list_head buf_list;
-	wait_queue_head_t wq;
+	struct llist_head incoming; /* buf_queue 无锁入队，见 video_cap_incoming_splice() */
 
-	wait_queue_head_t vsync_wq;
+	wait_queue_head_t vsync_wq; /* 只剩 warm-up 同步等 VSYNC */
 	atomic64_t vsync_seq;
+	struct video_cap_vsync_stamp vsync_ring[VIDEO_CAP_VSYNC_RING];
+	/* FRAME_SYNC / DMA_START 的订阅数：ISR 和提交路径读到 0 就不构造事件 */
+	atomic_t ev_frame_sync;
+	atomic_t ev_dma_start;
 	u32 vsync_timeout_ms;
 	u32 user_irq_mask;
 
-	struct task_struct *thread;
+	/*
+	 * 采集 work（非 ring 模式）：被 kick 时立即运行，空闲时每 vsync_timeout_ms 跑一次看门狗。
+	 * vsync_used/vsync_waiting/vsync_wait_jiffies 只在 work 里读写：
+	 * 最近一次挂帧用掉的 VSYNC 序号，以及 buffer 开始等 VSYNC 的时刻（VSYNC 门控模式）
+	 * work_cpu：work 固定排到的 CPU（numa_local=1 时取设备 NUMA 节点上的 CPU），WORK_CPU_UNBOUND 为不固定
+	 * cap_worker 非 NULL（rt_prio>0）时这一路不走共用的 cap_wq，而是自己的 SCHED_FIFO/RR kthread_worker
+	 * 跑 cap_kwork；rt_policy/rt_prio 为它的调度策略/优先级
+	 */
+	struct delayed_work cap_work;
+	struct kthread_worker *cap_worker;
+	struct kthread_delayed_work cap_kwork;
+	int rt_policy;
+	unsigned int rt_prio;
+	int work_cpu;
+	bool irq_hint; /* 已把本路 user IRQ / C2H engine 的 MSI-X 向量 affinity 设到 work_cpu */
+	u64 vsync_used;
+	bool vsync_waiting;
+	unsigned long vsync_wait_jiffies;
 	bool stopping;
 	bool streaming;
 	unsigned int sequence;
 
+	/* pipeline 模式：armed_list/armed 受 qlock 保护 */
+	unsigned int pipeline_depth;
+	unsigned int pipe_depth; /* 本次 STREAMON 实际生效的深度（描述符环放不下时调低） */
+	struct list_head armed_list;
+	unsigned int armed;
+	unsigned long armed_jiffies; /* 最近一次 DMA 进展（提交到空 engine / 完成） */
+
+	/* ring 模式：ring 在槽里的 buffer 同样挂在 armed_list 上 */
+	bool ring_mode;
+	struct xdma_ring *ring;
+	/* 指向 warm-up 缓冲区的整帧链：ring 的 scratch 槽 / overrun_policy=drain 的丢帧目标 */
+	struct xdma_chain *scratch_chain;
+
+	/* overrun_policy=drain：scratch 链同一时刻只挂一次，scratch_armed 受 qlock 保护 */
+	unsigned int overrun_policy;
+	struct xdma_io_cb scratch_cb;
+	bool scratch_armed;
+
+	/*
+	 * DMA 出错快速恢复（dma_recover=1）：recover_state 任意上下文原子切换，
+	 * recover_start_ns 为这次恢复开始计时的时刻（出错时刻，超时为最后一次 DMA 进展）
+	 */
+	bool dma_recover;
+	atomic_t recover_state;
+	u64 recover_start_ns;
+
+	/*
+	 * hot_restart=1：STREAMOFF 只停 engine，VSYNC IRQ、bridge 使能、warm-up 缓冲区、scratch 链和 ring
+	 * 留给下一次 STREAMON。hw_live 表示 IRQ/bridge 开着，hw_pixfmt/hw_test_pattern 为当时写入的配置；
+	 * skip_left 是完成路径上还要丢的 warm-up 帧数（只在完成回调里读写）
+	 */
+	bool hot_restart;
+	bool hw_live;
+	u32 hw_pixfmt;
+	bool hw_test_pattern;
+	unsigned int skip_left;
+	unsigned int ring_slots;
+
+	/*
+	 * 低延时模式（low_latency 控件）：mailbox 为最新完成、还没交给 vb2 的一帧，
+	 * mailbox_wait 表示有读者在等（完成时直接交付）；两者受 qlock 保护
+	 */
+	bool low_latency;
+	struct video_cap_buffer *mailbox;
+	bool mailbox_wait;
+
+	/*
+	 * 带宽 QoS（见 video_cap_pcie_v4l2_qos.c）：qos_prio 为 qos_priority 控件（越大越晚被降），
+	 * qos_bps 为 STREAMON 时登记的带宽（B/s，0 = 没登记），qos_div 为降帧系数（1 = 不降），
+	 * qos_period_ns 为登记时的帧周期，qos_next_ns 为降帧时下一次允许挂帧的时刻
+	 */
+	u32 qos_prio;
+	u64 qos_bps;
+	unsigned int qos_div;
+	u64 qos_period_ns;
+	u64 qos_next_ns;
+
+	/*
+	 * hybrid 完成（poll_us>0，仅 pipeline 模式）：按帧周期预测完成时刻，
+	 * poll_timer 提前 poll_us 调度 work 忙等 writeback；frame_period_ns 为完成间隔的 EWMA
+	 */
+	unsigned int poll_us;
+	bool hybrid_poll;
+	u64 frame_period_ns;
+	u64 last_done_ns;
+	u64 poll_last_ns; /* 预约忙等时最近一次完成的时刻（到点前又有完成则这次预约作废） */
+	struct hrtimer poll_timer;
+	bool poll_due;
+
+	/* 分片交付（slices>1）：见 video_cap_slice_progress() */
+	unsigned int slices;
+
+	/*
+	 * 每帧元数据节点（meta_node=1）：见 video_cap_pcie_v4l2_meta.c。
+	 * meta_list/meta_streaming 受 meta_qlock 保护（meta_streaming 允许无锁快速判断）
+	 */
+	bool meta_node;
+	bool meta_registered;
+	bool meta_streaming;
+	struct video_device meta_vdev;
+	struct vb2_queue meta_queue;
+	struct mutex meta_lock;
+	spinlock_t meta_qlock;
+	struct list_head meta_list;
+
+	/*
+	 * 延迟直方图（debugfs）：work_ns/lat_vsync_seen 只在采集 work 里读写，
+	 * 分别是本次 work 开始运行的时刻、最近一次计入 vsync_wake 的 VSYNC 序号
+	 */
+	struct video_cap_hist lat[VIDEO_CAP_LAT_NUM];
+	struct dentry *debugfs_dir;
+	u64 work_ns;
+	u64 lat_vsync_seen;
+	/* 所有已 buf_init 的 dma-sg buffers 在设备 NUMA 节点上/外的页数 */
+	atomic_long_t pages_local;
+	atomic_long_t pages_remote;
+
 	u32 width;
 	u32 height;
 	u32 pixfmt;
@@ -112,6 +357,7 @@ struct video_cap_dev {
 	u32 sizeimage;
 
 	bool test_pattern;
+	bool dma_contig; /* vb2-dma-contig 分配 buffer（整帧一段 DMA 地址） */
 	unsigned int skip;
 	unsigned int c2h_channel;
 	unsigned int irq_index;
@@ -120,6 +366,7 @@ struct video_cap_dev {
 	dma_addr_t warmup_dma;
 	struct sg_table warmup_sgt;
 	struct scatterlist warmup_sg;
+	u32 warmup_size;
 	bool warmup_inited;
 };
 
@@ -144,6 +391,30 @@ struct video_cap_multi {
 	u32 ch_count;
 
 	u32 user_irq_mask; /* registered bits */
+
+	/*
+	 * 输入时序检测（所有 /dev/videoX 共用一路输入）：src_detect 时 src_work 每 src_poll_ms
+	 * 读一次实测时序，变化时给各路发 V4L2_EVENT_SOURCE_CHANGE；src 受 src_lock 保护
+	 */
+	bool src_detect;
+	unsigned int src_poll_ms;
+	spinlock_t src_lock;
+	struct video_cap_timing src;
+	struct delayed_work src_work;
+
+	/*
+	 * 带宽 QoS：qos_link_bps 为链路预算（B/s，0 = 未知，不做准入），qos_used_bps 为各路登记之和；
+	 * qos_congest_ns / qos_change_ns 为最近一次拥塞信号 / 降帧系数调整的时刻。都受 qos_lock 保护
+	 */
+	bool qos_enabled;
+	spinlock_t qos_lock;
+	u64 qos_link_bps;
+	u64 qos_used_bps;
+	u64 qos_congest_ns;
+	u64 qos_change_ns;
+
+	/* 所有 /dev/videoX 的采集 work 共用（取代每路一个 kthread） */
+	struct workqueue_struct *cap_wq;
 	unsigned int num_devs;
 	struct video_cap_dev **devs;
 };
@@ -158,6 +429,14 @@ bool video_cap_detect_per_channel_regs(struct video_cap_multi *m);
 /* 计算某通道的寄存器偏移（REG_CH_BASE + ch*stride + off） */
 u32 video_cap_ch_reg_off(struct video_cap_dev *dev, u32 ch_off);
 
+/* ===== 输入时序检测 ===== */
+/* 读取实测输入时序（旧 bitstream 返回 -EOPNOTSUPP） */
+int video_cap_read_timing(struct video_cap_multi *m, struct video_cap_timing *t);
+/* 初始化输入时序检测（probe 时调用，返回是否启用；启用后由 probe 调度 src_work） */
+bool video_cap_src_init(struct video_cap_multi *m, unsigned int poll_ms);
+/* 读取最近一次实测时序（未启用检测时返回 false） */
+bool video_cap_src_timing(struct video_cap_multi *m, struct video_cap_timing *t);
+
 /* ===== 统计/打印 ===== */
 /* 初始化统计计数器 */
 void video_cap_stats_init(struct video_cap_dev *dev);
@@ -169,12 +448,24 @@ void video_cap_stats_dump(struct video_cap_dev *dev, const char *tag);
 void video_cap_apply_hw_format(struct video_cap_dev *dev);
 /* 使能/关闭 FPGA 采集（CTRL_ENABLE / CTRL_TEST_MODE） */
 int video_cap_enable(struct video_cap_dev *dev, bool enable);
+/* 脉冲本路 bridge 的软复位（采集保持使能） */
+void video_cap_soft_reset(struct video_cap_dev *dev);
 
-/* ===== vb2 / 采集线程 ===== */
+/* ===== vb2 / 采集状态机 ===== */
+/* 初始化采集 work / 入队 llist / hybrid hrtimer（probe 时调用） */
+void video_cap_capture_init(struct video_cap_dev *dev);
+/* 给这一路起专用的实时采集线程（probe 时、work_cpu 定下之后调用）/ remove 时停掉 */
+int video_cap_capture_rt(struct video_cap_dev *dev, int policy, unsigned int prio);
+void video_cap_capture_exit(struct video_cap_dev *dev);
+/* 释放 hot_restart 跨 STREAMOFF 保留的资源（remove 时调用） */
+void video_cap_capture_release(struct video_cap_dev *dev);
 /* VSYNC user IRQ handler（ISR） */
 irqreturn_t video_cap_user_irq_handler(int user, void *data);
-/* vb2: STREAMOFF 回调（停止采集线程/关闭 IRQ/归还 buffers） */
+/* vb2: STREAMOFF 回调（停止采集 work/关闭 IRQ/归还 buffers） */
 void video_cap_stop_streaming(struct vb2_queue *vq);
+/* 低延时模式：读者来取帧前把信箱里的帧交给 vb2 / 取完后撤销等待 */
+void video_cap_mailbox_flush(struct video_cap_dev *dev, bool wait);
+void video_cap_mailbox_idle(struct video_cap_dev *dev);
 /* vb2 ops 表（queue_setup/buf_queue/start/stop 等） */
 extern const struct vb2_ops video_cap_vb2_ops;
 
@@ -187,3 +478,45 @@ void video_cap_unregister_v4l2(struct video_cap_dev *dev);
 bool video_cap_pixfmt_supported(u32 pixfmt);
 /* 填充 v4l2_pix_format 的 bytesperline/sizeimage/colorspace 等 */
 void video_cap_fill_pix_format(struct v4l2_pix_format *pix, u32 width, u32 height, u32 pixfmt);
+/* 输入时序变化：发 V4L2_EVENT_SOURCE_CHANGE，采集中分辨率不符时让 vb2 队列进入 error */
+void video_cap_source_event(struct video_cap_dev *dev, const struct video_cap_timing *t);
+
+/* ===== debugfs（延迟直方图 / 完整计数器） ===== */
+/* 创建/删除模块的 debugfs 根目录（module init/exit） */
+void video_cap_debugfs_init(void);
+void video_cap_debugfs_exit(void);
+/* 为一个 /dev/videoX 建/删 debugfs 子目录（注册 video_device 之后/注销之前） */
+void video_cap_debugfs_register(struct video_cap_dev *dev);
+void video_cap_debugfs_unregister(struct video_cap_dev *dev);
+/* 记录一段延迟（任意上下文，调用方保证两个时刻先后有序） */
+void video_cap_lat_record(struct video_cap_dev *dev, enum video_cap_lat_id id, u64 ns);
+
+/* ===== 每帧元数据节点 ===== */
+/* 注册 /dev/videoX 旁边的 META_CAPTURE 节点 */
+int video_cap_register_meta(struct video_cap_dev *dev);
+/* 注销元数据节点（未注册时为空操作） */
+void video_cap_unregister_meta(struct video_cap_dev *dev);
+/* 视频 buffer 归还前填写并交付一帧元数据（DMA 完成回调，原子上下文） */
+void video_cap_meta_frame(struct video_cap_dev *dev, struct video_cap_buffer *buf,
+			  enum vb2_buffer_state state, ssize_t n, u64 done_ns);
+
+/* ===== 带宽 QoS ===== */
+/* 初始化链路预算（probe 时调用；budget_pct=0 关闭 QoS） */
+void video_cap_qos_init(struct video_cap_multi *m, unsigned int link_mbps,
+			unsigned int budget_pct);
+/* STREAMON 登记带宽（超出链路预算返回 -ENOSPC）/ STREAMOFF 撤销 */
+int video_cap_qos_admit(struct video_cap_dev *dev);
+void video_cap_qos_release(struct video_cap_dev *dev);
+/* remove 时把第 i 路从 devs[] 摘掉 */
+void video_cap_qos_unlink(struct video_cap_multi *m, unsigned int i);
+/* 这一路丢帧（任意上下文）：给优先级最低的一路降帧 */
+void video_cap_qos_congested(struct video_cap_dev *dev);
+/* 采集 work：拥塞过去后逐级恢复 / 挂帧前判断这一帧是否挂 */
+void video_cap_qos_relax(struct video_cap_dev *dev);
+bool video_cap_qos_gate(struct video_cap_dev *dev, u64 now);
+
+/* 这一路当前是否在降帧（采集 work 无锁读） */
+static inline bool video_cap_qos_throttled(struct video_cap_dev *dev)
+{
+	return READ_ONCE(dev->qos_div) > 1;
+}
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * video_cap_pcie_v4l2_qos.c
+ *
+ * 多路共用一条 PCIe 链路时的带宽 QoS（qos_budget_pct=0 关闭）：
+ * - 准入：STREAMON 时按 sizeimage × 帧率算出这一路要的带宽，和已登记的各路加起来超过链路预算
+ *   （协商出的链路带宽 × qos_budget_pct，或 qos_link_mbps 指定的实测值）就以 -ENOSPC 拒绝
+ * - 降级：各路 engine 在链路上由硬件仲裁，软件能决定的只是“哪些帧上链路”。某一路丢帧
+ *   （DMA 出错/长度不对/超时，通常是 bridge FIFO 溢出）时，把优先级最低（同级取带宽最大）的一路降帧：
+ *   每 qos_div 帧只挂 1 帧，其余帧不挂 engine，由 bridge 丢在 FPGA 里、不占链路；
+ *   拥塞停了 VIDEO_CAP_QOS_RELAX_MS 后从优先级最高的被降路开始逐级恢复
+ * - 降帧只作用在 VSYNC 门控和 pipeline 模式（挂帧在采集 work 里）；ring 模式 engine 连续运行，
+ *   不会被选中，但它的丢帧同样会让别的路让出带宽
+ *
+ * qos_lock 是最内层的锁（完成回调持有 engine->lock / qlock 时也会拿）。
+ * qos_div 只在 qos_lock 下改，采集 work 无锁读；qos_next_ns 只在采集 work 里读写。
+ */
+
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/pci.h>
+
+#include "video_cap_pcie_v4l2_priv.h"
+
+#define VIDEO_CAP_MB 1000000ULL
+
+/* 函数：初始化链路预算（probe 时调用，早于任何 STREAMON） */
+void video_cap_qos_init(struct video_cap_multi *m, unsigned int link_mbps,
+			unsigned int budget_pct)
+{
+	enum pcie_link_width width = PCIE_LNK_WIDTH_UNKNOWN;
+	enum pci_bus_speed speed = PCI_SPEED_UNKNOWN;
+	u32 mbps = link_mbps;
+
+	spin_lock_init(&m->qos_lock);
+	m->qos_enabled = budget_pct > 0;
+	m->qos_link_bps = 0;
+	m->qos_used_bps = 0;
+	if (!m->qos_enabled)
+		return;
+
+	/* 没给实测值：用协商出的链路带宽（已扣除线路编码，还没扣 TLP 头/读请求等开销，所以再乘预算比例） */
+	if (!mbps) {
+		mbps = pcie_bandwidth_available(m->pdev, NULL, &speed, &width);
+		mbps = (u32)div_u64((u64)mbps * min(budget_pct, 100U), 100);
+	}
+	if (!mbps) {
+		dev_info(&m->pdev->dev, "qos: link bandwidth unknown, no admission control\n");
+		return;
+	}
+
+	m->qos_link_bps = (u64)mbps * VIDEO_CAP_MB / 8;
+	dev_info(&m->pdev->dev, "qos: link budget %llu MB/s%s\n",
+		 div_u64(m->qos_link_bps, VIDEO_CAP_MB), link_mbps ? " (qos_link_mbps)" : "");
+}
+
+/* 函数：这一路的帧周期（ns）：实测帧周期，没有时按 60fps */
+static u64 video_cap_qos_period_ns(struct video_cap_dev *dev)
+{
+	struct video_cap_timing t;
+
+	if (video_cap_src_timing(dev->multi, &t) && t.period_us)
+		return (u64)t.period_us * NSEC_PER_USEC;
+	return div_u64(NSEC_PER_SEC, VIDEO_FRAME_RATE_60);
+}
+
+/* 函数：STREAMON 时登记这一路的带宽（超出链路预算返回 -ENOSPC） */
+int video_cap_qos_admit(struct video_cap_dev *dev)
+{
+	struct video_cap_multi *m = dev->multi;
+	u64 period = video_cap_qos_period_ns(dev);
+	u64 bps = div64_u64((u64)dev->sizeimage * NSEC_PER_SEC, period);
+	unsigned long flags;
+	u64 used;
+
+	dev->qos_period_ns = period;
+	dev->qos_next_ns = 0;
+	if (!m->qos_enabled)
+		return 0;
+
+	spin_lock_irqsave(&m->qos_lock, flags);
+	used = m->qos_used_bps;
+	if (m->qos_link_bps && used + bps > m->qos_link_bps) {
+		spin_unlock_irqrestore(&m->qos_lock, flags);
+		dev_err(&dev->pdev->dev,
+			"qos: /dev/video%d needs %llu MB/s (%u bytes every %llu us), link budget %llu MB/s, %llu MB/s already reserved\n",
+			dev->vdev.num, div_u64(bps, VIDEO_CAP_MB), dev->sizeimage,
+			div_u64(period, NSEC_PER_USEC), div_u64(m->qos_link_bps, VIDEO_CAP_MB),
+			div_u64(used, VIDEO_CAP_MB));
+		return -ENOSPC;
+	}
+	m->qos_used_bps = used + bps;
+	dev->qos_bps = bps;
+	WRITE_ONCE(dev->qos_div, 1);
+	spin_unlock_irqrestore(&m->qos_lock, flags);
+	return 0;
+}
+
+/* 函数：STREAMOFF / STREAMON 失败时撤销登记（没登记过时为空操作） */
+void video_cap_qos_release(struct video_cap_dev *dev)
+{
+	struct video_cap_multi *m = dev->multi;
+	unsigned long flags;
+
+	if (!m->qos_enabled)
+		return;
+
+	spin_lock_irqsave(&m->qos_lock, flags);
+	m->qos_used_bps -= dev->qos_bps;
+	dev->qos_bps = 0;
+	WRITE_ONCE(dev->qos_div, 1);
+	spin_unlock_irqrestore(&m->qos_lock, flags);
+}
+
+/* 函数：remove 时把一路从 devs[] 摘掉（别的路的拥塞处理会遍历 devs[]） */
+void video_cap_qos_unlink(struct video_cap_multi *m, unsigned int i)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&m->qos_lock, flags);
+	m->devs[i] = NULL;
+	spin_unlock_irqrestore(&m->qos_lock, flags);
+}
+
+/*
+ * 某一路丢了一帧（完成回调 / 看门狗，任意上下文）：距上次调整超过 VIDEO_CAP_QOS_HOLD_MS 时
+ * 给最该让的一路降一级。同一次拥塞往往几路、几帧连着丢，HOLD 内的后续信号只刷新拥塞时刻。
+ */
+/* 函数：拥塞信号 */
+void video_cap_qos_congested(struct video_cap_dev *dev)
+{
+	struct video_cap_multi *m = dev->multi;
+	struct video_cap_dev *victim = NULL;
+	u64 now = ktime_get_ns();
+	unsigned int i, div = 0;
+	unsigned long flags;
+
+	if (!m->qos_enabled || !dev->qos_bps)
+		return;
+
+	spin_lock_irqsave(&m->qos_lock, flags);
+	m->qos_congest_ns = now;
+	if (now - m->qos_change_ns < (u64)VIDEO_CAP_QOS_HOLD_MS * NSEC_PER_MSEC)
+		goto out;
+
+	for (i = 0; i < m->num_devs; i++) {
+		struct video_cap_dev *d = m->devs[i];
+
+		if (!d || !d->qos_bps || d->ring_mode || d->qos_div >= VIDEO_CAP_QOS_DIV_MAX)
+			continue;
+		if (!victim || READ_ONCE(d->qos_prio) < READ_ONCE(victim->qos_prio) ||
+		    (READ_ONCE(d->qos_prio) == READ_ONCE(victim->qos_prio) &&
+		     d->qos_bps > victim->qos_bps))
+			victim = d;
+	}
+	if (victim) {
+		div = victim->qos_div + 1;
+		WRITE_ONCE(victim->qos_div, div);
+		m->qos_change_ns = now;
+		atomic64_inc(&victim->stats.qos_throttle);
+	}
+out:
+	spin_unlock_irqrestore(&m->qos_lock, flags);
+
+	if (victim)
+		dev_warn_ratelimited(&victim->pdev->dev,
+				     "qos: link congested (loss on /dev/video%d), /dev/video%d now captures 1 of %u frames\n",
+				     dev->vdev.num, victim->vdev.num, div);
+}
+
+/* 函数：拥塞停了一段时间后恢复一级（采集 work 里调用；被降路里优先级最高的先恢复） */
+void video_cap_qos_relax(struct video_cap_dev *dev)
+{
+	struct video_cap_multi *m = dev->multi;
+	struct video_cap_dev *best = NULL;
+	u64 relax = (u64)VIDEO_CAP_QOS_RELAX_MS * NSEC_PER_MSEC;
+	u64 now = ktime_get_ns();
+	unsigned int i, div = 0;
+	unsigned long flags;
+
+	if (!video_cap_qos_throttled(dev))
+		return;
+
+	spin_lock_irqsave(&m->qos_lock, flags);
+	if (now - m->qos_congest_ns < relax || now - m->qos_change_ns < relax)
+		goto out;
+
+	for (i = 0; i < m->num_devs; i++) {
+		struct video_cap_dev *d = m->devs[i];
+
+		if (!d || !d->qos_bps || d->qos_div <= 1)
+			continue;
+		if (!best || READ_ONCE(d->qos_prio) > READ_ONCE(best->qos_prio) ||
+		    (READ_ONCE(d->qos_prio) == READ_ONCE(best->qos_prio) &&
+		     d->qos_bps < best->qos_bps))
+			best = d;
+	}
+	if (best == dev) {
+		div = dev->qos_div - 1;
+		WRITE_ONCE(dev->qos_div, div);
+		m->qos_change_ns = now;
+	}
+out:
+	spin_unlock_irqrestore(&m->qos_lock, flags);
+
+	if (div)
+		dev_info_ratelimited(&dev->pdev->dev, "qos: /dev/video%d back to 1 of %u frames\n",
+				     dev->vdev.num, div);
+}
+
+/*
+ * 采集 work 挂帧前调用：降帧时两次挂帧至少隔 qos_div 个帧周期（少算半个周期，吸收 VSYNC 抖动），
+ * 返回 false 表示这一帧不挂。没有降帧时总是 true。
+ */
+/* 函数：降帧闸门 */
+bool video_cap_qos_gate(struct video_cap_dev *dev, u64 now)
+{
+	unsigned int div = READ_ONCE(dev->qos_div);
+
+	if (div <= 1)
+		return true;
+	if (now < dev->qos_next_ns)
+		return false;
+
+	dev->qos_next_ns = now + (u64)div * dev->qos_period_ns - dev->qos_period_ns / 2;
+	return true;
+}
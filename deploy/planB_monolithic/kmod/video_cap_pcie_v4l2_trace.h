@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * video_cap_pcie_v4l2_trace.h
+ *
+ * 采集路径的 tracepoints（TRACE_SYSTEM video_cap），关掉时只是一个 static key 分支。
+ * - ch：C2H 通道号
+ * - seq：vsync_irq 为 VSYNC 序号；buf_done 为这一帧的 v4l2 sequence；
+ *   其余为事件发生时的 dev->sequence（下一个 DONE 帧将拿到的序号）
+ * - cookie：与 xdma:* 事件里的 cookie 相同（nowait 提交为 &buf->cb，ring 模式为 buf），
+ *   用来把 engine 上的一次 DMA 对回这一帧
+ *
+ * 只有 video_cap_pcie_v4l2_vb2.c 定义 CREATE_TRACE_POINTS。
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM video_cap
+
+#ifndef __VIDEO_CAP_PCIE_V4L2_TRACE_ERR__
+#define __VIDEO_CAP_PCIE_V4L2_TRACE_ERR__
+/* video_cap_error 的出错位置 */
+#define VIDEO_CAP_TRACE_ERR_SUBMIT        0 /* 提交 DMA 失败 */
+#define VIDEO_CAP_TRACE_ERR_SCRATCH       1 /* scratch 帧提交失败 */
+#define VIDEO_CAP_TRACE_ERR_DMA           2 /* DMA 完成但出错/长度不对 */
+#define VIDEO_CAP_TRACE_ERR_DMA_TIMEOUT   3 /* 看门狗：在飞 buffer 超时 */
+#define VIDEO_CAP_TRACE_ERR_VSYNC_TIMEOUT 4 /* 看门狗：等不到 VSYNC */
+#define VIDEO_CAP_TRACE_ERR_RECOVER       5 /* dma_recover：已复位 engine/bridge（err 为出错以来的 us） */
+#endif
+
+#if !defined(__VIDEO_CAP_PCIE_V4L2_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __VIDEO_CAP_PCIE_V4L2_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+#include "video_cap_pcie_v4l2_priv.h"
+
+TRACE_EVENT(video_cap_vsync_irq,
+	TP_PROTO(struct video_cap_dev *dev, u64 seq),
+	TP_ARGS(dev, seq),
+
+	TP_STRUCT__entry(
+		__field(u32, ch)
+		__field(u64, seq)
+	),
+
+	TP_fast_assign(
+		__entry->ch = dev->c2h_channel;
+		__entry->seq = seq;
+	),
+
+	TP_printk("ch=%u vsync=%llu", __entry->ch, __entry->seq)
+);
+
+TRACE_EVENT(video_cap_buf_queue,
+	TP_PROTO(struct video_cap_dev *dev, struct video_cap_buffer *buf),
+	TP_ARGS(dev, buf),
+
+	TP_STRUCT__entry(
+		__field(u32, ch)
+		__field(u32, seq)
+		__field(u32, index)
+	),
+
+	TP_fast_assign(
+		__entry->ch = dev->c2h_channel;
+		__entry->seq = dev->sequence;
+		__entry->index = buf->vb.vb2_buf.index;
+	),
+
+	TP_printk("ch=%u seq=%u index=%u", __entry->ch, __entry->seq, __entry->index)
+);
+
+TRACE_EVENT(video_cap_dma_submit,
+	TP_PROTO(struct video_cap_dev *dev, struct video_cap_buffer *buf, const void *cookie,
+		 unsigned int nents, unsigned int len),
+	TP_ARGS(dev, buf, cookie, nents, len),
+
+	TP_STRUCT__entry(
+		__field(u32, ch)
+		__field(u32, seq)
+		__field(u32, index)
+		__field(const void *, cookie)
+		__field(unsigned int, nents)
+		__field(unsigned int, len)
+	),
+
+	TP_fast_assign(
+		__entry->ch = dev->c2h_channel;
+		__entry->seq = dev->sequence;
+		__entry->index = buf->vb.vb2_buf.index;
+		__entry->cookie = cookie;
+		__entry->nents = nents;
+		__entry->len = len;
+	),
+
+	TP_printk("ch=%u seq=%u index=%u cookie=%p nents=%u len=%u", __entry->ch, __entry->seq,
+		  __entry->index, __entry->cookie, __entry->nents, __entry->len)
+);
+
+TRACE_EVENT(video_cap_dma_done,
+	TP_PROTO(struct video_cap_dev *dev, struct video_cap_buffer *buf, long bytes, int err),
+	TP_ARGS(dev, buf, bytes, err),
+
+	TP_STRUCT__entry(
+		__field(u32, ch)
+		__field(u32, seq)
+		__field(u32, index)
+		__field(long, bytes)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__entry->ch = dev->c2h_channel;
+		__entry->seq = dev->sequence;
+		__entry->index = buf->vb.vb2_buf.index;
+		__entry->bytes = bytes;
+		__entry->err = err;
+	),
+
+	TP_printk("ch=%u seq=%u index=%u bytes=%ld err=%d", __entry->ch, __entry->seq,
+		  __entry->index, __entry->bytes, __entry->err)
+);
+
+TRACE_EVENT(video_cap_buf_done,
+	TP_PROTO(struct video_cap_dev *dev, struct video_cap_buffer *buf, int state),
+	TP_ARGS(dev, buf, state),
+
+	TP_STRUCT__entry(
+		__field(u32, ch)
+		__field(u32, seq)
+		__field(u32, index)
+		__field(int, state)
+		__field(u64, timestamp)
+	),
+
+	TP_fast_assign(
+		__entry->ch = dev->c2h_channel;
+		__entry->seq = buf->vb.sequence;
+		__entry->index = buf->vb.vb2_buf.index;
+		__entry->state = state;
+		__entry->timestamp = buf->vb.vb2_buf.timestamp;
+	),
+
+	TP_printk("ch=%u seq=%u index=%u state=%s ts=%llu", __entry->ch, __entry->seq,
+		  __entry->index,
+		  __print_symbolic(__entry->state,
+				   { VB2_BUF_STATE_DONE, "DONE" },
+				   { VB2_BUF_STATE_ERROR, "ERROR" }),
+		  __entry->timestamp)
+);
+
+TRACE_EVENT(video_cap_error,
+	TP_PROTO(struct video_cap_dev *dev, int where, long err),
+	TP_ARGS(dev, where, err),
+
+	TP_STRUCT__entry(
+		__field(u32, ch)
+		__field(u32, seq)
+		__field(int, where)
+		__field(long, err)
+	),
+
+	TP_fast_assign(
+		__entry->ch = dev->c2h_channel;
+		__entry->seq = dev->sequence;
+		__entry->where = where;
+		__entry->err = err;
+	),
+
+	TP_printk("ch=%u seq=%u %s err=%ld", __entry->ch, __entry->seq,
+		  __print_symbolic(__entry->where,
+				   { VIDEO_CAP_TRACE_ERR_SUBMIT, "submit" },
+				   { VIDEO_CAP_TRACE_ERR_SCRATCH, "scratch_submit" },
+				   { VIDEO_CAP_TRACE_ERR_DMA, "dma" },
+				   { VIDEO_CAP_TRACE_ERR_DMA_TIMEOUT, "dma_timeout" },
+				   { VIDEO_CAP_TRACE_ERR_VSYNC_TIMEOUT, "vsync_timeout" },
+				   { VIDEO_CAP_TRACE_ERR_RECOVER, "recover" }),
+		  __entry->err)
+);
+
+#endif /* __VIDEO_CAP_PCIE_V4L2_TRACE_H__ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE video_cap_pcie_v4l2_trace
+#include <trace/define_trace.h>
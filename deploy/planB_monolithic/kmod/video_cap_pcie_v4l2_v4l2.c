@@ -5,17 +5,21 @@
  *
  * 这一文件只放 V4L2 侧的 glue：
  * - querycap / enum_fmt / g/s/try_fmt / g/s_parm
- * - 自定义 controls（test_pattern/skip/vsync_timeout 等）
+ * - 自定义 controls（test_pattern/skip/vsync_timeout/low_latency 等）
+ * - 低延时模式下 DQBUF/poll/read 的包装（先把信箱里最新的帧交给 vb2）
  * - 注册 video_device 与 vb2_queue
  *
- * 当前实现为了 bring-up 简化：TRY_FMT/S_FMT 会固定到默认分辨率（1080p），
- * 不支持任意分辨率切换；后续再按需要扩展。
+ * 分辨率不由用户选：TRY_FMT/S_FMT 取 FPGA 实测的输入分辨率（旧 bitstream 固定 1080p），
+ * 输入时序变化时发 V4L2_EVENT_SOURCE_CHANGE，由用户态 STREAMOFF + S_FMT 重新配置。
  */
 
+#include <linux/gcd.h>
 #include <linux/limits.h>
 #include <linux/module.h>
 
+#include <media/v4l2-event.h>
 #include <media/v4l2-ioctl.h>
+#include <media/videobuf2-dma-contig.h>
 #include <media/videobuf2-dma-sg.h>
 
 #include "video_cap_pcie_v4l2_priv.h"
@@ -51,6 +55,37 @@ void video_cap_fill_pix_format(struct v4l2_pix_format *pix, u32 width, u32 heigh
 	}
 }
 
+/*
+ * 输入时序变化（src_work 调用，进程上下文）：
+ * - 给订阅者发 V4L2_EVENT_SOURCE_CHANGE（无信号/信号恢复也算）
+ * - 正在采集且新分辨率和当前格式不一致：buffer 大小已经不对了，让 vb2 队列进入 error，
+ *   DQBUF/QBUF 立即返回 -EIO，而不是在 DMA 超时和 dma_short 里空转；
+ *   用户态 STREAMOFF 后按新格式 S_FMT/REQBUFS 即可，不用重载模块
+ */
+/* 函数：上报输入时序变化 */
+void video_cap_source_event(struct video_cap_dev *dev, const struct video_cap_timing *t)
+{
+	static const struct v4l2_event ev = {
+		.type = V4L2_EVENT_SOURCE_CHANGE,
+		.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION,
+	};
+
+	atomic64_inc(&dev->stats.source_change);
+	v4l2_event_queue(&dev->vdev, &ev);
+
+	/* 信号丢了先不动队列：看门狗照常处理，信号回来且分辨率不变时可以接着采 */
+	if (!t->width)
+		return;
+
+	mutex_lock(&dev->lock);
+	if (dev->streaming && (t->width != dev->width || t->height != dev->height)) {
+		dev_warn(&dev->pdev->dev, "source is %ux%u, streaming %ux%u: stop the queue\n",
+			 t->width, t->height, dev->width, dev->height);
+		vb2_queue_error(&dev->vb_queue);
+	}
+	mutex_unlock(&dev->lock);
+}
+
 /*
  * V4L2 ctrl 回调：设置自定义控件。
  * 说明：
@@ -61,6 +96,12 @@ static int video_cap_s_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct video_cap_dev *dev = container_of(ctrl->handler, struct video_cap_dev, ctrl_handler);
 
+	/* QoS 优先级只在下一次拥塞/恢复时读，采集中也可以改 */
+	if (ctrl->id == V4L2_CID_VIDEO_CAP_QOS_PRIORITY) {
+		WRITE_ONCE(dev->qos_prio, (u32)ctrl->val);
+		return 0;
+	}
+
 	/*
 	 * 为了简化状态机，streaming 期间禁止修改这些参数。
 	 * 如果后续确实需要“热切换测试图”，可以在这里加寄存器更新逻辑。
@@ -78,6 +119,15 @@ static int video_cap_s_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_VIDEO_CAP_VSYNC_TIMEOUT_MS:
 		dev->vsync_timeout_ms = (u32)ctrl->val;
 		return 0;
+	case V4L2_CID_VIDEO_CAP_POLL_US:
+		dev->poll_us = (unsigned int)ctrl->val;
+		return 0;
+	case V4L2_CID_VIDEO_CAP_LOW_LATENCY:
+		/* queue_setup 按它定 buffer 数，已经分配过 buffer（REQBUFS 之后）就不能再改 */
+		if (vb2_is_busy(&dev->vb_queue))
+			return -EBUSY;
+		dev->low_latency = !!ctrl->val;
+		return 0;
 	default:
 		return -EINVAL;
 	}
@@ -98,6 +148,14 @@ static int video_cap_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
 		value = atomic64_read(&dev->stats.dma_error);
 		ctrl->val = (value > INT_MAX) ? INT_MAX : (int)value;
 		return 0;
+	case V4L2_CID_VIDEO_CAP_DESC_PER_FRAME:
+		value = atomic64_read(&dev->stats.desc_per_frame);
+		ctrl->val = (value > INT_MAX) ? INT_MAX : (int)value;
+		return 0;
+	case V4L2_CID_VIDEO_CAP_SUPERSEDED:
+		value = atomic64_read(&dev->stats.superseded);
+		ctrl->val = (value > INT_MAX) ? INT_MAX : (int)value;
+		return 0;
 	default:
 		return -EINVAL;
 	}
@@ -122,15 +180,15 @@ static struct v4l2_ctrl *video_cap_new_ctrl(struct video_cap_dev *dev, const str
 
 /*
  * 初始化该 /dev/videoX 的 controls：
- * - test_pattern/skip/vsync_timeout_ms
- * - 只读统计：vsync_timeout/dma_error
+ * - test_pattern/skip/vsync_timeout_ms/poll_us/low_latency/qos_priority
+ * - 只读统计：vsync_timeout/dma_error/desc_per_frame/superseded
  */
 static int video_cap_init_controls(struct video_cap_dev *dev)
 {
 	struct v4l2_ctrl_config cfg;
 	int ret;
 
-	v4l2_ctrl_handler_init(&dev->ctrl_handler, 8);
+	v4l2_ctrl_handler_init(&dev->ctrl_handler, 11);
 
 	memset(&cfg, 0, sizeof(cfg));
 	cfg.ops = &video_cap_ctrl_ops;
@@ -166,6 +224,42 @@ static int video_cap_init_controls(struct video_cap_dev *dev)
 	cfg.def = dev->vsync_timeout_ms;
 	video_cap_new_ctrl(dev, &cfg);
 
+	/* hybrid 完成：预测帧尾前 poll_us 开始忙等 writeback（0=只用中断） */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ops = &video_cap_ctrl_ops;
+	cfg.id = V4L2_CID_VIDEO_CAP_POLL_US;
+	cfg.name = "video_cap_poll_us";
+	cfg.type = V4L2_CTRL_TYPE_INTEGER;
+	cfg.min = 0;
+	cfg.max = VIDEO_CAP_POLL_US_MAX;
+	cfg.step = 1;
+	cfg.def = dev->poll_us;
+	video_cap_new_ctrl(dev, &cfg);
+
+	/* 低延时模式：最少 2 个 buffer，DQBUF 拿最新完成的帧，没人取的旧帧回收重填（REQBUFS 之前设） */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ops = &video_cap_ctrl_ops;
+	cfg.id = V4L2_CID_VIDEO_CAP_LOW_LATENCY;
+	cfg.name = "video_cap_low_latency";
+	cfg.type = V4L2_CTRL_TYPE_BOOLEAN;
+	cfg.min = 0;
+	cfg.max = 1;
+	cfg.step = 1;
+	cfg.def = 0;
+	video_cap_new_ctrl(dev, &cfg);
+
+	/* 带宽 QoS 优先级：链路拥塞时数值小的先降帧（采集中可改） */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ops = &video_cap_ctrl_ops;
+	cfg.id = V4L2_CID_VIDEO_CAP_QOS_PRIORITY;
+	cfg.name = "video_cap_qos_priority";
+	cfg.type = V4L2_CTRL_TYPE_INTEGER;
+	cfg.min = 0;
+	cfg.max = VIDEO_CAP_QOS_PRIO_MAX;
+	cfg.step = 1;
+	cfg.def = 0;
+	video_cap_new_ctrl(dev, &cfg);
+
 	/*
 	 * 运行统计：只读 + volatile（每次 GET_CTRL 都会刷新）。
 	 * 内核 V4L2 ctrl 的赋值接口在不同版本上有差异；这里用 32-bit counter
@@ -201,6 +295,38 @@ static int video_cap_init_controls(struct video_cap_dev *dev)
 		dev->ctrl_stat_dma_error->flags |= V4L2_CTRL_FLAG_READ_ONLY |
 						   V4L2_CTRL_FLAG_VOLATILE;
 
+	/* 每帧描述符数（最近一次 buf_init 建链的结果）：dma-sg ~2k，dma_contig 降到个位数 */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ops = &video_cap_ctrl_ops;
+	cfg.id = V4L2_CID_VIDEO_CAP_DESC_PER_FRAME;
+	cfg.name = "video_cap_desc_per_frame";
+	cfg.type = V4L2_CTRL_TYPE_INTEGER;
+	cfg.min = 0;
+	cfg.max = INT_MAX;
+	cfg.step = 1;
+	cfg.def = 0;
+	cfg.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE;
+	dev->ctrl_stat_desc_per_frame = video_cap_new_ctrl(dev, &cfg);
+	if (dev->ctrl_stat_desc_per_frame)
+		dev->ctrl_stat_desc_per_frame->flags |= V4L2_CTRL_FLAG_READ_ONLY |
+							V4L2_CTRL_FLAG_VOLATILE;
+
+	/* 低延时模式下被更新的帧顶掉的帧数（sequence 同样会跳） */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.ops = &video_cap_ctrl_ops;
+	cfg.id = V4L2_CID_VIDEO_CAP_SUPERSEDED;
+	cfg.name = "video_cap_superseded";
+	cfg.type = V4L2_CTRL_TYPE_INTEGER;
+	cfg.min = 0;
+	cfg.max = INT_MAX;
+	cfg.step = 1;
+	cfg.def = 0;
+	cfg.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE;
+	dev->ctrl_stat_superseded = video_cap_new_ctrl(dev, &cfg);
+	if (dev->ctrl_stat_superseded)
+		dev->ctrl_stat_superseded->flags |= V4L2_CTRL_FLAG_READ_ONLY |
+						    V4L2_CTRL_FLAG_VOLATILE;
+
 	ret = dev->ctrl_handler.error;
 	if (ret) {
 		v4l2_ctrl_handler_free(&dev->ctrl_handler);
@@ -234,10 +360,12 @@ static int video_cap_querycap(struct file *file, void *priv, struct v4l2_capabil
 	return 0;
 }
 
-/* V4L2：枚举 input（这里固定只有 index=0，一个虚拟输入） */
+/* V4L2：枚举 input（这里固定只有 index=0，一个虚拟输入；有时序检测时上报无信号） */
 static int video_cap_enum_input(struct file *file, void *priv, struct v4l2_input *inp)
 {
-	(void)file;
+	struct video_cap_dev *dev = video_drvdata(file);
+	struct video_cap_timing t;
+
 	(void)priv;
 
 	if (inp->index != 0)
@@ -249,6 +377,8 @@ static int video_cap_enum_input(struct file *file, void *priv, struct v4l2_input
 	inp->tuner = 0;
 	inp->std = 0;
 	inp->status = 0;
+	if (video_cap_src_timing(dev->multi, &t) && !t.width)
+		inp->status = V4L2_IN_ST_NO_SIGNAL;
 	return 0;
 }
 
@@ -302,27 +432,38 @@ static int video_cap_g_fmt_vid_cap(struct file *file, void *priv, struct v4l2_fo
 
 /*
  * V4L2：校验/修正用户请求格式。
- * 当前策略：只允许切换像素格式，分辨率固定为默认值（1080p）。
+ * 只允许切换像素格式，分辨率收敛到输入源的分辨率：
+ * - 有时序检测：FPGA 实测值；无信号时保持当前格式（等 SOURCE_CHANGE 再来配置）
+ * - 旧 bitstream / src_poll_ms=0：默认值（1080p）
  */
 /* 函数：V4L2 try_fmt 回调（校验/修正用户请求格式） */
 static int video_cap_try_fmt_vid_cap(struct file *file, void *priv, struct v4l2_format *f)
 {
+	struct video_cap_dev *dev = video_drvdata(file);
+	struct video_cap_timing t;
+	u32 width = VIDEO_WIDTH_DEFAULT;
+	u32 height = VIDEO_HEIGHT_DEFAULT;
 	u32 pixfmt;
 
-	(void)file;
 	(void)priv;
 
 	pixfmt = f->fmt.pix.pixelformat;
 	if (!video_cap_pixfmt_supported(pixfmt))
 		pixfmt = V4L2_PIX_FMT_XBGR32;
 
-	/* 当前驱动直接把请求格式收敛到默认分辨率，避免与 FPGA 侧能力不匹配 */
-	video_cap_fill_pix_format(&f->fmt.pix, VIDEO_WIDTH_DEFAULT, VIDEO_HEIGHT_DEFAULT, pixfmt);
+	if (video_cap_src_timing(dev->multi, &t)) {
+		width = t.width ? t.width : dev->width;
+		height = t.height ? t.height : dev->height;
+	}
+
+	/* sizeimage 跟着源分辨率走，buf_init 按它建描述符链，FPGA bridge 按实测高度打 TLAST */
+	video_cap_fill_pix_format(&f->fmt.pix, width, height, pixfmt);
 	return 0;
 }
 
 /*
- * V4L2：设置格式（streaming 期间禁止）。
+ * V4L2：设置格式（streaming 或已分配 buffers 期间禁止）。
+ * buffers 的描述符链在 buf_init 时按 sizeimage 预建，所以 REQBUFS 之后不能再改格式。
  * 这里会把选择的像素格式同步到 FPGA（VID_FORMAT）。
  */
 /* 函数：V4L2 s_fmt 回调（设置当前格式，并同步到 FPGA） */
@@ -331,7 +472,7 @@ static int video_cap_s_fmt_vid_cap(struct file *file, void *priv, struct v4l2_fo
 	struct video_cap_dev *dev = video_drvdata(file);
 	int ret;
 
-	if (dev->streaming)
+	if (dev->streaming || vb2_is_busy(&dev->vb_queue))
 		return -EBUSY;
 
 	ret = video_cap_try_fmt_vid_cap(file, priv, f);
@@ -349,27 +490,134 @@ static int video_cap_s_fmt_vid_cap(struct file *file, void *priv, struct v4l2_fo
 	return 0;
 }
 
-/* V4L2：上报帧率信息（固定 60fps，仅用于查询 timeperframe 的应用） */
+/* V4L2：上报帧率信息（实测帧周期；没有时序检测或无信号时为 60fps） */
 static int video_cap_g_parm(struct file *file, void *priv, struct v4l2_streamparm *sp)
 {
-	(void)file;
+	struct video_cap_dev *dev = video_drvdata(file);
+	struct video_cap_timing t;
+	u32 num = 1;
+	u32 den = VIDEO_FRAME_RATE_60;
+
 	(void)priv;
 
 	if (sp->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
 		return -EINVAL;
 
+	if (video_cap_src_timing(dev->multi, &t) && t.period_us) {
+		unsigned long g = gcd(t.period_us, USEC_PER_SEC);
+
+		num = t.period_us / g;
+		den = USEC_PER_SEC / g;
+	}
+
 	sp->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
-	sp->parm.capture.timeperframe.numerator = 1;
-	sp->parm.capture.timeperframe.denominator = VIDEO_FRAME_RATE_60;
+	sp->parm.capture.timeperframe.numerator = num;
+	sp->parm.capture.timeperframe.denominator = den;
 	return 0;
 }
 
-/* V4L2：设置帧率（当前实现固定，直接回到 g_parm） */
+/* V4L2：设置帧率（由输入源决定，直接回到 g_parm） */
 static int video_cap_s_parm(struct file *file, void *priv, struct v4l2_streamparm *sp)
 {
 	return video_cap_g_parm(file, priv, sp);
 }
 
+/* 函数：FRAME_SYNC/DMA_START 的订阅计数（ISR 和提交路径据此跳过没人要的事件） */
+static atomic_t *video_cap_sync_subs(struct v4l2_subscribed_event *sev)
+{
+	struct video_cap_dev *dev = video_get_drvdata(sev->fh->vdev);
+
+	return sev->type == V4L2_EVENT_FRAME_SYNC ? &dev->ev_frame_sync : &dev->ev_dma_start;
+}
+
+/* 函数：订阅生效 */
+static int video_cap_sync_add(struct v4l2_subscribed_event *sev, unsigned int elems)
+{
+	atomic_inc(video_cap_sync_subs(sev));
+	return 0;
+}
+
+/* 函数：退订/关闭 fh */
+static void video_cap_sync_del(struct v4l2_subscribed_event *sev)
+{
+	atomic_dec(video_cap_sync_subs(sev));
+}
+
+static const struct v4l2_subscribed_event_ops video_cap_sync_ops = {
+	.add = video_cap_sync_add,
+	.del = video_cap_sync_del,
+};
+
+/* V4L2：事件订阅（分片 lines-ready + 帧边界 + 输入时序变化 + 控件事件） */
+static int video_cap_subscribe_event(struct v4l2_fh *fh,
+				     const struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case VIDEO_CAP_EVENT_LINES_READY:
+		/* 每帧最多 slices-1 个事件，留两帧的余量，溢出时丢最老的 */
+		return v4l2_event_subscribe(fh, sub, 2 * VIDEO_CAP_SLICES_MAX, NULL);
+	case V4L2_EVENT_FRAME_SYNC:
+	case VIDEO_CAP_EVENT_DMA_START:
+		/* 每帧一个，留 4 帧给来不及 DQEVENT 的订阅者 */
+		return v4l2_event_subscribe(fh, sub, 4, &video_cap_sync_ops);
+	case V4L2_EVENT_SOURCE_CHANGE:
+		return v4l2_src_change_event_subscribe(fh, sub);
+	default:
+		return v4l2_ctrl_subscribe_event(fh, sub);
+	}
+}
+
+/*
+ * 低延时模式的读者入口（见 video_cap_pcie_v4l2_vb2.c 的信箱说明）：
+ * 先登记“在等”并把信箱里最新的帧交给 vb2，取完（或发现已经可读）后撤销登记，
+ * 消费者处理期间完成的帧留在信箱里，不会在 done_list 里变旧。
+ */
+/* 函数：VIDIOC_DQBUF */
+static int video_cap_dqbuf(struct file *file, void *priv, struct v4l2_buffer *b)
+{
+	struct video_cap_dev *dev = video_drvdata(file);
+	int ret;
+
+	if (!dev->low_latency)
+		return vb2_ioctl_dqbuf(file, priv, b);
+
+	video_cap_mailbox_flush(dev, !(file->f_flags & O_NONBLOCK));
+	ret = vb2_ioctl_dqbuf(file, priv, b);
+	video_cap_mailbox_idle(dev);
+	return ret;
+}
+
+/* 函数：poll（没有可读帧时登记在等，下一帧完成即交付并唤醒） */
+static __poll_t video_cap_poll(struct file *file, poll_table *wait)
+{
+	struct video_cap_dev *dev = video_drvdata(file);
+	__poll_t res;
+
+	if (!dev->low_latency)
+		return vb2_fop_poll(file, wait);
+
+	video_cap_mailbox_flush(dev, true);
+	res = vb2_fop_poll(file, wait);
+	if (res & (EPOLLIN | EPOLLRDNORM))
+		video_cap_mailbox_idle(dev);
+	return res;
+}
+
+/* 函数：read() I/O（vb2 内部 DQBUF，同样要先交付信箱） */
+static ssize_t video_cap_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct video_cap_dev *dev = video_drvdata(file);
+	ssize_t ret;
+
+	if (!dev->low_latency)
+		return vb2_fop_read(file, buf, count, ppos);
+
+	video_cap_mailbox_flush(dev, !(file->f_flags & O_NONBLOCK));
+	ret = vb2_fop_read(file, buf, count, ppos);
+	video_cap_mailbox_idle(dev);
+	return ret;
+}
+
 static const struct v4l2_ioctl_ops video_cap_ioctl_ops = {
 	.vidioc_querycap = video_cap_querycap,
 
@@ -390,18 +638,21 @@ static const struct v4l2_ioctl_ops video_cap_ioctl_ops = {
 	.vidioc_prepare_buf = vb2_ioctl_prepare_buf,
 	.vidioc_querybuf = vb2_ioctl_querybuf,
 	.vidioc_qbuf = vb2_ioctl_qbuf,
-	.vidioc_dqbuf = vb2_ioctl_dqbuf,
+	.vidioc_dqbuf = video_cap_dqbuf,
 	.vidioc_expbuf = vb2_ioctl_expbuf,
 	.vidioc_streamon = vb2_ioctl_streamon,
 	.vidioc_streamoff = vb2_ioctl_streamoff,
+
+	.vidioc_subscribe_event = video_cap_subscribe_event,
+	.vidioc_unsubscribe_event = v4l2_event_unsubscribe,
 };
 
 static const struct v4l2_file_operations video_cap_fops = {
 	.owner = THIS_MODULE,
 	.open = v4l2_fh_open,
 	.release = vb2_fop_release,
-	.read = vb2_fop_read,
-	.poll = vb2_fop_poll,
+	.read = video_cap_read,
+	.poll = video_cap_poll,
 	.mmap = vb2_fop_mmap,
 	.unlocked_ioctl = video_ioctl2,
 };
@@ -409,8 +660,9 @@ static const struct v4l2_file_operations video_cap_fops = {
 /*
  * 注册一个 /dev/videoX：
  * - 初始化 controls
- * - 初始化 vb2_queue（mem_ops=vb2_dma_sg_memops）
+ * - 初始化 vb2_queue（mem_ops=vb2_dma_sg_memops，dma_contig=1 时 vb2_dma_contig_memops）
  * - 注册 video_device
+ * - meta_node=1 时再注册一个元数据节点（video_cap_pcie_v4l2_meta.c）
  */
 int video_cap_register_v4l2(struct video_cap_dev *dev)
 {
@@ -425,6 +677,7 @@ int video_cap_register_v4l2(struct video_cap_dev *dev)
 	/*
 	 * vb2_queue 初始化要点：
 	 * - mem_ops=vb2_dma_sg_memops：分配 sg buffer，方便直接交给 XDMA
+	 * - dma_contig=1：整帧一段连续 DMA 地址（CMA 或 IOMMU 映射），一帧只需几个描述符
 	 * - vb_queue.dev=&pdev->dev：确保 vb2 以 PCIe 设备为 DMA 设备做映射
 	 */
 	dev->vb_queue.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -432,8 +685,10 @@ int video_cap_register_v4l2(struct video_cap_dev *dev)
 	dev->vb_queue.drv_priv = dev;
 	dev->vb_queue.buf_struct_size = sizeof(struct video_cap_buffer);
 	dev->vb_queue.ops = &video_cap_vb2_ops;
-	dev->vb_queue.mem_ops = &vb2_dma_sg_memops;
-	dev->vb_queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	dev->vb_queue.mem_ops = dev->dma_contig ? &vb2_dma_contig_memops : &vb2_dma_sg_memops;
+	/* 时间戳取开始这一帧的 VSYNC（ISR 里记录），见 video_cap_frame_timestamp() */
+	dev->vb_queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC |
+					V4L2_BUF_FLAG_TSTAMP_SRC_SOE;
 	dev->vb_queue.lock = &dev->lock;
 	dev->vb_queue.dev = &dev->pdev->dev;
 
@@ -461,8 +716,17 @@ int video_cap_register_v4l2(struct video_cap_dev *dev)
 		goto err_ctrls;
 	}
 
+	if (dev->meta_node) {
+		ret = video_cap_register_meta(dev);
+		if (ret)
+			goto err_vdev;
+	}
+
+	video_cap_debugfs_register(dev);
 	return 0;
 
+err_vdev:
+	video_unregister_device(&dev->vdev);
 err_ctrls:
 	video_cap_free_controls(dev);
 	return ret;
@@ -471,6 +735,8 @@ err_ctrls:
 /* 注销 /dev/videoX 并释放 controls */
 void video_cap_unregister_v4l2(struct video_cap_dev *dev)
 {
+	video_cap_debugfs_unregister(dev);
+	video_cap_unregister_meta(dev);
 	video_unregister_device(&dev->vdev);
 	video_cap_free_controls(dev);
 }
@@ -3,9 +3,17 @@
 /*
  * video_cap_pcie_v4l2_vb2.c
  *
- * 这一文件承载“采集线程 + vb2 队列”的主体逻辑：
- * - VSYNC IRQ：只做计数 + 唤醒，尽量短
- * - 采集线程：等 QBUF -> 等 VSYNC -> 发起一次整帧 DMA -> DONE/ERROR
+ * 这一文件承载“采集状态机 + vb2 队列”的主体逻辑（没有每路一个的采集线程）：
+ * - VSYNC IRQ：只做计数 + 调度采集 work，尽量短
+ * - 采集 work（每路一个 delayed_work，所有通道共用 multi->cap_wq；rt_prio>0 的通道换成
+ *   自己的 SCHED_FIFO/RR kthread_worker）：
+ *   VSYNC 门控模式（pipeline_depth=0）下每个新 VSYNC nowait 挂一帧；
+ *   pipeline 模式（pipeline_depth>0）下把 engine 补满到 depth；兼做看门狗
+ * - DMA 完成回调里 DONE/ERROR，再调度采集 work 补位
+ * - ring 模式（ring_mode=1）：连 work 都不用，engine 在描述符环上连续运行，
+ *   帧完成中断里 DONE/ERROR 并换入下一个 buffer，QBUF 时 kick 补槽
+ * - DMA 出错恢复（dma_recover=1）：复位 engine 和 bridge 后在下一个 SOF 接着采，不重启流
+ * - 带宽 QoS：STREAMON 准入，丢帧时按优先级降帧（video_cap_pcie_v4l2_qos.c），降帧闸门在挂帧路径上
  * - vb2 ops：queue_setup/buf_queue/STREAMON/STREAMOFF
  *
  * 注意：当前是“按帧 DMA”模型（每次 DMA dev->sizeimage 字节）。
@@ -13,42 +21,169 @@
 
 #include <linux/dma-mapping.h>
 #include <linux/jiffies.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/sched/types.h>
+#include <linux/version.h>
 
+#include <media/v4l2-event.h>
+#include <media/videobuf2-dma-contig.h>
 #include <media/videobuf2-dma-sg.h>
 
 #include "libxdma_api.h"
 
 #include "video_cap_pcie_v4l2_priv.h"
 
+#define CREATE_TRACE_POINTS
+#include "video_cap_pcie_v4l2_trace.h"
+
 /*
- * VSYNC 中断处理函数（XDMA 的 user IRQ）。
- * 尽量保持 ISR 最小化：只记录“来了一个 VSYNC”，并唤醒采集线程。
+ * 记录一次 VSYNC 的时间戳。ISR 是唯一写者：先把槽的 seq 清 0，再写 ts，最后写 seq，
+ * 读者前后两次读到相同且非 0 的 seq 才认为 ts 有效（seqcount 的简化版）。
  */
+static void video_cap_vsync_record(struct video_cap_dev *dev, u64 seq, u64 ts_ns)
+{
+	struct video_cap_vsync_stamp *s = &dev->vsync_ring[seq & (VIDEO_CAP_VSYNC_RING - 1)];
+
+	WRITE_ONCE(s->seq, 0);
+	smp_wmb();
+	WRITE_ONCE(s->ts_ns, ts_ns);
+	smp_wmb();
+	WRITE_ONCE(s->seq, seq);
+}
+
+/* 函数：本路采集 work 排到哪个 CPU（固定的 CPU 被下线时退回不固定） */
+static int video_cap_work_cpu(struct video_cap_dev *dev)
+{
+	int cpu = dev->work_cpu;
+
+	return (cpu != WORK_CPU_UNBOUND && cpu_online(cpu)) ? cpu : WORK_CPU_UNBOUND;
+}
+
+/* 函数：立即调度本路的采集 work（任意上下文可调；已在定时等待时提前到现在） */
+static void video_cap_kick(struct video_cap_dev *dev)
+{
+	if (dev->cap_worker)
+		kthread_mod_delayed_work(dev->cap_worker, &dev->cap_kwork, 0);
+	else
+		mod_delayed_work_on(video_cap_work_cpu(dev), dev->multi->cap_wq, &dev->cap_work, 0);
+}
+
+/* 函数：delay 后再跑一次采集 work（已经排上时不推迟它） */
+static void video_cap_work_defer(struct video_cap_dev *dev, unsigned long delay)
+{
+	if (dev->cap_worker)
+		kthread_queue_delayed_work(dev->cap_worker, &dev->cap_kwork, delay);
+	else
+		queue_delayed_work_on(video_cap_work_cpu(dev), dev->multi->cap_wq, &dev->cap_work,
+				      delay);
+}
+
+/* 函数：取消并等待本路采集 work 结束 */
+static void video_cap_work_cancel(struct video_cap_dev *dev)
+{
+	if (dev->cap_worker)
+		kthread_cancel_delayed_work_sync(&dev->cap_kwork);
+	else
+		cancel_delayed_work_sync(&dev->cap_work);
+}
+
+/*
+ * 发 FRAME_SYNC 事件。在硬中断里发：v4l2_event_queue 只取 fh_lock（irqsave 自旋锁）并写各 fh
+ * 预分配的事件槽，不分配、不睡眠；没人订阅时只有一次 atomic_read。
+ */
+static void video_cap_event_frame_sync(struct video_cap_dev *dev, u64 seq)
+{
+	struct v4l2_event ev = {};
+
+	ev.type = V4L2_EVENT_FRAME_SYNC;
+	ev.u.frame_sync.frame_sequence = (u32)seq;
+	v4l2_event_queue(&dev->vdev, &ev);
+	atomic64_inc(&dev->stats.sync_event);
+}
+
 /*
- * VSYNC 的 user IRQ ISR。
+ * VSYNC 中断处理函数（XDMA 的 user IRQ）。
  * 设计要点：
- * - ISR 尽量短：只做计数 + 唤醒 waitqueue
+ * - ISR 尽量短：只做时间戳入环 + 计数 + 唤醒 waitqueue（warm-up）+ 调度 work
  * - 不在 ISR 里做寄存器读写/提交 DMA，避免增加中断抖动
  */
-/* 函数：VSYNC user IRQ 中断处理（只做计数+唤醒） */
 irqreturn_t video_cap_user_irq_handler(int user, void *data)
 {
 	struct video_cap_dev *dev = data;
+	u64 now = ktime_get_ns();
 
 	(void)user;
 
 	atomic64_inc(&dev->stats.vsync_isr);
+	/* 先入环再发布序号：看到新序号的一方一定能查到它的时间戳 */
+	video_cap_vsync_record(dev, (u64)atomic64_read(&dev->vsync_seq) + 1, now);
 	atomic64_inc(&dev->vsync_seq);
+	trace_video_cap_vsync_irq(dev, (u64)atomic64_read(&dev->vsync_seq));
+	if (atomic_read(&dev->ev_frame_sync))
+		video_cap_event_frame_sync(dev, (u64)atomic64_read(&dev->vsync_seq));
 	wake_up_interruptible(&dev->vsync_wq);
+	/* VSYNC 门控模式：由这次 VSYNC 触发下一帧的提交 */
+	if (!dev->pipeline_depth && !dev->ring_mode && READ_ONCE(dev->streaming) &&
+	    !dev->stopping)
+		video_cap_kick(dev);
 	return IRQ_HANDLED;
 }
 
+/* 按序号读取 VSYNC 时间戳；槽已被覆盖或正在改写时返回 false */
+static bool video_cap_vsync_ts(struct video_cap_dev *dev, u64 seq, u64 *ts_ns)
+{
+	struct video_cap_vsync_stamp *s = &dev->vsync_ring[seq & (VIDEO_CAP_VSYNC_RING - 1)];
+	u64 s1, s2, ts;
+
+	s1 = READ_ONCE(s->seq);
+	smp_rmb();
+	ts = READ_ONCE(s->ts_ns);
+	smp_rmb();
+	s2 = READ_ONCE(s->seq);
+	if (s1 != seq || s2 != seq)
+		return false;
+
+	*ts_ns = ts;
+	return true;
+}
+
+/*
+ * 给完成的帧找“开始它的那次 VSYNC”：done_ns - period/2 之前最近的一次。
+ * VSYNC 在帧头（消隐区），DMA 在帧尾完成，二者相隔约一个有效期（远大于半个周期）；
+ * 帧尾到下一次 VSYNC 只隔前沿消隐，所以完成处理即使被推迟小半个周期也不会配到下一帧。
+ * period 取最近两次 VSYNC 的间隔；找不到（无 VSYNC/环被覆盖）时退回 done_ns 并计数。
+ */
+/* 函数：计算 vb2 buffer 的 start-of-exposure 时间戳 */
+static u64 video_cap_frame_timestamp(struct video_cap_dev *dev, u64 done_ns)
+{
+	u64 head = (u64)atomic64_read(&dev->vsync_seq);
+	u64 limit = done_ns;
+	u64 ts, prev;
+	unsigned int n;
+
+	if (head && video_cap_vsync_ts(dev, head, &ts) && head > 1 &&
+	    video_cap_vsync_ts(dev, head - 1, &prev) && ts > prev)
+		limit -= min(done_ns, (ts - prev) / 2);
+
+	for (n = 0; n < VIDEO_CAP_VSYNC_RING - 1 && n < head; n++) {
+		if (!video_cap_vsync_ts(dev, head - n, &ts))
+			break;
+		if (ts <= limit)
+			return ts;
+	}
+
+	atomic64_inc(&dev->stats.vsync_ts_miss);
+	return done_ns;
+}
+
 /*
  * 等待 VSYNC 到来（或 stop/timeout）。
  * 使用“递增序号”而不是“pending 计数”：
  * - 不会因为 ISR/线程调度造成 pending 计数积压或丢失
  * - 每次只需关心“是否出现了新的 VSYNC”
+ * 现在只有 warm-up 还在 STREAMON 里同步等 VSYNC，正常采集由 ISR 直接调度 work。
  */
 /*
  * 等待“下一次 VSYNC”到来。
@@ -82,55 +217,44 @@ static int video_cap_wait_vsync(struct video_cap_dev *dev, u64 *last_seq)
 }
 
 /*
- * 把“一帧数据”通过 XDMA C2H DMA 写入 vb2 buffer。
- * vb2-dma-sg 返回的 sg_table 已经针对 &pdev->dev 做过 DMA map。
+ * sg_table 裁剪状态：提交 DMA 前把最后一个 sg 段裁剪到 sizeimage，提交后恢复。
+ * libxdma 在 submit 时就把 sg 拷贝成描述符，所以 nowait 提交返回后即可恢复。
  */
+struct video_cap_sg_trim {
+	struct scatterlist *last_sg;
+	u32 orig_nents;
+	u32 last_orig_len;
+	u32 last_orig_dma_len;
+	bool applied;
+};
+
 /*
- * 提交一次整帧 DMA（C2H）把数据写入 vb2 buffer。
- * 关键点：
- * - vb2-dma-sg 的 sg_table 通常页对齐，总长度可能 > sizeimage
- * - FPGA 实际每帧只输出 sizeimage 字节，因此这里裁剪最后一个 sg 段
+ * 把 sg_table 裁剪到精确的 dev->sizeimage（需配合 video_cap_sg_restore）。
+ * vb2 分配的 buffer 往往页对齐，sg_table 总长度可能大于 sizeimage；FPGA 实际每帧只输出
+ * sizeimage 字节，所以把最后一个 sg 段裁剪到精确长度，避免 XDMA 继续等待“多出来的页尾”
+ * 导致 DMA timeout/短帧。
  */
-/* 函数：提交一次整帧 DMA，把数据写入 vb2 buffer */
-static int video_cap_dma_read_frame(struct video_cap_dev *dev, struct vb2_buffer *vb)
+static int video_cap_sg_trim(struct video_cap_dev *dev, struct sg_table *sgt,
+			     struct video_cap_sg_trim *t)
 {
-	struct sg_table *sgt;
-	struct scatterlist *sg, *last_sg = NULL;
-	ssize_t n;
-	u32 orig_nents;
+	struct scatterlist *sg;
 	u32 used_nents;
-	u32 last_orig_len = 0;
-	u32 last_orig_dma_len = 0;
 	size_t remaining;
 	bool trim_applied = false;
 
-	sgt = vb2_dma_sg_plane_desc(vb, 0);
-	if (!sgt)
-		return -EFAULT;
-
-	/*
-	 * vb2-dma-sg buffers are often page-aligned, so the sg_table total DMA
-	 * length can be larger than dev->sizeimage. The FPGA only produces
-	 * sizeimage bytes per frame, so cap the DMA transfer length to exactly
-	 * dev->sizeimage to avoid timeouts/short frames.
-	 */
-	/* 中文说明：vb2 分配的 buffer 往往页对齐，sg_table 总长度可能大于 sizeimage。
-	 * FPGA 实际每帧只输出 sizeimage 字节，所以这里把最后一个 sg 段裁剪到精确长度，
-	 * 避免 XDMA 继续等待“多出来的页尾”导致 DMA timeout/短帧。
-	 */
-	atomic64_inc(&dev->stats.dma_submit);
-	orig_nents = sgt->nents;
+	t->last_sg = NULL;
+	t->orig_nents = sgt->nents;
 	remaining = dev->sizeimage;
 	sg = sgt->sgl;
-	for (used_nents = 0; used_nents < orig_nents && sg; used_nents++, sg = sg_next(sg)) {
+	for (used_nents = 0; used_nents < t->orig_nents && sg; used_nents++, sg = sg_next(sg)) {
 		u32 seg_len = sg_dma_len(sg);
 
 		if (seg_len >= remaining) {
-			if (seg_len != remaining || (used_nents + 1) < orig_nents)
+			if (seg_len != remaining || (used_nents + 1) < t->orig_nents)
 				trim_applied = true;
-			last_sg = sg;
-			last_orig_len = sg->length;
-			last_orig_dma_len = sg_dma_len(sg);
+			t->last_sg = sg;
+			t->last_orig_len = sg->length;
+			t->last_orig_dma_len = sg_dma_len(sg);
 			sg->length = (u32)remaining;
 			sg_dma_len(sg) = (u32)remaining;
 			remaining = 0;
@@ -142,29 +266,637 @@ static int video_cap_dma_read_frame(struct video_cap_dev *dev, struct vb2_buffer
 	if (remaining != 0)
 		return -EFAULT;
 	sgt->nents = used_nents;
+	t->applied = trim_applied;
 	if (trim_applied)
 		atomic64_inc(&dev->stats.dma_trim);
+	return 0;
+}
 
-	n = xdma_xfer_submit(dev->xdev, dev->c2h_channel, false, 0, sgt, true, 1000);
+/* Restore sg_table for vb2 reuse */
+static void video_cap_sg_restore(struct sg_table *sgt, const struct video_cap_sg_trim *t)
+{
+	sgt->nents = t->orig_nents;
+	if (t->last_sg) {
+		t->last_sg->length = t->last_orig_len;
+		sg_dma_len(t->last_sg) = t->last_orig_dma_len;
+	}
+}
 
-	/* Restore sg_table for vb2 reuse */
-	sgt->nents = orig_nents;
-	if (last_sg) {
-		last_sg->length = last_orig_len;
-		sg_dma_len(last_sg) = last_orig_dma_len;
+/*
+ * 取 buffer 的 DMA sg_table：
+ * - dma-sg：vb2 已经针对 &pdev->dev map 好的 sg_table
+ * - dma_contig：整块连续的 DMA 地址，按分片行边界切成 slices 段封装进 buf->contig_sgt
+ *   （分片点必须落在描述符边界上，否则一个整帧描述符没有中间完成中断）
+ * 封装时只覆盖 sizeimage 字节，不需要再裁剪。
+ */
+/* 函数：取 vb2 buffer 对应的 DMA sg_table */
+static struct sg_table *video_cap_buf_sgt(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	struct vb2_buffer *vb = &buf->vb.vb2_buf;
+	unsigned int i, n, start = 0;
+	dma_addr_t addr;
+
+	if (!dev->dma_contig)
+		return vb2_dma_sg_plane_desc(vb, 0);
+
+	addr = vb2_dma_contig_plane_dma_addr(vb, 0);
+	if (!addr)
+		return NULL;
+
+	n = dev->slices > 1 ? dev->slices : 1;
+	sg_init_table(buf->contig_sg, n);
+	for (i = 0; i < n; i++) {
+		unsigned int end = (i + 1 == n) ? dev->sizeimage :
+				   dev->height * (i + 1) / n * dev->bytesperline;
+
+		buf->contig_sg[i].length = end - start;
+		sg_dma_address(&buf->contig_sg[i]) = addr + start;
+		sg_dma_len(&buf->contig_sg[i]) = end - start;
+		start = end;
 	}
+	buf->contig_sgt.sgl = buf->contig_sg;
+	buf->contig_sgt.orig_nents = n;
+	buf->contig_sgt.nents = n;
+	return &buf->contig_sgt;
+}
 
-	if (n < 0) {
-		atomic64_inc(&dev->stats.dma_error);
-		return (int)n;
+/* 从 armed_list 摘下 buffer；返回 false 表示已被另一条路径（完成回调/提交失败）处理 */
+static bool video_cap_armed_take(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	unsigned long flags;
+	bool armed = false;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	if (!list_empty(&buf->list)) {
+		list_del_init(&buf->list);
+		dev->armed--;
+		dev->armed_jiffies = jiffies;
+		armed = true;
+	}
+	spin_unlock_irqrestore(&dev->qlock, flags);
+
+	return armed;
+}
+
+/* 更新帧周期估计：完成间隔的 1/8 EWMA，超过 4 个周期的间隔（断流）不计入 */
+static void video_cap_period_update(struct video_cap_dev *dev, u64 now)
+{
+	u64 last = dev->last_done_ns;
+	u64 period = dev->frame_period_ns;
+	u64 delta = now - last;
+
+	if (last && (!period || delta < 4 * period))
+		WRITE_ONCE(dev->frame_period_ns,
+			   period ? period - (period >> 3) + (delta >> 3) : delta);
+	WRITE_ONCE(dev->last_done_ns, now);
+}
+
+/*
+ * DMA 出错快速恢复（dma_recover=1），不经过 STREAMOFF/STREAMON，vb2 队列原样保留：
+ * - 完成回调 / 看门狗发现真正的 DMA 错误（-ECANCELED 和短帧不算：短帧时 bridge 已在 TLAST 处
+ *   自行对齐）：IDLE -> PENDING，记下出错时刻，kick 采集 work
+ * - 采集 work 里 video_cap_recover()：abort 本路所有 engine（停 engine、清状态寄存器，
+ *   在飞 buffers 以 ERROR 归还）-> 脉冲 bridge 软复位 -> RESYNC，然后照常补位，
+ *   bridge 从下一个 SOF 开始送帧
+ * - 之后第一帧完整 DONE：RESYNC -> IDLE，出错到这一帧的时间计入 recover 直方图和 recover_us
+ * - RESYNC 期间再出错：回到 PENDING 再复位一次，计时仍从第一次出错算起
+ * ring 模式下 libxdma 的 ring service 出错时已经自己停/清/重启了 engine，只补 bridge 软复位。
+ */
+/* 函数：请求一次恢复（任意上下文，since_ns 为视频开始丢失的时刻） */
+static void video_cap_recover_request(struct video_cap_dev *dev, u64 since_ns)
+{
+	int old;
+
+	if (!dev->dma_recover || dev->stopping)
+		return;
+
+	old = atomic_xchg(&dev->recover_state, VIDEO_CAP_RECOVER_PENDING);
+	if (old == VIDEO_CAP_RECOVER_PENDING)
+		return;
+	if (old == VIDEO_CAP_RECOVER_IDLE)
+		WRITE_ONCE(dev->recover_start_ns, since_ns);
+	video_cap_kick(dev);
+}
+
+/* 函数：恢复后第一帧完整 DONE，结束这次恢复并记录耗时 */
+static void video_cap_recover_done(struct video_cap_dev *dev, u64 now)
+{
+	u64 ns;
+
+	if (atomic_read(&dev->recover_state) != VIDEO_CAP_RECOVER_RESYNC ||
+	    atomic_cmpxchg(&dev->recover_state, VIDEO_CAP_RECOVER_RESYNC,
+			   VIDEO_CAP_RECOVER_IDLE) != VIDEO_CAP_RECOVER_RESYNC)
+		return;
+
+	ns = now - READ_ONCE(dev->recover_start_ns);
+	video_cap_lat_record(dev, VIDEO_CAP_LAT_RECOVER, ns);
+	atomic64_add(div_u64(ns, NSEC_PER_USEC), &dev->stats.recover_us);
+	dev_info_ratelimited(&dev->pdev->dev, "dma recovered in %llu us (seq %u)\n",
+			     div_u64(ns, NSEC_PER_USEC), dev->sequence);
+}
+
+/*
+ * 低延时模式（V4L2_CID_VIDEO_CAP_LOW_LATENCY）：latest-frame / mailbox 语义。
+ * vb2 的 done_list 是 FIFO，交出去的帧收不回来；慢了一拍的消费者 DQBUF 拿到的是几个周期前的帧。
+ * 所以完成的帧先不交给 vb2，而是放进驱动里的一格信箱（dev->mailbox，受 qlock 保护）：
+ * - 有读者正在等（阻塞 DQBUF / read，poll 没有可读）：mailbox_wait=true，完成时直接交付
+ * - 否则进信箱；信箱里原来那帧没人要了，放回 buf_list 重新填，计为 superseded
+ * - 读者来取（DQBUF / read / poll）时先把信箱里的帧交给 vb2，拿到的总是最新完成的一帧
+ * - 补位时 buf_list 空了也拿信箱里的 buffer 去填（同样计 superseded）：新鲜度优先于完整性，
+ *   2 个 buffer 也能一直转
+ */
+/* 函数：完成的一帧进信箱；返回 false 表示有读者在等，应立即交付 */
+static bool video_cap_mailbox_post(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	struct video_cap_buffer *old;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	if (dev->mailbox_wait || dev->stopping) {
+		dev->mailbox_wait = false;
+		spin_unlock_irqrestore(&dev->qlock, flags);
+		return false;
+	}
+	old = dev->mailbox;
+	dev->mailbox = buf;
+	if (old)
+		list_add(&old->list, &dev->buf_list);
+	spin_unlock_irqrestore(&dev->qlock, flags);
+
+	if (old)
+		atomic64_inc(&dev->stats.superseded);
+	return true;
+}
+
+/* 函数：补位时取信箱里的 buffer（持有 qlock，buf_list 已空） */
+static struct video_cap_buffer *video_cap_mailbox_take(struct video_cap_dev *dev)
+{
+	struct video_cap_buffer *buf = dev->mailbox;
+
+	if (buf) {
+		dev->mailbox = NULL;
+		atomic64_inc(&dev->stats.superseded);
 	}
-	if (n != dev->sizeimage) {
+	return buf;
+}
+
+/*
+ * 读者来取帧（DQBUF/read/poll 之前，不持有 dev->lock）：wait 表示取不到就要等，信箱里有帧则交给 vb2。
+ * vb2_buffer_done 在 qlock 里调用：放锁再交付的话，并发的 STREAMOFF 可能已经 return_all_buffers
+ * 并结束 stop_streaming，这一帧就成了 vb2 以为早已归还的 buffer。STREAMOFF 进行中时把帧留在信箱，
+ * 由 return_all_buffers 以 ERROR 归还。
+ */
+/* 函数：读者来取帧 */
+void video_cap_mailbox_flush(struct video_cap_dev *dev, bool wait)
+{
+	struct video_cap_buffer *buf;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	if (dev->stopping) {
+		dev->mailbox_wait = false;
+		spin_unlock_irqrestore(&dev->qlock, flags);
+		return;
+	}
+	buf = dev->mailbox;
+	dev->mailbox = NULL;
+	dev->mailbox_wait = wait && !buf;
+	if (buf) {
+		trace_video_cap_buf_done(dev, buf, VB2_BUF_STATE_DONE);
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+	}
+	spin_unlock_irqrestore(&dev->qlock, flags);
+}
+
+/* 函数：读者已经拿到帧（或不再等）：之后完成的帧回到信箱 */
+void video_cap_mailbox_idle(struct video_cap_dev *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	dev->mailbox_wait = false;
+	spin_unlock_irqrestore(&dev->qlock, flags);
+}
+
+/* 把 buffer 放回 buf_list 头部（描述符环满或 hot_restart 丢 warm-up 帧时暂不交付） */
+static void video_cap_requeue_buf(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	list_add(&buf->list, &dev->buf_list);
+	spin_unlock_irqrestore(&dev->qlock, flags);
+}
+
+/* 异步完成（pipeline/ring 共用）：按 DMA 结果填写 sequence/timestamp，交付元数据并归还 vb2 */
+static void video_cap_buf_complete(struct video_cap_dev *dev, struct video_cap_buffer *buf,
+				   ssize_t n, int err)
+{
+	enum vb2_buffer_state state = VB2_BUF_STATE_DONE;
+	u64 now = ktime_get_ns();
+	u64 irq = now;
+
+	trace_video_cap_dma_done(dev, buf, n, err);
+
+	/* 完成中断（或忙等命中）的时刻；比提交还早说明是上一帧留下的，退回当前时刻 */
+	if (err != -ECANCELED) {
+		irq = xdma_engine_irq_ns(dev->xdev, dev->c2h_channel, false);
+		if (irq < buf->submit_ns || irq > now)
+			irq = now;
+		video_cap_lat_record(dev, VIDEO_CAP_LAT_SUBMIT_DONE, irq - buf->submit_ns);
+	}
+
+	if (err) {
+		if (err != -ECANCELED) {
+			atomic64_inc(&dev->stats.dma_error);
+			trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_DMA, err);
+			video_cap_recover_request(dev, irq);
+			video_cap_qos_congested(dev);
+		}
+		state = VB2_BUF_STATE_ERROR;
+	} else if (n != dev->sizeimage) {
 		atomic64_inc(&dev->stats.dma_short);
-		return -EIO;
+		trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_DMA, n);
+		video_cap_qos_congested(dev);
+		state = VB2_BUF_STATE_ERROR;
+	} else if (dev->skip_left) {
+		/* hot_restart 的 warm-up：内容丢掉，buffer 放回队头重新挂，不占 sequence */
+		dev->skip_left--;
+		buf->qbuf_ns = now;
+		video_cap_requeue_buf(dev, buf);
+		return;
+	} else {
+		buf->vb.sequence = dev->sequence++;
+		buf->vb.field = V4L2_FIELD_NONE;
+		buf->vb.vb2_buf.timestamp = video_cap_frame_timestamp(dev, now);
+		video_cap_period_update(dev, now);
+		video_cap_recover_done(dev, now);
 	}
-	return 0;
+
+	if (err != -ECANCELED) {
+		video_cap_meta_frame(dev, buf, state, n, now);
+		video_cap_lat_record(dev, VIDEO_CAP_LAT_DONE_VB2, ktime_get_ns() - irq);
+	}
+	if (state == VB2_BUF_STATE_DONE && dev->low_latency && video_cap_mailbox_post(dev, buf))
+		return;
+	trace_video_cap_buf_done(dev, buf, state);
+	vb2_buffer_done(&buf->vb.vb2_buf, state);
+}
+
+/*
+ * 分片进度（pipeline/ring 共用，持有 engine->lock）：desc_done 是这一帧已完成的描述符数。
+ * 一次中断里跨过多个分片边界时只发一个事件，报最新的行数。
+ * sequence 取 dev->sequence：这一帧完成时会拿到的序号（正在接收的总是最老的那一帧）。
+ */
+/* 函数：分片边界落地，发 lines-ready 事件 */
+static void video_cap_slice_progress(struct video_cap_dev *dev, struct video_cap_buffer *buf,
+				     unsigned int desc_done)
+{
+	struct video_cap_event_lines *lines;
+	struct v4l2_event ev = {};
+	unsigned int k = buf->slices_done;
+
+	while (k < buf->slice_cnt && buf->slice_desc[k] <= desc_done)
+		k++;
+	if (k == buf->slices_done)
+		return;
+	buf->slices_done = k;
+
+	BUILD_BUG_ON(sizeof(*lines) > sizeof(ev.u.data));
+	ev.type = VIDEO_CAP_EVENT_LINES_READY;
+	lines = (struct video_cap_event_lines *)ev.u.data;
+	lines->index = buf->vb.vb2_buf.index;
+	lines->sequence = dev->sequence;
+	lines->lines = dev->height * k / dev->slices;
+	lines->height = dev->height;
+	v4l2_event_queue(&dev->vdev, &ev);
+	atomic64_inc(&dev->stats.slice_event);
+}
+
+/*
+ * buffer 挂上 engine 后发 DMA_START（pipeline 在采集 work 里，ring 在 refill 回调里、持有 engine->lock）。
+ * pos 是它挂上后在 armed_list 里的位置（从 1 开始）：前面每个在飞 buffer 先各拿一个序号。
+ */
+/* 函数：发 DMA_START 事件 */
+static void video_cap_event_dma_start(struct video_cap_dev *dev, struct video_cap_buffer *buf,
+				      unsigned int pos)
+{
+	struct video_cap_event_dma *dma;
+	struct v4l2_event ev = {};
+
+	if (!atomic_read(&dev->ev_dma_start))
+		return;
+
+	BUILD_BUG_ON(sizeof(*dma) > sizeof(ev.u.data));
+	ev.type = VIDEO_CAP_EVENT_DMA_START;
+	dma = (struct video_cap_event_dma *)ev.u.data;
+	dma->index = buf->vb.vb2_buf.index;
+	dma->sequence = READ_ONCE(dev->sequence) + pos - 1;
+	dma->vsync = (u32)atomic64_read(&dev->vsync_seq);
+	v4l2_event_queue(&dev->vdev, &ev);
+	atomic64_inc(&dev->stats.sync_event);
+}
+
+/* 函数：pipeline 模式分片进度回调（xdma_io_cb.io_progress） */
+static void video_cap_dma_progress(unsigned long cb_hndl, unsigned int desc_done)
+{
+	struct xdma_io_cb *cb = (struct xdma_io_cb *)cb_hndl;
+	struct video_cap_buffer *buf = cb->private;
+
+	video_cap_slice_progress(buf->dev, buf, desc_done);
+}
+
+/*
+ * hybrid 完成（poll_us>0，仅 pipeline 模式）：以这次完成为基准，按 frame_period_ns 预测下一帧的
+ * 完成时刻，用 hrtimer 在它之前 poll_us 调度采集 work 去忙等（video_cap_busy_poll()）。
+ * 每次完成都重新预约，所以空闲/断流时不会有忙等；中断先完成了那一帧时这次预约作废。
+ */
+/* 函数：预约下一次 hybrid 忙等（完成回调里调用，持有 engine->lock） */
+static void video_cap_poll_arm(struct video_cap_dev *dev)
+{
+	u64 period = READ_ONCE(dev->frame_period_ns);
+	u64 window = (u64)dev->poll_us * NSEC_PER_USEC;
+
+	if (!dev->hybrid_poll || dev->stopping || !period)
+		return;
+
+	WRITE_ONCE(dev->poll_last_ns, READ_ONCE(dev->last_done_ns));
+	hrtimer_start(&dev->poll_timer, ns_to_ktime(period > window ? period - window : 0),
+		      HRTIMER_MODE_REL);
+}
+
+/*
+ * pipeline / VSYNC 门控模式的 DMA 完成回调（xdma_io_cb.io_done）。
+ * 运行在 libxdma engine_service 上下文（持有 engine->lock、关中断），所以这里只做：
+ * 释放 XDMA request -> 填写 sequence/timestamp -> vb2_buffer_done -> 调度采集 work 补位。
+ * err=-ECANCELED 来自 xdma_engine_abort（STREAMOFF/看门狗）。
+ */
+/* 函数：pipeline 模式 DMA 完成回调 */
+static void video_cap_dma_done(unsigned long cb_hndl, int err)
+{
+	struct xdma_io_cb *cb = (struct xdma_io_cb *)cb_hndl;
+	struct video_cap_buffer *buf = cb->private;
+	struct video_cap_dev *dev = buf->dev;
+	ssize_t n = 0;
+
+	/*
+	 * -EBUSY 是 libxdma 在 submit 内部 transfer_init 失败时的同步回调，
+	 * 此时 request 由 xdma_xfer_submit_nowait 自己释放。
+	 */
+	if (buf->chain)
+		n = xdma_chain_completion(buf->chain);
+	else if (err != -EBUSY)
+		n = xdma_xfer_completion(cb, dev->xdev, dev->c2h_channel, false, 0,
+					 video_cap_buf_sgt(dev, buf), true, 0);
+
+	if (!video_cap_armed_take(dev, buf))
+		return;
+
+	video_cap_buf_complete(dev, buf, n, err);
+
+	video_cap_poll_arm(dev);
+	if (!dev->stopping)
+		video_cap_kick(dev);
+}
+
+/* pipeline / VSYNC 门控模式：停本路的 C2H engine 并取消在飞 transfers（回调里以 ERROR 归还） */
+static void video_cap_dma_abort(struct video_cap_dev *dev)
+{
+	xdma_engine_abort(dev->xdev, dev->c2h_channel, false);
+}
+
+/*
+ * overrun_policy=drain：用户态来不及 QBUF、engine 上又没有 buffer 时，把这一帧 DMA 进 scratch
+ * （warm-up 缓冲区），FPGA bridge 的 FIFO 一直有人排空，下一帧仍从 SOF 开始对齐。
+ * 丢掉的帧计为 frame_drop 并占用一个 sequence（与 ring 模式的 scratch 槽一致），
+ * 慢消费者只丢它没接住的帧，不会因为溢出/错位再连带 timeout 一串帧。
+ */
+/* 函数：scratch 帧完成回调（持有 engine->lock） */
+static void video_cap_scratch_done(unsigned long cb_hndl, int err)
+{
+	struct xdma_io_cb *cb = (struct xdma_io_cb *)cb_hndl;
+	struct video_cap_dev *dev = cb->private;
+	ssize_t n = xdma_chain_completion(dev->scratch_chain);
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	dev->scratch_armed = false;
+	dev->armed_jiffies = jiffies;
+	spin_unlock_irqrestore(&dev->qlock, flags);
+
+	if (err) {
+		if (err != -ECANCELED) {
+			atomic64_inc(&dev->stats.dma_error);
+			trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_DMA, err);
+			video_cap_recover_request(dev, ktime_get_ns());
+		}
+	} else if (n != dev->sizeimage) {
+		atomic64_inc(&dev->stats.dma_short);
+		trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_DMA, n);
+	} else {
+		atomic64_inc(&dev->stats.frame_drop);
+		dev->sequence++;
+		video_cap_period_update(dev, ktime_get_ns());
+	}
+
+	if (!dev->stopping)
+		video_cap_kick(dev);
+}
+
+/* 函数：engine 空闲且没有已排队 buffer 时挂一帧 scratch（采集 work 上下文） */
+static void video_cap_scratch_arm(struct video_cap_dev *dev)
+{
+	unsigned long flags;
+	ssize_t n;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	if (dev->stopping || dev->armed || dev->scratch_armed || dev->mailbox ||
+	    !list_empty(&dev->buf_list) || !llist_empty(&dev->incoming)) {
+		spin_unlock_irqrestore(&dev->qlock, flags);
+		return;
+	}
+	dev->scratch_armed = true;
+	dev->armed_jiffies = jiffies;
+	spin_unlock_irqrestore(&dev->qlock, flags);
+
+	n = xdma_chain_submit_nowait(&dev->scratch_cb, dev->scratch_chain);
+	if (n == -EIOCBQUEUED)
+		return;
+
+	WRITE_ONCE(dev->scratch_armed, false);
+	atomic64_inc(&dev->stats.dma_error);
+	trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_SCRATCH, n);
+	dev_err_ratelimited(&dev->pdev->dev, "scratch submit error: %zd\n", n);
+}
+
+/*
+ * 以 nowait 方式把一个 buffer 挂到 C2H engine 上（pipeline / VSYNC 门控模式共用）。
+ * buffer 先进 armed_list 再提交，保证完成回调一定能找到它。
+ * 返回 -EBUSY 表示 XDMA 描述符环暂时放不下，buffer 未被消费。
+ */
+/* 函数：nowait 提交一帧 DMA */
+static int video_cap_dma_arm_frame(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	struct video_cap_sg_trim trim = {};
+	struct sg_table *sgt = NULL;
+	unsigned long flags;
+	unsigned int pos, desc;
+	ssize_t n;
+	int ret;
+
+	if (!buf->chain) {
+		sgt = video_cap_buf_sgt(dev, buf);
+		if (!sgt)
+			return -EFAULT;
+
+		ret = video_cap_sg_trim(dev, sgt, &trim);
+		if (ret)
+			return ret;
+		buf->trimmed = trim.applied;
+		/* 逐帧路径（DMABUF）：libxdma 合并 DMA 地址相邻的 sg 段后的描述符数 */
+		desc = xdma_sg_desc_count(sgt);
+		atomic64_set(&dev->stats.desc_per_frame, desc);
+	} else {
+		desc = xdma_chain_desc_count(buf->chain);
+	}
+
+	memset(&buf->cb, 0, sizeof(buf->cb));
+	buf->cb.private = buf;
+	buf->cb.io_done = video_cap_dma_done;
+	if (buf->slice_cnt)
+		buf->cb.io_progress = video_cap_dma_progress;
+	buf->slices_done = 0;
+	buf->dev = dev;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	if (!dev->armed)
+		dev->armed_jiffies = jiffies;
+	list_add_tail(&buf->list, &dev->armed_list);
+	pos = ++dev->armed;
+	spin_unlock_irqrestore(&dev->qlock, flags);
+
+	buf->submit_ns = ktime_get_ns();
+	trace_video_cap_dma_submit(dev, buf, &buf->cb, desc, dev->sizeimage);
+	if (buf->chain) {
+		n = xdma_chain_submit_nowait(&buf->cb, buf->chain);
+	} else {
+		n = xdma_xfer_submit_nowait(&buf->cb, dev->xdev, dev->c2h_channel, false, 0, sgt,
+					    true, 0);
+		video_cap_sg_restore(sgt, &trim);
+	}
+
+	if (n == -EIOCBQUEUED) {
+		atomic64_inc(&dev->stats.dma_submit);
+		video_cap_lat_record(dev, VIDEO_CAP_LAT_WAKE_SUBMIT, buf->submit_ns - dev->work_ns);
+		video_cap_lat_record(dev, VIDEO_CAP_LAT_QBUF_FILL, buf->submit_ns - buf->qbuf_ns);
+		video_cap_event_dma_start(dev, buf, pos);
+		return 0;
+	}
+
+	/* 提交失败：如果回调没有抢先处理，由这里把 buffer 收回 */
+	if (!video_cap_armed_take(dev, buf))
+		return 0;
+	return n < 0 ? (int)n : -EIO;
+}
+
+/*
+ * 把 buf_queue 无锁挂到 incoming 上的 buffers 按 QBUF 顺序并进 buf_list（调用方持有 qlock）。
+ * llist_del_all 和并发的 llist_add 不冲突，QBUF 路径因此不用和完成回调/补位争 qlock。
+ */
+static void video_cap_incoming_splice(struct video_cap_dev *dev)
+{
+	struct llist_node *first = llist_del_all(&dev->incoming);
+	struct video_cap_buffer *buf, *tmp;
+
+	first = llist_reverse_order(first);
+	llist_for_each_entry_safe(buf, tmp, first, lnode)
+		list_add_tail(&buf->list, &dev->buf_list);
+}
+
+/*
+ * ring 模式 refill（持有 engine->lock）：从 buf_list（先并入 incoming）取下一个 buffer 放进空出的槽。
+ * 返回 NULL 时 libxdma 在槽里放 scratch 链，这一帧被丢弃。
+ * 没有预建链的 buffer（DMABUF）由 libxdma 以 -EINVAL 直接交回 frame_done。
+ */
+/* 函数：ring 模式取下一个待填充 buffer */
+static void *video_cap_ring_refill(void *priv, struct xdma_chain **chain)
+{
+	struct video_cap_dev *dev = priv;
+	struct video_cap_buffer *buf = NULL;
+	unsigned long flags;
+	unsigned int pos = 0;
+
+	spin_lock_irqsave(&dev->qlock, flags);
+	video_cap_incoming_splice(dev);
+	if (!dev->stopping && !list_empty(&dev->buf_list)) {
+		buf = list_first_entry(&dev->buf_list, struct video_cap_buffer, list);
+		list_move_tail(&buf->list, &dev->armed_list);
+		pos = ++dev->armed;
+	} else if (!dev->stopping) {
+		buf = video_cap_mailbox_take(dev);
+		if (buf) {
+			list_add_tail(&buf->list, &dev->armed_list);
+			pos = ++dev->armed;
+		}
+	}
+	spin_unlock_irqrestore(&dev->qlock, flags);
+
+	if (!buf)
+		return NULL;
+
+	atomic64_inc(&dev->stats.dma_submit);
+	buf->slices_done = 0;
+	buf->submit_ns = ktime_get_ns();
+	video_cap_lat_record(dev, VIDEO_CAP_LAT_QBUF_FILL, buf->submit_ns - buf->qbuf_ns);
+	trace_video_cap_dma_submit(dev, buf, buf,
+				   buf->chain ? xdma_chain_desc_count(buf->chain) : 0,
+				   dev->sizeimage);
+	if (buf->chain)
+		video_cap_event_dma_start(dev, buf, pos);
+	*chain = buf->chain;
+	return buf;
 }
 
+/*
+ * ring 模式帧完成（持有 engine->lock）：buf=NULL 表示 scratch 槽。
+ * 丢弃的帧同样占用一个 sequence，用户态可以从 sequence 跳变看出丢帧。
+ */
+/* 函数：ring 模式一个槽完成 */
+static void video_cap_ring_frame_done(void *priv, void *cookie, ssize_t bytes, int err)
+{
+	struct video_cap_dev *dev = priv;
+	struct video_cap_buffer *buf = cookie;
+
+	if (!buf) {
+		if (!err) {
+			atomic64_inc(&dev->stats.frame_drop);
+			dev->sequence++;
+		} else if (err != -ECANCELED) {
+			atomic64_inc(&dev->stats.dma_error);
+			trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_DMA, err);
+			video_cap_recover_request(dev, ktime_get_ns());
+		}
+		return;
+	}
+
+	if (!video_cap_armed_take(dev, buf))
+		return;
+
+	video_cap_buf_complete(dev, buf, bytes, err);
+}
+
+/* 函数：ring 模式分片进度（只对真实 buffer 调用，scratch 槽不报） */
+static void video_cap_ring_frame_progress(void *priv, void *cookie, unsigned int desc_done)
+{
+	video_cap_slice_progress(priv, cookie, desc_done);
+}
+
+static const struct xdma_ring_ops video_cap_ring_ops = {
+	.refill = video_cap_ring_refill,
+	.frame_done = video_cap_ring_frame_done,
+	.frame_progress = video_cap_ring_frame_progress,
+};
+
 /*
  * Warm-up（可选）：
  * 使能采集后先读并丢 N 帧，用于对齐流水线/稳定输出。
@@ -177,7 +909,13 @@ static int video_cap_dma_read_frame(struct video_cap_dev *dev, struct vb2_buffer
 /* 函数：warm-up 初始化（丢弃前 N 帧） */
 static int video_cap_warmup_init(struct video_cap_dev *dev)
 {
-	if (!dev->skip || dev->warmup_inited)
+	/*
+	 * ring 模式的 scratch 槽、overrun_policy=drain 的丢帧也指向这块缓冲区；
+	 * hot_restart 的 warm-up 在完成路径上丢用户 buffer，不需要它
+	 */
+	if (((!dev->skip || dev->hot_restart) && !dev->ring_mode &&
+	     dev->overrun_policy != VIDEO_CAP_OVERRUN_DRAIN) ||
+	    dev->warmup_inited)
 		return 0;
 
 	dev->warmup_buf = dma_alloc_coherent(&dev->pdev->dev, dev->sizeimage, &dev->warmup_dma,
@@ -193,6 +931,7 @@ static int video_cap_warmup_init(struct video_cap_dev *dev)
 	dev->warmup_sgt.sgl = &dev->warmup_sg;
 	dev->warmup_sgt.orig_nents = 1;
 	dev->warmup_sgt.nents = 1;
+	dev->warmup_size = dev->sizeimage;
 	dev->warmup_inited = true;
 	return 0;
 }
@@ -201,29 +940,115 @@ static int video_cap_warmup_init(struct video_cap_dev *dev)
 static void video_cap_warmup_free(struct video_cap_dev *dev)
 {
 	if (dev->warmup_buf) {
-		dma_free_coherent(&dev->pdev->dev, dev->sizeimage, dev->warmup_buf,
+		dma_free_coherent(&dev->pdev->dev, dev->warmup_size, dev->warmup_buf,
 				  dev->warmup_dma);
 		dev->warmup_buf = NULL;
 	}
 	dev->warmup_inited = false;
 }
 
-/* 从队列中取出下一个待填充的 vb2 buffer（线程上下文） */
+/* vb2 队列里已分配的 buffer 数 */
+static unsigned int video_cap_num_buffers(struct vb2_queue *vq)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	return vb2_get_num_buffers(vq);
+#else
+	return vq->num_buffers;
+#endif
+}
+
+/* ring 模式资源释放（engine 必须已经 xdma_ring_stop） */
+static void video_cap_ring_free(struct video_cap_dev *dev)
+{
+	xdma_ring_destroy(dev->ring);
+	dev->ring = NULL;
+	xdma_chain_free(dev->scratch_chain);
+	dev->scratch_chain = NULL;
+}
+
+/* 函数：释放 hot_restart 跨 STREAMOFF 保留的 ring / scratch 链 / warm-up 缓冲区（engine 须已停） */
+static void video_cap_stream_res_free(struct video_cap_dev *dev)
+{
+	if (dev->ring)
+		video_cap_ring_free(dev);
+	xdma_chain_free(dev->scratch_chain);
+	dev->scratch_chain = NULL;
+	video_cap_warmup_free(dev);
+}
+
+/*
+ * ring 模式启动：每个已分配的 vb2 buffer 对应环上一个槽（至少 3 个）。
+ * 槽按 sizeimage 最坏情况（每页一个描述符）分配，buffer 的预建链直接拷入槽内；
+ * scratch 链指向 warm-up 缓冲区，槽里没有 buffer 时帧写到这里。
+ * hot_restart 保留下来的环槽数够用就直接重启（sizeimage 变了的话已随 warm-up 缓冲区一起释放）。
+ */
+/* 函数：建环并启动 C2H engine（ring 模式） */
+static int video_cap_ring_start(struct video_cap_dev *dev, struct vb2_queue *vq)
+{
+	unsigned int slots = max(video_cap_num_buffers(vq), 3U);
+	unsigned int slot_desc = DIV_ROUND_UP(dev->sizeimage, PAGE_SIZE) + 1;
+	struct xdma_chain *scratch;
+	struct xdma_ring *ring;
+	int ret;
+
+	if (dev->ring && dev->ring_slots >= slots) {
+		ret = xdma_ring_start(dev->ring);
+		if (ret)
+			video_cap_ring_free(dev);
+		return ret;
+	}
+	video_cap_ring_free(dev);
+
+	scratch = xdma_chain_build(dev->xdev, dev->c2h_channel, false, 0, &dev->warmup_sgt,
+				   dev->sizeimage);
+	if (IS_ERR(scratch))
+		return PTR_ERR(scratch);
+
+	ring = xdma_ring_create(dev->xdev, dev->c2h_channel, slots, slot_desc, scratch,
+				&video_cap_ring_ops, dev);
+	if (IS_ERR(ring)) {
+		xdma_chain_free(scratch);
+		return PTR_ERR(ring);
+	}
+
+	dev->scratch_chain = scratch;
+	dev->ring = ring;
+	dev->ring_slots = slots;
+
+	ret = xdma_ring_start(ring);
+	if (ret) {
+		video_cap_ring_free(dev);
+		return ret;
+	}
+	return 0;
+}
+
+/* 从队列中取出下一个待填充的 vb2 buffer（采集 work 上下文） */
 static struct video_cap_buffer *video_cap_next_buf(struct video_cap_dev *dev)
 {
 	struct video_cap_buffer *buf = NULL;
 	unsigned long flags;
 
 	spin_lock_irqsave(&dev->qlock, flags);
+	video_cap_incoming_splice(dev);
 	if (!list_empty(&dev->buf_list)) {
 		buf = list_first_entry(&dev->buf_list, struct video_cap_buffer, list);
 		list_del(&buf->list);
+	} else {
+		buf = video_cap_mailbox_take(dev);
 	}
 	spin_unlock_irqrestore(&dev->qlock, flags);
 
 	return buf;
 }
 
+/* 是否有已 QBUF（或在信箱里可回收）、尚未挂上 engine 的 buffer（无锁快速判断） */
+static bool video_cap_has_buf(struct video_cap_dev *dev)
+{
+	return !llist_empty(&dev->incoming) || !list_empty_careful(&dev->buf_list) ||
+	       READ_ONCE(dev->mailbox);
+}
+
 /*
  * 把当前所有已排队但未完成的 buffer 以指定状态返回给 vb2。
  * 常用于：STREAMOFF / 错误退出 / probe/cleanup。
@@ -235,7 +1060,14 @@ static void video_cap_return_all_buffers(struct video_cap_dev *dev, enum vb2_buf
 	unsigned long flags;
 
 	spin_lock_irqsave(&dev->qlock, flags);
+	video_cap_incoming_splice(dev);
 	list_splice_init(&dev->buf_list, &list);
+	/* 低延时模式信箱里还没交出去的那一帧 */
+	if (dev->mailbox) {
+		list_add_tail(&dev->mailbox->list, &list);
+		dev->mailbox = NULL;
+	}
+	dev->mailbox_wait = false;
 	spin_unlock_irqrestore(&dev->qlock, flags);
 
 	while (!list_empty(&list)) {
@@ -246,59 +1078,357 @@ static void video_cap_return_all_buffers(struct video_cap_dev *dev, enum vb2_buf
 	}
 }
 
-/*
- * 采集线程主循环：
- * 1) 等待用户态 QBUF（buf_list 非空）
- * 2) 等待 VSYNC（对齐到帧边界）
- * 3) 提交一次整帧 DMA，把 FPGA 输出写入该 buffer
- * 4) 完成后 vb2_buffer_done(DONE)，失败则 ERROR
- */
-static int video_cap_thread_fn(void *data)
+/* pipeline 模式：在 armed < pipe_depth 时持续补充已排队的 buffer */
+static void video_cap_pipeline_fill(struct video_cap_dev *dev)
 {
-	struct video_cap_dev *dev = data;
-	u64 vsync_seq = (u64)atomic64_read(&dev->vsync_seq);
-
-	while (!kthread_should_stop()) {
+	while (!dev->stopping && READ_ONCE(dev->armed) < dev->pipe_depth) {
 		struct video_cap_buffer *buf;
+		u64 now;
 		int ret;
 
-		wait_event_interruptible(dev->wq,
-					 dev->stopping || !list_empty(&dev->buf_list) ||
-						 kthread_should_stop());
-		if (dev->stopping || kthread_should_stop())
-			break;
-
 		buf = video_cap_next_buf(dev);
 		if (!buf)
-			continue;
+			break;
 
-		ret = video_cap_wait_vsync(dev, &vsync_seq);
-		if (ret)
-			goto buf_err;
+		/* 降帧：engine 空着等到下一个允许挂帧的时刻，其间的帧由 bridge 丢掉 */
+		now = ktime_get_ns();
+		if (!video_cap_qos_gate(dev, now)) {
+			video_cap_requeue_buf(dev, buf);
+			video_cap_work_defer(dev, nsecs_to_jiffies(dev->qos_next_ns - now) + 1);
+			break;
+		}
 
-		ret = video_cap_dma_read_frame(dev, &buf->vb.vb2_buf);
-		if (ret)
-			goto buf_err;
+		ret = video_cap_dma_arm_frame(dev, buf);
+		if (ret == -EBUSY) {
+			unsigned int armed = READ_ONCE(dev->armed);
+
+			video_cap_requeue_buf(dev, buf);
+			/*
+			 * 描述符环放不下 depth 帧：本次 STREAMON 收敛到实际能挂住的帧数，
+			 * 避免 work 反复空跑；配置值不动，下次 STREAMON 重新尝试
+			 */
+			if (armed) {
+				dev_warn(&dev->pdev->dev,
+					 "pipeline_depth=%u exceeds XDMA descriptor ring, use %u\n",
+					 dev->pipe_depth, armed);
+				dev->pipe_depth = armed;
+			}
+			break;
+		}
+		if (ret) {
+			atomic64_inc(&dev->stats.dma_error);
+			trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_SUBMIT, ret);
+			vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+			dev_err_ratelimited(&dev->pdev->dev, "dma submit error: %d\n", ret);
+		}
+	}
+}
 
-		buf->vb.sequence = dev->sequence++;
-		buf->vb.field = V4L2_FIELD_NONE;
-		buf->vb.vb2_buf.timestamp = ktime_get_ns();
-		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
-		continue;
+/*
+ * VSYNC 门控（pipeline_depth=0）：engine 空闲时，每出现一次新的 VSYNC 挂一帧（nowait）。
+ * VSYNC ISR、QBUF 和完成回调都会调度采集 work，这里从不阻塞：
+ * 还没有新 VSYNC 就记下开始等待的时刻（看门狗据此判 vsync timeout），等 ISR 再次调度。
+ */
+/* 函数：VSYNC 门控模式下挂一帧 DMA */
+static void video_cap_vsync_fill(struct video_cap_dev *dev)
+{
+	u64 seq = (u64)atomic64_read(&dev->vsync_seq);
+	struct video_cap_buffer *buf;
+	int ret;
+
+	if (dev->stopping || READ_ONCE(dev->armed) || READ_ONCE(dev->scratch_armed)) {
+		dev->vsync_waiting = false;
+		return;
+	}
+
+	if (!video_cap_has_buf(dev)) {
+		dev->vsync_waiting = false;
+		/* drain：这一帧没有 buffer 接，也要让 engine 把它从 FIFO 里取走（降帧时不占链路） */
+		if (dev->scratch_chain && seq != dev->vsync_used && !video_cap_qos_throttled(dev)) {
+			dev->vsync_used = seq;
+			video_cap_scratch_arm(dev);
+		}
+		return;
+	}
+
+	if (seq == dev->vsync_used) {
+		if (!dev->vsync_waiting) {
+			dev->vsync_waiting = true;
+			dev->vsync_wait_jiffies = jiffies;
+		}
+		return;
+	}
+
+	/* 降帧：这次 VSYNC 不挂，帧留在 bridge 里丢掉 */
+	if (!video_cap_qos_gate(dev, ktime_get_ns())) {
+		dev->vsync_used = seq;
+		dev->vsync_waiting = false;
+		atomic64_inc(&dev->stats.qos_skip);
+		return;
+	}
 
-buf_err:
+	buf = video_cap_next_buf(dev);
+	if (!buf)
+		return;
+
+	atomic64_inc(&dev->stats.vsync_wait);
+	dev->vsync_used = seq;
+	dev->vsync_waiting = false;
+	ret = video_cap_dma_arm_frame(dev, buf);
+	if (ret) {
+		atomic64_inc(&dev->stats.dma_error);
+		trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_SUBMIT, ret);
 		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
-		if (ret && ret != -ERESTARTSYS) {
-			if (ret == -ETIMEDOUT)
-				dev_err_ratelimited(&dev->pdev->dev, "vsync timeout\n");
-			else
-				dev_err_ratelimited(&dev->pdev->dev, "capture error: %d\n", ret);
+		dev_err_ratelimited(&dev->pdev->dev, "capture error: %d\n", ret);
+	}
+}
+
+/*
+ * VSYNC 门控模式：本次 work 是被一个新的 VSYNC 唤醒的，记 VSYNC ISR -> work 运行的延迟。
+ * 看门狗/QBUF 唤醒的那几次看不到新序号，不计入。
+ */
+/* 函数：记录 vsync_wake 延迟 */
+static void video_cap_lat_vsync(struct video_cap_dev *dev)
+{
+	u64 seq = (u64)atomic64_read(&dev->vsync_seq);
+	u64 ts;
+
+	if (seq == dev->lat_vsync_seen)
+		return;
+	dev->lat_vsync_seen = seq;
+	if (video_cap_vsync_ts(dev, seq, &ts) && dev->work_ns >= ts)
+		video_cap_lat_record(dev, VIDEO_CAP_LAT_VSYNC_WAKE, dev->work_ns - ts);
+}
+
+/*
+ * hybrid 完成（poll_us>0）：在 work 里忙等 hrtimer 预约的那一帧（见 video_cap_poll_arm()），
+ * 在 writeback 上最多忙等 2*poll_us。命中时完成回调直接在 work 里运行，
+ * 省掉 IRQ -> workqueue 的调度延迟；未命中则这一帧交回中断。
+ * 到点前中断已经完成了这一帧（已重新预约），或已经没有帧在飞时不忙等。
+ */
+/* 函数：hybrid 完成模式的忙等 */
+static void video_cap_busy_poll(struct video_cap_dev *dev)
+{
+	int ret;
+
+	if (!READ_ONCE(dev->poll_due))
+		return;
+	WRITE_ONCE(dev->poll_due, false);
+
+	if (READ_ONCE(dev->last_done_ns) != READ_ONCE(dev->poll_last_ns) ||
+	    !READ_ONCE(dev->armed))
+		return;
+
+	ret = xdma_engine_poll_completion(dev->xdev, dev->c2h_channel, false, 2 * dev->poll_us);
+	if (ret > 0)
+		atomic64_inc(&dev->stats.poll_hit);
+	else if (!ret)
+		atomic64_inc(&dev->stats.poll_miss);
+}
+
+/* 函数：hybrid 忙等预约到点（hrtimer，硬中断上下文），交给采集 work */
+static enum hrtimer_restart video_cap_poll_timer_fn(struct hrtimer *t)
+{
+	struct video_cap_dev *dev = container_of(t, struct video_cap_dev, poll_timer);
+
+	WRITE_ONCE(dev->poll_due, true);
+	video_cap_kick(dev);
+	return HRTIMER_NORESTART;
+}
+
+/* 函数：执行一次恢复（采集 work 上下文，见 video_cap_recover_request()） */
+static void video_cap_recover(struct video_cap_dev *dev)
+{
+	u64 us;
+
+	if (atomic_read(&dev->recover_state) != VIDEO_CAP_RECOVER_PENDING)
+		return;
+
+	/* 先停 engine 再复位 bridge：复位后送出的第一拍一定落在重新挂上的 buffer 开头 */
+	if (!dev->ring_mode) {
+		video_cap_dma_abort(dev);
+		/* VSYNC 门控：复位之前的 VSYNC 不算，从下一次开始挂帧 */
+		dev->vsync_used = (u64)atomic64_read(&dev->vsync_seq);
+		dev->vsync_waiting = false;
+	}
+	video_cap_soft_reset(dev);
+	atomic_set(&dev->recover_state, VIDEO_CAP_RECOVER_RESYNC);
+
+	us = div_u64(ktime_get_ns() - READ_ONCE(dev->recover_start_ns), NSEC_PER_USEC);
+	atomic64_inc(&dev->stats.recover);
+	trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_RECOVER, us);
+	dev_warn_ratelimited(&dev->pdev->dev,
+			     "dma error: engine and bridge reset, resync on next SOF\n");
+}
+
+/*
+ * 看门狗：
+ * - 有 buffer 在飞但超过 vsync_timeout_ms 没有任何完成：abort engine，
+ *   在飞的 buffers 以 ERROR 返回，随后重新补位（dma_recover=1 时交给 video_cap_recover()，
+ *   同时复位 bridge）
+ * - VSYNC 门控模式下有 buffer 等了 vsync_timeout_ms 仍没有 VSYNC：把这个 buffer 以 ERROR 归还
+ */
+/* 函数：DMA / VSYNC 超时检查 */
+static void video_cap_watchdog(struct video_cap_dev *dev, unsigned long timeout)
+{
+	struct video_cap_buffer *buf;
+
+	if ((READ_ONCE(dev->armed) || READ_ONCE(dev->scratch_armed)) &&
+	    time_after(jiffies, READ_ONCE(dev->armed_jiffies) + timeout)) {
+		atomic64_inc(&dev->stats.dma_error);
+		trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_DMA_TIMEOUT, -ETIMEDOUT);
+		dev_err_ratelimited(&dev->pdev->dev, "dma timeout, abort %u armed buffers\n",
+				    READ_ONCE(dev->armed));
+		video_cap_qos_congested(dev);
+		/* 从最后一次 DMA 进展算起就没有视频了；恢复时由 video_cap_recover() 统一 abort */
+		if (dev->dma_recover) {
+			u64 stall = jiffies_to_nsecs(jiffies - READ_ONCE(dev->armed_jiffies));
+
+			video_cap_recover_request(dev, ktime_get_ns() - stall);
+		} else {
+			video_cap_dma_abort(dev);
 		}
 	}
 
+	if (!dev->vsync_waiting || (u64)atomic64_read(&dev->vsync_seq) != dev->vsync_used ||
+	    !time_after(jiffies, dev->vsync_wait_jiffies + timeout))
+		return;
+
+	dev->vsync_waiting = false;
+	atomic64_inc(&dev->stats.vsync_timeout);
+	trace_video_cap_error(dev, VIDEO_CAP_TRACE_ERR_VSYNC_TIMEOUT, -ETIMEDOUT);
+	dev_err_ratelimited(&dev->pdev->dev, "vsync timeout\n");
+	buf = video_cap_next_buf(dev);
+	if (buf)
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+}
+
+/*
+ * 采集 work（pipeline / VSYNC 门控模式共用，取代原来每路一个的采集线程）：
+ * - QBUF、VSYNC ISR、DMA 完成回调、hybrid hrtimer 都用 video_cap_kick() 立即调度它，
+ *   空闲时每 vsync_timeout_ms 自己跑一次看门狗
+ * - 同一个 work 不会并发运行，看门狗 abort、出错恢复、补位和忙等天然串行
+ * - 完成回调持有 engine->lock，不能在回调里提交同一 engine，所以补位总在这里做
+ */
+/* 函数：采集 work 的一步（cap_wq 和实时 kthread_worker 共用） */
+static void video_cap_work_step(struct video_cap_dev *dev)
+{
+	unsigned long timeout = max(msecs_to_jiffies(dev->vsync_timeout_ms), 1UL);
+
+	if (dev->stopping || !READ_ONCE(dev->streaming))
+		return;
+
+	/* ring 模式只有恢复请求会调度到这里 */
+	if (dev->ring_mode) {
+		video_cap_recover(dev);
+		return;
+	}
+
+	dev->work_ns = ktime_get_ns();
+	if (!dev->pipeline_depth)
+		video_cap_lat_vsync(dev);
+
+	video_cap_watchdog(dev, timeout);
+	video_cap_recover(dev);
+	video_cap_qos_relax(dev);
+	if (dev->pipeline_depth) {
+		video_cap_pipeline_fill(dev);
+		/* 补位后 engine 仍是空的：说明用户态没有 buffer，drain 模式下用 scratch 顶上（降帧时不顶） */
+		if (dev->scratch_chain && !video_cap_qos_throttled(dev))
+			video_cap_scratch_arm(dev);
+		video_cap_busy_poll(dev);
+	} else {
+		video_cap_vsync_fill(dev);
+	}
+
+	/* 已经被 kick 提前排上时不会推迟它 */
+	if (!dev->stopping)
+		video_cap_work_defer(dev, timeout);
+}
+
+/* 函数：采集 work（共用的 cap_wq） */
+static void video_cap_work_fn(struct work_struct *work)
+{
+	video_cap_work_step(container_of(to_delayed_work(work), struct video_cap_dev, cap_work));
+}
+
+/* 函数：采集 work（本路的实时 kthread_worker） */
+static void video_cap_kwork_fn(struct kthread_work *work)
+{
+	video_cap_work_step(container_of(work, struct video_cap_dev, cap_kwork.work));
+}
+
+/* 函数：初始化采集状态机（probe 时每路调用一次） */
+void video_cap_capture_init(struct video_cap_dev *dev)
+{
+	init_llist_head(&dev->incoming);
+	INIT_DELAYED_WORK(&dev->cap_work, video_cap_work_fn);
+	kthread_init_delayed_work(&dev->cap_kwork, video_cap_kwork_fn);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&dev->poll_timer, video_cap_poll_timer_fn, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&dev->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dev->poll_timer.function = video_cap_poll_timer_fn;
+#endif
+}
+
+/*
+ * CFS 下 WQ_HIGHPRI worker 也会被同 CPU 上的普通任务抢占，忙的机器上 VSYNC -> 提交的尾延迟从 us 级
+ * 涨到 ms 级。rt_prio>0 的通道改由自己的 SCHED_FIFO/RR 线程跑采集 work，work_cpu 固定时绑在那个 CPU。
+ * 必须在任何 kick 之前调用（probe 里，STREAMON 之前），之后 cap_worker 不再变。
+ */
+/* 函数：起本路的实时采集线程 */
+int video_cap_capture_rt(struct video_cap_dev *dev, int policy, unsigned int prio)
+{
+	struct kthread_worker *w;
+	int ret;
+
+	w = kthread_create_worker(0, "video_cap/c2h%u", dev->c2h_channel);
+	if (IS_ERR(w))
+		return PTR_ERR(w);
+
+	if (dev->work_cpu != WORK_CPU_UNBOUND)
+		set_cpus_allowed_ptr(w->task, cpumask_of(dev->work_cpu));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+	{
+		struct sched_attr attr = {
+			.size = sizeof(attr),
+			.sched_policy = policy,
+			.sched_priority = prio,
+		};
+
+		ret = sched_setattr_nocheck(w->task, &attr);
+	}
+#else
+	{
+		struct sched_param sp = { .sched_priority = prio };
+
+		ret = sched_setscheduler_nocheck(w->task, policy, &sp);
+	}
+#endif
+	if (ret) {
+		kthread_destroy_worker(w);
+		return ret;
+	}
+
+	dev->cap_worker = w;
+	dev->rt_policy = policy;
+	dev->rt_prio = prio;
 	return 0;
 }
 
+/* 函数：停本路的实时采集线程（已 STREAMOFF，work 不会再被 kick） */
+void video_cap_capture_exit(struct video_cap_dev *dev)
+{
+	if (!dev->cap_worker)
+		return;
+
+	kthread_cancel_delayed_work_sync(&dev->cap_kwork);
+	kthread_destroy_worker(dev->cap_worker);
+	dev->cap_worker = NULL;
+}
+
 static int video_cap_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers, unsigned int *nplanes,
 				 unsigned int sizes[], struct device *alloc_devs[])
 {
@@ -308,13 +1438,152 @@ static int video_cap_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers, u
 	*nplanes = 1;
 	sizes[0] = dev->sizeimage;
 
-	/* 这里强制最少 4 个 buffer（更稳，但会增加系统整体缓冲；低延时可后续再优化） */
+	/*
+	 * 低延时模式：信箱会回收没人取的帧，engine 上 1 个 + 用户态 1 个就能转，最少 2 个
+	 * （pipeline 模式 depth 个之外再留 1 个）
+	 */
+	if (dev->low_latency) {
+		*nbuffers = max3(*nbuffers, 2U, dev->pipeline_depth + 1);
+		return 0;
+	}
+
+	/* 这里强制最少 4 个 buffer（更稳，但会增加系统整体缓冲；低延时见 low_latency 控件） */
 	if (*nbuffers < 4)
 		*nbuffers = 4;
+	/* pipeline 模式：engine 上挂满 depth 个之外，至少还要留 2 个给用户态/等待队列 */
+	if (*nbuffers < dev->pipeline_depth + 2)
+		*nbuffers = dev->pipeline_depth + 2;
+
+	return 0;
+}
+
+/*
+ * 给 buffer 的预建链按行边界标出 slices-1 个分片点（每个点一次描述符完成中断）。
+ * 任何一个点失败都整帧退回不分片（已标的点只多出几次无事件的中断）。
+ */
+static void video_cap_slice_mark(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	unsigned int i;
+	int n;
+
+	buf->slice_cnt = 0;
+	if (dev->slices < 2)
+		return;
+
+	for (i = 1; i < dev->slices; i++) {
+		n = xdma_chain_mark(buf->chain,
+				    dev->height * i / dev->slices * dev->bytesperline);
+		if (n < 0) {
+			dev_warn_ratelimited(&dev->pdev->dev,
+					     "buffer %u: slice mark failed: %d\n",
+					     buf->vb.vb2_buf.index, n);
+			return;
+		}
+		buf->slice_desc[i - 1] = n;
+	}
+	buf->slice_cnt = dev->slices - 1;
+}
+
+/*
+ * dma-sg 的页由 REQBUFS（MMAP）/ QBUF（USERPTR）的调用进程按它的内存策略分配，驱动管不到节点，
+ * 这里只统计落在设备节点上/外的页数（debugfs numa），远端页多时用 numactl --membind 绑住采集进程。
+ * dma_contig 走 DMA API，本来就在设备节点上分配。
+ */
+/* 函数：统计 buffer 页所在的 NUMA 节点 */
+static void video_cap_buf_numa_account(struct video_cap_dev *dev, struct video_cap_buffer *buf)
+{
+	int node = dev_to_node(&dev->pdev->dev);
+	struct scatterlist *sg;
+	struct sg_table *sgt;
+	unsigned int i;
+
+	buf->pages_local = 0;
+	buf->pages_remote = 0;
+	if (dev->dma_contig)
+		return;
+
+	sgt = vb2_dma_sg_plane_desc(&buf->vb.vb2_buf, 0);
+	if (!sgt)
+		return;
+
+	/* 一个 sg 段物理连续，按首页算节点 */
+	for_each_sg(sgt->sgl, sg, sgt->orig_nents, i) {
+		unsigned long n = PAGE_ALIGN(sg->offset + sg->length) >> PAGE_SHIFT;
+
+		if (node == NUMA_NO_NODE || page_to_nid(sg_page(sg)) == node)
+			buf->pages_local += n;
+		else
+			buf->pages_remote += n;
+	}
+	atomic_long_add(buf->pages_local, &dev->pages_local);
+	atomic_long_add(buf->pages_remote, &dev->pages_remote);
+}
+
+/*
+ * vb2 回调：buffer 初始化（REQBUFS/CREATE_BUFS 分配后调用一次）。
+ * 按当前 sizeimage 预建 XDMA 描述符链，采集热路径上不再 kmalloc request、
+ * 不再重建描述符，也不再裁剪/恢复 sg_table。
+ * DMABUF 每次 QBUF 都会重新 map（DMA 地址可能变化），因此仍走逐帧路径。
+ * 建链失败不致命：chain=NULL 时回落到 xdma_xfer_submit 旧路径。
+ * 每帧描述符数记在 desc_per_frame（control video_cap_desc_per_frame 可读）。
+ */
+static int video_cap_buf_init(struct vb2_buffer *vb)
+{
+	struct video_cap_dev *dev = vb2_get_drv_priv(vb->vb2_queue);
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct video_cap_buffer *buf = container_of(vbuf, struct video_cap_buffer, vb);
+	struct xdma_chain *chain;
+	struct sg_table *sgt;
+
+	buf->dev = dev;
+	buf->chain = NULL;
+	buf->slice_cnt = 0;
+	buf->trimmed = false;
+	if (vb->memory == VB2_MEMORY_DMABUF)
+		return 0;
+
+	video_cap_buf_numa_account(dev, buf);
+
+	if (vb2_plane_size(vb, 0) < dev->sizeimage)
+		return 0;
+
+	/* 预建链只覆盖 sizeimage，buffer 更长（页对齐尾巴）时等价于每帧都裁剪过 */
+	buf->trimmed = vb2_plane_size(vb, 0) > dev->sizeimage;
+
+	sgt = video_cap_buf_sgt(dev, buf);
+	if (!sgt)
+		return 0;
+
+	chain = xdma_chain_build(dev->xdev, dev->c2h_channel, false, 0, sgt, dev->sizeimage);
+	if (IS_ERR(chain)) {
+		atomic64_inc(&dev->stats.chain_build_fail);
+		dev_warn_ratelimited(&dev->pdev->dev,
+				     "buffer %u: prebuilt descriptor chain failed: %ld\n",
+				     vb->index, PTR_ERR(chain));
+		return 0;
+	}
 
+	buf->chain = chain;
+	atomic64_set(&dev->stats.desc_per_frame, xdma_chain_desc_count(chain));
+	video_cap_slice_mark(dev, buf);
 	return 0;
 }
 
+/* vb2 回调：buffer 释放前销毁预建描述符链 */
+static void video_cap_buf_cleanup(struct vb2_buffer *vb)
+{
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct video_cap_buffer *buf = container_of(vbuf, struct video_cap_buffer, vb);
+	struct video_cap_dev *dev = vb2_get_drv_priv(vb->vb2_queue);
+
+	atomic_long_sub(buf->pages_local, &dev->pages_local);
+	atomic_long_sub(buf->pages_remote, &dev->pages_remote);
+	buf->pages_local = 0;
+	buf->pages_remote = 0;
+	xdma_chain_free(buf->chain);
+	buf->chain = NULL;
+}
+
 /* vb2 回调：准备 buffer（检查大小并设置 payload） */
 static int video_cap_buf_prepare(struct vb2_buffer *vb)
 {
@@ -327,19 +1596,71 @@ static int video_cap_buf_prepare(struct vb2_buffer *vb)
 	return 0;
 }
 
-/* vb2 回调：用户态 QBUF 之后，把 buffer 放入待处理队列并唤醒采集线程 */
+/* vb2 回调：用户态 QBUF 之后，把 buffer 无锁挂到 incoming，必要时调度采集 work */
 static void video_cap_buf_queue(struct vb2_buffer *vb)
 {
 	struct video_cap_dev *dev = vb2_get_drv_priv(vb->vb2_queue);
 	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
 	struct video_cap_buffer *buf = container_of(vbuf, struct video_cap_buffer, vb);
-	unsigned long flags;
 
-	spin_lock_irqsave(&dev->qlock, flags);
-	list_add_tail(&buf->list, &dev->buf_list);
-	spin_unlock_irqrestore(&dev->qlock, flags);
+	buf->qbuf_ns = ktime_get_ns();
+	trace_video_cap_buf_queue(dev, buf);
+	llist_add(&buf->lnode, &dev->incoming);
+
+	/* ring 模式：把新 buffer 换进 scratch 槽（refill 里并入 incoming） */
+	if (dev->ring) {
+		xdma_ring_kick(dev->ring);
+		return;
+	}
+
+	/*
+	 * engine 上已经挂满时不用调度：下一次完成回调会调度 work，届时并入 incoming。
+	 * STREAMON 之前排队的 buffers 由 start_streaming 末尾统一调度。
+	 */
+	if (READ_ONCE(dev->streaming) &&
+	    READ_ONCE(dev->armed) < max(dev->pipe_depth, 1U))
+		video_cap_kick(dev);
+}
 
-	wake_up(&dev->wq);
+/*
+ * STREAMON 时使能 FPGA 采集，返回后 skip_left 为完成路径上要丢的 warm-up 帧数。
+ * hot_restart 且 bridge 仍按同样的配置开着时什么都不写：bridge 没人取数时在 FIFO 溢出处复位、
+ * 一直停在 SOF 上对齐，engine 一挂上下一个 VSYNC 就出帧，也不需要 warm-up。
+ * 配置变了（S_FMT / test_pattern）则重写并软复位，从下一个 SOF 重新对齐。
+ */
+static int video_cap_hw_start(struct video_cap_dev *dev)
+{
+	bool live = dev->hw_live;
+	int ret;
+
+	dev->skip_left = 0;
+	if (live && dev->hw_pixfmt == dev->pixfmt && dev->hw_test_pattern == dev->test_pattern)
+		return 0;
+
+	ret = video_cap_enable(dev, true);
+	if (ret)
+		return ret;
+	if (live)
+		video_cap_soft_reset(dev);
+	dev->hw_pixfmt = dev->pixfmt;
+	dev->hw_test_pattern = dev->test_pattern;
+	dev->hw_live = true;
+
+	/* hot 模式的 warm-up 不在 STREAMON 里同步等，改到完成路径上丢 */
+	if (dev->hot_restart)
+		dev->skip_left = dev->skip;
+	return 0;
+}
+
+/* 函数：释放 hot_restart 保留的资源并关掉 bridge / VSYNC IRQ（remove 时调用，须已 STREAMOFF） */
+void video_cap_capture_release(struct video_cap_dev *dev)
+{
+	if (dev->hw_live) {
+		xdma_user_isr_disable(dev->xdev, dev->user_irq_mask);
+		video_cap_enable(dev, false);
+		dev->hw_live = false;
+	}
+	video_cap_stream_res_free(dev);
 }
 
 /*
@@ -347,7 +1668,7 @@ static void video_cap_buf_queue(struct vb2_buffer *vb)
  * - enable user IRQ（VSYNC）
  * - enable FPGA capture
  * - 可选 warm-up 丢弃 N 帧
- * - 启动采集线程
+ * - 调度采集 work（ring 模式直接启动描述符环）
  */
 static int video_cap_start_streaming(struct vb2_queue *vq, unsigned int count)
 {
@@ -374,30 +1695,49 @@ static int video_cap_start_streaming(struct vb2_queue *vq, unsigned int count)
 		mutex_unlock(&dev->multi->hw_lock);
 	}
 
+	/* 带宽准入：各路加起来超过链路预算时拒绝，而不是开起来之后随机丢帧 */
+	ret = video_cap_qos_admit(dev);
+	if (ret) {
+		video_cap_return_all_buffers(dev, VB2_BUF_STATE_QUEUED);
+		goto err_active;
+	}
+
 	dev->stopping = false;
 	dev->sequence = 0;
-	atomic64_set(&dev->vsync_seq, 0);
+	atomic_set(&dev->recover_state, VIDEO_CAP_RECOVER_IDLE);
+	dev->lat_vsync_seen = 0;
 	vsync_seq = 0;
 
-	/* 打开 VSYNC user IRQ（仅对本路绑定的 bit 生效） */
-	ret = xdma_user_isr_enable(dev->xdev, dev->user_irq_mask);
-	if (ret) {
-		dev_err(&dev->pdev->dev, "enable user irq failed: %d\n", ret);
-		video_cap_return_all_buffers(dev, VB2_BUF_STATE_QUEUED);
-		goto err_active;
+	/* hot_restart 保留下来时 IRQ 一直开着：VSYNC 序号保持单调，不和 ISR 抢着清零 */
+	if (!dev->hw_live) {
+		atomic64_set(&dev->vsync_seq, 0);
+		memset(dev->vsync_ring, 0, sizeof(dev->vsync_ring));
+
+		/* 打开 VSYNC user IRQ（仅对本路绑定的 bit 生效） */
+		ret = xdma_user_isr_enable(dev->xdev, dev->user_irq_mask);
+		if (ret) {
+			dev_err(&dev->pdev->dev, "enable user irq failed: %d\n", ret);
+			video_cap_return_all_buffers(dev, VB2_BUF_STATE_QUEUED);
+			goto err_active;
+		}
 	}
 
-	/* 使能 FPGA 采集（写 CTRL/VID_FORMAT 等寄存器） */
-	ret = video_cap_enable(dev, true);
+	/* 使能 FPGA 采集（写 CTRL/VID_FORMAT 等寄存器；hot 复用且配置没变时不写） */
+	ret = video_cap_hw_start(dev);
 	if (ret)
 		goto err_irq;
 
-	/* warm-up 缓冲区准备（如果 skip=0 则不会分配） */
+	/* hot_restart 保留的缓冲区大小不对了（S_FMT / 分辨率变化）：连同指向它的 ring/scratch 链一起重建 */
+	if (dev->warmup_inited && dev->warmup_size != dev->sizeimage)
+		video_cap_stream_res_free(dev);
+
+	/* warm-up 缓冲区准备（skip=0 且非 ring 模式时不会分配） */
 	ret = video_cap_warmup_init(dev);
 	if (ret)
 		goto err_disable;
 
-	for (i = 0; i < dev->skip; i++) {
+	/* hot_restart 时 warm-up 由 video_cap_hw_start() 转成完成路径上的 skip_left，STREAMON 不等 */
+	for (i = 0; !dev->hot_restart && i < dev->skip; i++) {
 		ssize_t n;
 
 		ret = video_cap_wait_vsync(dev, &vsync_seq);
@@ -415,25 +1755,74 @@ static int video_cap_start_streaming(struct vb2_queue *vq, unsigned int count)
 		}
 	}
 
-	dev->thread = kthread_run(video_cap_thread_fn, dev, DRV_NAME "_cap");
-	if (IS_ERR(dev->thread)) {
-		ret = PTR_ERR(dev->thread);
-		dev->thread = NULL;
-		goto err_disable;
+	dev->armed = 0;
+	dev->pipe_depth = dev->pipeline_depth;
+	dev->frame_period_ns = 0;
+	dev->last_done_ns = 0;
+	dev->poll_last_ns = 0;
+	dev->hybrid_poll = false;
+	if (!dev->ring_mode && dev->pipeline_depth && dev->poll_us) {
+		ret = xdma_engine_poll_wb(dev->xdev, dev->c2h_channel, false, true);
+		if (ret)
+			dev_warn(&dev->pdev->dev, "busy-poll unavailable (%d), interrupts only\n",
+				 ret);
+		else
+			dev->hybrid_poll = true;
+	}
+
+	if (dev->ring_mode) {
+		/* ring 模式连采集 work 都不用，帧完成和补槽都在 engine 中断 / QBUF 路径上 */
+		ret = video_cap_ring_start(dev, vq);
+		if (ret) {
+			dev_err(&dev->pdev->dev, "start C2H ring failed: %d\n", ret);
+			goto err_disable;
+		}
+		dev->streaming = true;
+		return 0;
+	}
+
+	dev->scratch_armed = false;
+	if (dev->overrun_policy == VIDEO_CAP_OVERRUN_DRAIN && !dev->scratch_chain) {
+		struct xdma_chain *scratch;
+
+		scratch = xdma_chain_build(dev->xdev, dev->c2h_channel, false, 0,
+					   &dev->warmup_sgt, dev->sizeimage);
+		if (IS_ERR(scratch)) {
+			dev_warn(&dev->pdev->dev,
+				 "overrun drain unavailable (%ld), stall on overrun\n",
+				 PTR_ERR(scratch));
+		} else {
+			memset(&dev->scratch_cb, 0, sizeof(dev->scratch_cb));
+			dev->scratch_cb.private = dev;
+			dev->scratch_cb.io_done = video_cap_scratch_done;
+			dev->scratch_chain = scratch;
+		}
 	}
 
-	dev->streaming = true;
+	/* STREAMON 之前（含 warm-up）的 VSYNC 不算：从下一次 VSYNC 开始挂帧 */
+	dev->vsync_used = (u64)atomic64_read(&dev->vsync_seq);
+	dev->vsync_waiting = false;
+	dev->poll_due = false;
+	WRITE_ONCE(dev->streaming, true);
+	/* 把 STREAMON 之前排队的 buffers 挂上去，之后由 ISR/完成回调/QBUF 驱动 */
+	video_cap_kick(dev);
 	return 0;
 
 err_disable:
-	/* 注意顺序：先关采集，再释放 warm-up 资源 */
+	if (dev->hybrid_poll) {
+		xdma_engine_poll_wb(dev->xdev, dev->c2h_channel, false, false);
+		dev->hybrid_poll = false;
+	}
+	/* 注意顺序：先关采集，再释放 warm-up 资源（hot_restart 保留的也一并放掉） */
 	video_cap_enable(dev, false);
-	video_cap_warmup_free(dev);
+	video_cap_stream_res_free(dev);
 err_irq:
 	/* 如果中途失败，需要把 IRQ 关掉避免空转唤醒 */
 	xdma_user_isr_disable(dev->xdev, dev->user_irq_mask);
+	dev->hw_live = false;
 	video_cap_return_all_buffers(dev, VB2_BUF_STATE_QUEUED);
 err_active:
+	video_cap_qos_release(dev);
 	if (!dev->multi->has_per_ch_regs) {
 		mutex_lock(&dev->multi->hw_lock);
 		if (dev->multi->active_stream == dev)
@@ -445,32 +1834,60 @@ err_active:
 
 /*
  * vb2 回调：STREAMOFF
- * - 停止采集线程
+ * - 停止采集 work / hybrid hrtimer
  * - disable user IRQ
  * - disable FPGA capture
  * - 归还所有未完成 buffer（ERROR）
+ * hot_restart=1 时只停 engine、归还 buffers：IRQ、bridge 使能、warm-up 缓冲区、scratch 链和 ring
+ * 都留给下一次 STREAMON，remove 时由 video_cap_capture_release() 释放
  */
-/* 函数：vb2 STREAMOFF（停线程/关 IRQ/归还 buffers） */
+/* 函数：vb2 STREAMOFF（停采集 work/关 IRQ/归还 buffers） */
 void video_cap_stop_streaming(struct vb2_queue *vq)
 {
 	struct video_cap_dev *dev = vb2_get_drv_priv(vq);
 
-	/* 通知线程退出，并唤醒所有 waitqueue 避免卡死 */
+	/* 之后 ISR/完成回调不再调度 work；先停状态机，abort 时不会有补位并发 */
 	dev->stopping = true;
-	wake_up(&dev->wq);
 	wake_up_interruptible(&dev->vsync_wq);
+	hrtimer_cancel(&dev->poll_timer);
+	video_cap_work_cancel(dev);
+
+	/* ring 模式：停 engine，槽里的 buffers 经 frame_done(-ECANCELED) 以 ERROR 归还 */
+	if (dev->ring) {
+		xdma_ring_stop(dev->ring);
+		if (!dev->hot_restart)
+			video_cap_ring_free(dev);
+	}
 
-	if (dev->thread) {
-		kthread_stop(dev->thread);
-		dev->thread = NULL;
+	/* pipeline / VSYNC 门控模式：停 engine 并取消在飞的 transfers（回调里以 ERROR 归还） */
+	if (!dev->ring_mode) {
+		video_cap_dma_abort(dev);
+		/* drain 的 scratch 链（ring 模式的在 video_cap_ring_free 里释放） */
+		if (!dev->hot_restart) {
+			xdma_chain_free(dev->scratch_chain);
+			dev->scratch_chain = NULL;
+		}
 	}
 
-	xdma_user_isr_disable(dev->xdev, dev->user_irq_mask);
-	video_cap_enable(dev, false);
-	video_cap_warmup_free(dev);
+	if (dev->hybrid_poll) {
+		xdma_engine_poll_wb(dev->xdev, dev->c2h_channel, false, false);
+		dev->hybrid_poll = false;
+	}
+
+	if (!dev->hot_restart)
+		xdma_user_isr_disable(dev->xdev, dev->user_irq_mask);
+	/* 看到 stopping 之前 ISR/回调可能又调度过一次：此时它们都已停下，最后收一次尾 */
+	hrtimer_cancel(&dev->poll_timer);
+	video_cap_work_cancel(dev);
+	if (!dev->hot_restart) {
+		video_cap_enable(dev, false);
+		video_cap_warmup_free(dev);
+		dev->hw_live = false;
+	}
 
 	video_cap_return_all_buffers(dev, VB2_BUF_STATE_ERROR);
 	dev->streaming = false;
+	video_cap_qos_release(dev);
 
 	if (!dev->multi->has_per_ch_regs) {
 		mutex_lock(&dev->multi->hw_lock);
@@ -484,6 +1901,8 @@ void video_cap_stop_streaming(struct vb2_queue *vq)
 
 const struct vb2_ops video_cap_vb2_ops = {
 	.queue_setup = video_cap_queue_setup,
+	.buf_init = video_cap_buf_init,
+	.buf_cleanup = video_cap_buf_cleanup,
 	.buf_prepare = video_cap_buf_prepare,
 	.buf_queue = video_cap_buf_queue,
 	.start_streaming = video_cap_start_streaming,
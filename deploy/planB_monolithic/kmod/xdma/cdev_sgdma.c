@@ -372,6 +372,393 @@ err_out:
 	return rv;
 }
 
+static void cdev_ki_complete(struct kiocb *iocb, ssize_t res)
+{
+#if defined(RHEL_RELEASE_CODE)
+    #if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(9, 4))
+	iocb->ki_complete(iocb, res);
+    #elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+	iocb->ki_complete(iocb, res);
+    #elif LINUX_VERSION_CODE >= KERNEL_VERSION(4, 1, 0)
+	iocb->ki_complete(iocb, res, 0);
+    #else
+	aio_complete(iocb, res, 0);
+    #endif
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+	iocb->ki_complete(iocb, res);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4, 1, 0)
+	iocb->ki_complete(iocb, res, 0);
+#else
+	aio_complete(iocb, res, 0);
+#endif
+}
+
+/*
+ * Registered buffers (IOCTL_XDMA_BUF_REGISTER)
+ *
+ * The pages are pinned, the sg table is built (physically contiguous pages
+ * merged) and mapped once at registration; a transfer into the buffer only
+ * syncs it and queues the prebuilt sg table with dma_mapped set.
+ */
+static void reg_buf_release(struct xdma_reg_buf *rb)
+{
+	struct pci_dev *pdev = rb->xcdev->xdev->pdev;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 6, 0)
+	int i;
+#endif
+
+	if (rb->sgt.nents) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 16, 0)
+		pci_unmap_sg(pdev, rb->sgt.sgl, rb->sgt.orig_nents, rb->dir);
+#else
+		dma_unmap_sg(&pdev->dev, rb->sgt.sgl, rb->sgt.orig_nents,
+			     rb->dir);
+#endif
+	}
+	sg_free_table(&rb->sgt);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+	unpin_user_pages_dirty_lock(rb->pages, rb->pages_nr,
+				    rb->dir == DMA_FROM_DEVICE);
+#else
+	for (i = 0; i < rb->pages_nr; i++) {
+		if (rb->dir == DMA_FROM_DEVICE)
+			set_page_dirty_lock(rb->pages[i]);
+		put_page(rb->pages[i]);
+	}
+#endif
+	kvfree(rb->pages);
+	kfree(rb);
+}
+
+static int ioctl_do_buf_register(struct xdma_cdev *xcdev, struct file *file,
+				 unsigned long arg)
+{
+	struct xdma_engine *engine = xcdev->engine;
+	struct xdma_buf_register_ioctl io;
+	struct xdma_reg_buf *rb;
+	unsigned int pages_nr;
+	int i, rv;
+
+	if (copy_from_user(&io, (void __user *)arg, sizeof(io)))
+		return -EFAULT;
+
+	if (!io.len || io.len > UINT_MAX)
+		return -EINVAL;
+
+	rv = check_transfer_align(engine, (char __user *)io.buffer, io.len, 0,
+				  0);
+	if (rv)
+		return rv;
+
+	pages_nr = ((io.buffer + io.len + PAGE_SIZE - 1) >> PAGE_SHIFT) -
+		   (io.buffer >> PAGE_SHIFT);
+
+	rb = kzalloc(sizeof(*rb), GFP_KERNEL);
+	if (!rb)
+		return -ENOMEM;
+	rb->xcdev = xcdev;
+	rb->owner = file;
+	rb->addr = io.buffer;
+	rb->len = io.len;
+	rb->dir = engine->dir;
+
+	rb->pages = kvcalloc(pages_nr, sizeof(struct page *), GFP_KERNEL);
+	if (!rb->pages) {
+		rv = -ENOMEM;
+		goto err_out;
+	}
+
+	/*
+	 * Long-term DMA target: FOLL_LONGTERM keeps the pages out of CMA and
+	 * movable zones, and a pin (unlike a plain reference) survives COW
+	 * after fork.
+	 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+	rv = pin_user_pages_fast(io.buffer, pages_nr,
+				 FOLL_WRITE | FOLL_LONGTERM, rb->pages);
+#else
+	rv = get_user_pages_fast(io.buffer, pages_nr, 1/* write */, rb->pages);
+#endif
+	if (rv < 0)
+		goto err_out;
+	rb->pages_nr = rv;
+	if (rv != pages_nr) {
+		pr_err("unable to pin down all %u user pages, %d.\n",
+			pages_nr, rv);
+		rv = -EFAULT;
+		goto err_out;
+	}
+
+	for (i = 0; i < pages_nr; i++)
+		flush_dcache_page(rb->pages[i]);
+
+	rv = sg_alloc_table_from_pages(&rb->sgt, rb->pages, pages_nr,
+				       offset_in_page(io.buffer), io.len,
+				       GFP_KERNEL);
+	if (rv)
+		goto err_out;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 16, 0)
+	rv = pci_map_sg(xcdev->xdev->pdev, rb->sgt.sgl, rb->sgt.orig_nents,
+			rb->dir);
+#else
+	rv = dma_map_sg(&xcdev->xdev->pdev->dev, rb->sgt.sgl,
+			rb->sgt.orig_nents, rb->dir);
+#endif
+	if (!rv) {
+		pr_err("map sgl failed, %u pages.\n", pages_nr);
+		rb->sgt.nents = 0;
+		rv = -EIO;
+		goto err_out;
+	}
+	rb->sgt.nents = rv;
+
+	rv = -ENOSPC;
+	spin_lock(&xcdev->lock);
+	for (i = 0; i < XDMA_REG_BUF_MAX; i++) {
+		if (!xcdev->reg_buf[i]) {
+			xcdev->reg_buf[i] = rb;
+			rv = 0;
+			break;
+		}
+	}
+	spin_unlock(&xcdev->lock);
+	if (rv)
+		goto err_out;
+
+	dbg_tfr("%s, reg buf %d, 0x%lx,%lu, %u pages, %u sg.\n", engine->name,
+		i, io.buffer, io.len, pages_nr, rb->sgt.nents);
+
+	io.index = i;
+	if (copy_to_user((void __user *)arg, &io, sizeof(io))) {
+		spin_lock(&xcdev->lock);
+		xcdev->reg_buf[i] = NULL;
+		spin_unlock(&xcdev->lock);
+		rv = -EFAULT;
+		goto err_out;
+	}
+	return 0;
+
+err_out:
+	reg_buf_release(rb);
+	return rv;
+}
+
+static int ioctl_do_buf_unregister(struct xdma_cdev *xcdev, struct file *file,
+				   unsigned long arg)
+{
+	struct xdma_reg_buf *rb = NULL;
+	int index = (int)arg;
+
+	if (index < 0 || index >= XDMA_REG_BUF_MAX)
+		return -EINVAL;
+
+	spin_lock(&xcdev->lock);
+	rb = xcdev->reg_buf[index];
+	if (!rb || rb->owner != file) {
+		spin_unlock(&xcdev->lock);
+		return -EINVAL;
+	}
+	if (atomic_read(&rb->busy)) {
+		spin_unlock(&xcdev->lock);
+		return -EBUSY;
+	}
+	xcdev->reg_buf[index] = NULL;
+	spin_unlock(&xcdev->lock);
+
+	reg_buf_release(rb);
+	return 0;
+}
+
+/* drop the registrations of a file being closed, nothing is in flight then */
+static void reg_buf_release_file(struct xdma_cdev *xcdev, struct file *file)
+{
+	struct xdma_reg_buf *rb;
+	int i;
+
+	for (i = 0; i < XDMA_REG_BUF_MAX; i++) {
+		spin_lock(&xcdev->lock);
+		rb = xcdev->reg_buf[i];
+		if (rb && rb->owner == file)
+			xcdev->reg_buf[i] = NULL;
+		else
+			rb = NULL;
+		spin_unlock(&xcdev->lock);
+
+		if (rb)
+			reg_buf_release(rb);
+	}
+}
+
+/*
+ * find the registered buffer covering exactly [buf, buf + count) and claim
+ * it: NULL if there is none (regular path), ERR_PTR(-EBUSY) if a transfer
+ * is already using it
+ */
+static struct xdma_reg_buf *reg_buf_get(struct xdma_cdev *xcdev,
+					struct file *file,
+					const char __user *buf, size_t count)
+{
+	struct xdma_reg_buf *rb = NULL;
+	int i;
+
+	spin_lock(&xcdev->lock);
+	for (i = 0; i < XDMA_REG_BUF_MAX; i++) {
+		struct xdma_reg_buf *r = xcdev->reg_buf[i];
+
+		if (r && r->owner == file && r->addr == (unsigned long)buf &&
+		    r->len == count) {
+			rb = atomic_cmpxchg(&r->busy, 0, 1) ? ERR_PTR(-EBUSY) : r;
+			break;
+		}
+	}
+	spin_unlock(&xcdev->lock);
+
+	return rb;
+}
+
+static void reg_buf_put(struct xdma_reg_buf *rb)
+{
+	atomic_set(&rb->busy, 0);
+}
+
+static ssize_t reg_buf_xfer_sync(struct xdma_reg_buf *rb, loff_t pos)
+{
+	struct xdma_cdev *xcdev = rb->xcdev;
+	struct device *dev = &xcdev->xdev->pdev->dev;
+	bool write = rb->dir == DMA_TO_DEVICE;
+	ssize_t res;
+
+	dma_sync_sg_for_device(dev, rb->sgt.sgl, rb->sgt.orig_nents, rb->dir);
+	res = xdma_xfer_submit(xcdev->xdev, xcdev->engine->channel, write, pos,
+			       &rb->sgt, 1, write ? h2c_timeout * 1000 :
+						    c2h_timeout * 1000);
+	if (!write)
+		dma_sync_sg_for_cpu(dev, rb->sgt.sgl, rb->sgt.orig_nents,
+				    rb->dir);
+	reg_buf_put(rb);
+
+	return res;
+}
+
+/* whoever takes rb->iocb completes it: the callback, or the failed submit */
+static void reg_buf_io_done(unsigned long cb_hndl, int err)
+{
+	struct xdma_io_cb *cb = (struct xdma_io_cb *)cb_hndl;
+	struct xdma_reg_buf *rb = cb->private;
+	struct xdma_cdev *xcdev = rb->xcdev;
+	struct kiocb *iocb;
+	ssize_t res = err;
+
+	/* -EBUSY: transfer_init failed inside submit, which frees the request */
+	if (!err)
+		res = xdma_xfer_completion(cb, xcdev->xdev,
+					   xcdev->engine->channel, cb->write,
+					   cb->ep_addr, &rb->sgt, 1, 0);
+	if (!cb->write)
+		dma_sync_sg_for_cpu(&xcdev->xdev->pdev->dev, rb->sgt.sgl,
+				    rb->sgt.orig_nents, rb->dir);
+
+	iocb = xchg(&rb->iocb, NULL);
+	if (!iocb)
+		return;
+
+	reg_buf_put(rb);
+	cdev_ki_complete(iocb, res);
+}
+
+/* single user segment of an iov_iter, NULL for anything else (bvec, kvec) */
+static const char __user *cdev_iter_ubuf(struct iov_iter *io)
+{
+	const struct iovec *iov;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+	if (iter_is_ubuf(io))
+		return (const char __user *)io->ubuf + io->iov_offset;
+#endif
+	if (!iter_is_iovec(io) || io->nr_segs != 1)
+		return NULL;
+
+#if defined(RHEL_RELEASE_CODE)
+    #if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(9, 4))
+	iov = iter_iov(io);
+    #else
+	iov = io->iov;
+    #endif
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	iov = iter_iov(io);
+#else
+	iov = io->iov;
+#endif
+	return (const char __user *)iov->iov_base + io->iov_offset;
+}
+
+/*
+ * read_iter/write_iter on a registered buffer: blocking for sync kiocbs
+ * (readv/writev), otherwise queued without waiting and completed from the
+ * engine callback. Returns -ENOENT when the iterator is not a registered
+ * buffer so the caller can take the regular path.
+ */
+static ssize_t cdev_reg_buf_iter(struct kiocb *iocb, struct iov_iter *io,
+				 bool write)
+{
+	struct xdma_cdev *xcdev = (struct xdma_cdev *)iocb->ki_filp->private_data;
+	struct xdma_engine *engine = xcdev->engine;
+	const char __user *ubuf = cdev_iter_ubuf(io);
+	size_t count = iov_iter_count(io);
+	struct xdma_reg_buf *rb;
+	ssize_t rv;
+
+	if (!ubuf)
+		return -ENOENT;
+
+	rb = reg_buf_get(xcdev, iocb->ki_filp, ubuf, count);
+	if (!rb)
+		return -ENOENT;
+	if (IS_ERR(rb))
+		return PTR_ERR(rb);
+
+	if ((write && engine->dir != DMA_TO_DEVICE) ||
+	    (!write && engine->dir != DMA_FROM_DEVICE)) {
+		reg_buf_put(rb);
+		return -EINVAL;
+	}
+
+	if (is_sync_kiocb(iocb)) {
+		rv = reg_buf_xfer_sync(rb, iocb->ki_pos);
+		if (rv > 0)
+			iov_iter_advance(io, rv);
+		return rv;
+	}
+
+	memset(&rb->cb, 0, sizeof(rb->cb));
+	rb->cb.buf = (void __user *)ubuf;
+	rb->cb.len = count;
+	rb->cb.ep_addr = (u64)iocb->ki_pos;
+	rb->cb.write = write;
+	rb->cb.private = rb;
+	rb->cb.io_done = reg_buf_io_done;
+	rb->iocb = iocb;
+
+	dma_sync_sg_for_device(&xcdev->xdev->pdev->dev, rb->sgt.sgl,
+			       rb->sgt.orig_nents, rb->dir);
+	rv = xdma_xfer_submit_nowait((void *)&rb->cb, xcdev->xdev,
+				     engine->channel, write, rb->cb.ep_addr,
+				     &rb->sgt, 1, write ? h2c_timeout * 1000 :
+							  c2h_timeout * 1000);
+	if (engine->cmplthp)
+		xdma_kthread_wakeup(engine->cmplthp);
+	if (rv == -EIOCBQUEUED)
+		return rv;
+
+	/* the callback may already have completed the iocb (-EBUSY) */
+	if (!xchg(&rb->iocb, NULL))
+		return -EIOCBQUEUED;
+	reg_buf_put(rb);
+	return rv;
+}
+
 static ssize_t char_sgdma_read_write(struct file *file, const char __user *buf,
 		size_t count, loff_t *pos, bool write)
 {
@@ -381,6 +768,7 @@ static ssize_t char_sgdma_read_write(struct file *file, const char __user *buf,
 	struct xdma_dev *xdev;
 	struct xdma_engine *engine;
 	struct xdma_io_cb cb;
+	struct xdma_reg_buf *rb;
 
 	rv = xcdev_check(__func__, xcdev, 1);
 	if (rv < 0)
@@ -405,6 +793,13 @@ static ssize_t char_sgdma_read_write(struct file *file, const char __user *buf,
 		return rv;
 	}
 
+	/* registered buffer: already pinned and mapped */
+	rb = reg_buf_get(xcdev, file, buf, count);
+	if (IS_ERR(rb))
+		return PTR_ERR(rb);
+	if (rb)
+		return reg_buf_xfer_sync(rb, *pos);
+
 	memset(&cb, 0, sizeof(struct xdma_io_cb));
 	cb.buf = (char __user *)buf;
 	cb.len = count;
@@ -585,6 +980,11 @@ static ssize_t cdev_aio_read(struct kiocb *iocb, const struct iovec *io,
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 16, 0)
 static ssize_t cdev_write_iter(struct kiocb *iocb, struct iov_iter *io)
 {
+	ssize_t rv = cdev_reg_buf_iter(iocb, io, true);
+
+	if (rv != -ENOENT)
+		return rv;
+
 #if defined(RHEL_RELEASE_CODE)
         #if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(9, 4))
             return cdev_aio_write(iocb, iter_iov(io), io->nr_segs, io->iov_offset);
@@ -600,6 +1000,11 @@ static ssize_t cdev_write_iter(struct kiocb *iocb, struct iov_iter *io)
 
 static ssize_t cdev_read_iter(struct kiocb *iocb, struct iov_iter *io)
 {
+	ssize_t rv = cdev_reg_buf_iter(iocb, io, false);
+
+	if (rv != -ENOENT)
+		return rv;
+
 #if defined(RHEL_RELEASE_CODE)
         #if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(9, 4))
             return cdev_aio_read(iocb, iter_iov(io), io->nr_segs, io->iov_offset);
@@ -881,6 +1286,12 @@ static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 	case IOCTL_XDMA_APERTURE_W:
 		rv = ioctl_do_aperture_dma(engine, arg, 1);
 		break;
+	case IOCTL_XDMA_BUF_REGISTER:
+		rv = ioctl_do_buf_register(xcdev, file, arg);
+		break;
+	case IOCTL_XDMA_BUF_UNREGISTER:
+		rv = ioctl_do_buf_unregister(xcdev, file, arg);
+		break;
 	default:
 		dbg_perf("Unsupported operation\n");
 		rv = -EINVAL;
@@ -923,6 +1334,8 @@ static int char_sgdma_close(struct inode *inode, struct file *file)
 
 	engine = xcdev->engine;
 
+	reg_buf_release_file(xcdev, file);
+
 	if (engine->streaming && engine->dir == DMA_FROM_DEVICE)
 		engine->device_open = 0;
 
@@ -67,6 +67,21 @@ struct xdma_aperture_ioctl {
 	unsigned long done;
 };
 
+/*
+ * registered buffers: IOCTL_XDMA_BUF_REGISTER pins a user buffer and maps it
+ * for DMA once. A read()/write(), readv()/writev(), aio or io_uring
+ * READ/WRITE whose user buffer is exactly [buffer, buffer + len) then skips
+ * the per-call page pinning, sg table allocation and mapping. Several
+ * registered buffers can be in flight at once through aio/io_uring, one
+ * transfer per buffer. Registrations belong to the file descriptor and are
+ * dropped when it is closed; at most XDMA_REG_BUF_MAX per device node.
+ */
+struct xdma_buf_register_ioctl {
+	unsigned long buffer;
+	unsigned long len;
+	int index;		/* out: handle for IOCTL_XDMA_BUF_UNREGISTER */
+};
+
 
 /* IOCTL codes */
 
@@ -78,5 +93,7 @@ struct xdma_aperture_ioctl {
 #define IOCTL_XDMA_ALIGN_GET    _IOR('q', 6, int)
 #define IOCTL_XDMA_APERTURE_R   _IOW('q', 7, struct xdma_aperture_ioctl *)
 #define IOCTL_XDMA_APERTURE_W   _IOW('q', 8, struct xdma_aperture_ioctl *)
+#define IOCTL_XDMA_BUF_REGISTER _IOWR('q', 9, struct xdma_buf_register_ioctl *)
+#define IOCTL_XDMA_BUF_UNREGISTER _IOW('q', 10, int)
 
 #endif /* _XDMA_IOCALLS_POSIX_H_ */
@@ -19,6 +19,8 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ":%s: " fmt, __func__
 
+#include <linux/delay.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/string.h>
@@ -32,6 +34,9 @@
 #include "cdev_sgdma.h"
 #include "xdma_thread.h"
 
+#define CREATE_TRACE_POINTS
+#include "xdma_trace.h"
+
 
 /* Module Parameters */
 static unsigned int poll_mode;
@@ -111,7 +116,8 @@ static inline int xdev_list_add(struct xdma_dev *xdev)
 		xdev->idx = 0;
 		if (poll_mode) {
 			int rv = xdma_threads_create(xdev->h2c_channel_max +
-					xdev->c2h_channel_max);
+					xdev->c2h_channel_max,
+					dev_to_node(&xdev->pdev->dev));
 			if (rv < 0) {
 				mutex_unlock(&xdev_mutex);
 				return rv;
@@ -562,6 +568,8 @@ static int xdma_engine_stop(struct xdma_engine *engine)
 	} else {
 		w |= (u32)XDMA_CTRL_IE_DESC_STOPPED;
 		w |= (u32)XDMA_CTRL_IE_DESC_COMPLETED;
+		if (engine->poll_wb)
+			w |= (u32)XDMA_CTRL_POLL_MODE_WB;
 	}
 
 	dbg_tfr("Stopping SG DMA %s engine; writing 0x%08x to 0x%p.\n",
@@ -612,6 +620,8 @@ static int engine_start_mode_config(struct xdma_engine *engine)
 	} else {
 		w |= (u32)XDMA_CTRL_IE_DESC_STOPPED;
 		w |= (u32)XDMA_CTRL_IE_DESC_COMPLETED;
+		if (engine->poll_wb)
+			w |= (u32)XDMA_CTRL_POLL_MODE_WB;
 	}
 
 	/* set non-incremental addressing mode */
@@ -724,6 +734,10 @@ static struct xdma_transfer *engine_start(struct xdma_engine *engine)
 
 	/* initialize number of descriptors of dequeued transfers */
 	engine->desc_dequeued = 0;
+	/* writeback count restarts with the run, drop the previous value */
+	if (engine->poll_wb)
+		((struct xdma_poll_wb *)engine->poll_mode_addr_virt)
+			->completed_desc_count = 0;
 
 	/* write lower 32-bit of bus address of transfer first descriptor */
 	w = cpu_to_le32(PCI_DMA_L(transfer->desc_bus));
@@ -770,6 +784,7 @@ static struct xdma_transfer *engine_start(struct xdma_engine *engine)
 		return NULL;
 	}
 	dbg_tfr("%s engine 0x%p now running\n", engine->name, engine);
+	trace_xdma_engine_start(engine, transfer->cb, transfer->desc_num, 0);
 	/* remember the engine is running */
 	engine->running = 1;
 	return transfer;
@@ -818,8 +833,10 @@ static struct xdma_transfer *engine_transfer_completion(
 	xlx_wake_up(&transfer->wq);
 
 	/* Send completion notification for Last transfer */
-	if (transfer->cb && transfer->last_in_request)
+	if (transfer->cb && transfer->last_in_request) {
+		trace_xdma_xfer_done(engine, transfer->cb, transfer->desc_num, 0);
 		transfer->cb->io_done((unsigned long)transfer->cb, 0);
+	}
 
 	return transfer;
 }
@@ -904,6 +921,8 @@ static int engine_err_handle(struct xdma_engine *engine,
 	printk_ratelimited(KERN_INFO "%s, s 0x%x, aborted xfer 0x%p, cmpl %d/%d\n",
 			engine->name, engine->status, transfer, desc_completed,
 			transfer->desc_num);
+	trace_xdma_engine_error(engine, transfer->cb, desc_completed,
+				engine->status);
 
 	/* mark transfer as failed */
 	transfer->state = TRANSFER_STATE_FAILED;
@@ -1087,6 +1106,16 @@ static int engine_service_resume(struct xdma_engine *engine)
 	return 0;
 }
 
+static int xdma_ring_service(struct xdma_ring *ring);
+
+/* direction specific error bits in the last status read */
+static bool xdma_engine_status_err(struct xdma_engine *engine)
+{
+	if (engine->dir == DMA_FROM_DEVICE)
+		return engine->status & XDMA_STAT_C2H_ERR_MASK;
+	return engine->status & XDMA_STAT_H2C_ERR_MASK;
+}
+
 /**
  * engine_service() - service an SG DMA engine
  *
@@ -1107,6 +1136,10 @@ static int engine_service(struct xdma_engine *engine, int desc_writeback)
 		return -EINVAL;
 	}
 
+	/* a cyclic ring owns the engine, no transfer list to walk */
+	if (engine->ring)
+		return xdma_ring_service(engine->ring);
+
 	/* Service the engine */
 	if (!engine->running) {
 		dbg_tfr("Engine was not running!!! Clearing status\n");
@@ -1155,6 +1188,7 @@ static int engine_service(struct xdma_engine *engine, int desc_writeback)
 	dbg_tfr("%s wb 0x%x, desc_count %u, err %u, dequeued %u.\n",
 		engine->name, desc_writeback, desc_count, err_flag,
 		engine->desc_dequeued);
+	trace_xdma_engine_service(engine, NULL, desc_count, engine->status);
 
 	if (!desc_count)
 		goto done;
@@ -1185,6 +1219,20 @@ static int engine_service(struct xdma_engine *engine, int desc_writeback)
 	/* Process all but the last transfer */
 	transfer = engine_service_transfer_list(engine, transfer, &desc_count);
 
+	/*
+	 * progress interrupt (xdma_chain_mark()): the engine is still busy
+	 * inside the head transfer, report how far it got and keep it queued
+	 */
+	if (transfer && !transfer->cyclic && !engine->eop_flush &&
+	    desc_count < transfer->desc_num &&
+	    (engine->status & XDMA_STAT_BUSY) &&
+	    !xdma_engine_status_err(engine)) {
+		if (transfer->cb && transfer->cb->io_progress)
+			transfer->cb->io_progress((unsigned long)transfer->cb,
+						  desc_count);
+		goto done;
+	}
+
 	/*
 	 * Process final transfer - includes checks of number of descriptors to
 	 * detect faulty completion
@@ -1431,6 +1479,7 @@ static irqreturn_t xdma_isr(int irq, void *dev_id)
 			if ((engine->irq_bitmask & mask) &&
 			    (engine->magic == MAGIC_ENGINE)) {
 				mask &= ~engine->irq_bitmask;
+				WRITE_ONCE(engine->irq_ns, ktime_get_ns());
 				dbg_tfr("schedule_work, %s.\n", engine->name);
 				schedule_work(&engine->work);
 			}
@@ -1450,6 +1499,7 @@ static irqreturn_t xdma_isr(int irq, void *dev_id)
 			if ((engine->irq_bitmask & mask) &&
 			    (engine->magic == MAGIC_ENGINE)) {
 				mask &= ~engine->irq_bitmask;
+				WRITE_ONCE(engine->irq_ns, ktime_get_ns());
 				dbg_tfr("schedule_work, %s.\n", engine->name);
 				schedule_work(&engine->work);
 			}
@@ -1517,6 +1567,7 @@ static irqreturn_t xdma_channel_irq(int irq, void *dev_id)
 			(unsigned long)(&engine->regs));
 	/* Dummy read to flush the above write */
 	read_register(&irq_regs->channel_int_pending);
+	WRITE_ONCE(engine->irq_ns, ktime_get_ns());
 	/* Schedule the bottom half */
 	schedule_work(&engine->work);
 
@@ -2495,6 +2546,12 @@ static int transfer_queue(struct xdma_engine *engine,
 		goto shutdown;
 	}
 
+	/* engine is running a cyclic ring */
+	if (engine->ring) {
+		rv = -EBUSY;
+		goto shutdown;
+	}
+
 	/* mark the transfer as submitted */
 	transfer->state = TRANSFER_STATE_SUBMITTED;
 	/* add transfer to the tail of the engine transfer queue */
@@ -2573,7 +2630,7 @@ static void engine_free_resource(struct xdma_engine *engine)
 			 dev_name(&xdev->pdev->dev), engine->name, engine->desc,
 			 engine->desc_bus);
 		dma_free_coherent(&xdev->pdev->dev,
-				  engine->desc_max * sizeof(struct xdma_desc),
+				  engine->desc_ring_max * sizeof(struct xdma_desc),
 				  engine->desc, engine->desc_bus);
 		engine->desc = NULL;
 	}
@@ -2581,7 +2638,7 @@ static void engine_free_resource(struct xdma_engine *engine)
 	if (engine->cyclic_result) {
 		dma_free_coherent(
 			&xdev->pdev->dev,
-			engine->desc_max * sizeof(struct xdma_result),
+			engine->desc_ring_max * sizeof(struct xdma_result),
 			engine->cyclic_result, engine->cyclic_result_bus);
 		engine->cyclic_result = NULL;
 	}
@@ -2791,7 +2848,7 @@ static int engine_alloc_resource(struct xdma_engine *engine)
 	struct xdma_dev *xdev = engine->xdev;
 
 	engine->desc = dma_alloc_coherent(&xdev->pdev->dev,
-					  engine->desc_max *
+					  engine->desc_ring_max *
 						  sizeof(struct xdma_desc),
 					  &engine->desc_bus, GFP_KERNEL);
 	if (!engine->desc) {
@@ -2815,7 +2872,7 @@ static int engine_alloc_resource(struct xdma_engine *engine)
 	if (engine->streaming && engine->dir == DMA_FROM_DEVICE) {
 		engine->cyclic_result = dma_alloc_coherent(
 			&xdev->pdev->dev,
-			engine->desc_max * sizeof(struct xdma_result),
+			engine->desc_ring_max * sizeof(struct xdma_result),
 			&engine->cyclic_result_bus, GFP_KERNEL);
 
 		if (!engine->cyclic_result) {
@@ -2872,6 +2929,17 @@ static int engine_init(struct xdma_engine *engine, struct xdma_dev *xdev,
 	else
 	    	engine->desc_max = XDMA_ENGINE_XFER_MAX_DESC;
 
+	/*
+	 * credit mode hands desc_used to the engine as credits, keep the ring
+	 * at one transfer there; otherwise let AXI-ST C2H queue several
+	 * requests without wrapping onto descriptors still owned by the engine
+	 */
+	if (!enable_st_c2h_credit && engine->streaming &&
+	    engine->dir == DMA_FROM_DEVICE)
+		engine->desc_ring_max = XDMA_ENGINE_ST_C2H_RING_DESC;
+	else
+		engine->desc_ring_max = engine->desc_max;
+
 	dbg_init("engine %p name %s irq_bitmask=0x%08x\n", engine, engine->name,
 		 (int)engine->irq_bitmask);
 
@@ -2991,10 +3059,10 @@ static int transfer_init(struct xdma_engine *engine,
 			(sizeof(struct xdma_result) * engine->desc_idx);
 	xfer->desc_index = engine->desc_idx;
 
-	/* Need to handle desc_used >= engine->desc_max */
+	/* Need to handle desc_used >= engine->desc_ring_max */
 
-	if ((engine->desc_idx + desc_max) >= engine->desc_max)
-		desc_max = engine->desc_max - engine->desc_idx;
+	if ((engine->desc_idx + desc_max) >= engine->desc_ring_max)
+		desc_max = engine->desc_ring_max - engine->desc_idx;
 
 	transfer_desc_init(xfer, desc_max);
 
@@ -3021,7 +3089,7 @@ static int transfer_init(struct xdma_engine *engine,
 		xfer->desc_cmpl_th = desc_max;
 
 	xfer->desc_num = desc_max;
-	engine->desc_idx = (engine->desc_idx + desc_max) % engine->desc_max;
+	engine->desc_idx = (engine->desc_idx + desc_max) % engine->desc_ring_max;
 	engine->desc_used += desc_max;
 
 	/* fill in adjacent numbers */
@@ -3094,25 +3162,57 @@ static struct xdma_request_cb *xdma_request_alloc(unsigned int sdesc_nr)
 	return req;
 }
 
+/*
+ * Length of the run of DMA-contiguous entries starting at *@sgp (at most
+ * *@left entries); *@sgp and *@left are advanced past the run. Behind an
+ * IOMMU a page-scattered buffer usually maps to one IOVA range, but it is
+ * only handed back as one entry up to the device's max segment size, and
+ * imported sg tables are often not merged at all.
+ */
+static u64 xdma_sg_run(struct scatterlist **sgp, int *left)
+{
+	struct scatterlist *sg = *sgp;
+	dma_addr_t end;
+	u64 len = 0;
+
+	do {
+		len += sg_dma_len(sg);
+		end = sg_dma_address(sg) + sg_dma_len(sg);
+		sg = --(*left) ? sg_next(sg) : NULL;
+	} while (sg && sg_dma_address(sg) == end);
+
+	*sgp = sg;
+	return len;
+}
+
+/* number of descriptors xdma_init_request() builds for @sgt */
+unsigned int xdma_sg_desc_count(struct sg_table *sgt)
+{
+	struct scatterlist *sg = sgt->sgl;
+	int left = sgt->nents;
+	unsigned int cnt = 0;
+
+	while (sg && left)
+		cnt += DIV_ROUND_UP_ULL(xdma_sg_run(&sg, &left),
+					desc_blen_max);
+	return cnt;
+}
+EXPORT_SYMBOL_GPL(xdma_sg_desc_count);
+
 static struct xdma_request_cb *xdma_init_request(struct sg_table *sgt,
 						 u64 ep_addr)
 {
 	struct xdma_request_cb *req;
-	struct scatterlist *sg = sgt->sgl;
-	int max = sgt->nents;
-	int extra = 0;
-	int i, j = 0;
-
-	for (i = 0; i < max; i++, sg = sg_next(sg)) {
-		unsigned int len = sg_dma_len(sg);
+	struct scatterlist *sg;
+	int left;
+	unsigned int max;
+	int j = 0;
 
-		if (unlikely(len > desc_blen_max))
-			extra += (len + desc_blen_max - 1) / desc_blen_max;
-	}
+	/* DMA-contiguous entries share descriptors, up to desc_blen_max each */
+	max = xdma_sg_desc_count(sgt);
 
-	dbg_tfr("ep 0x%llx, desc %u+%u.\n", ep_addr, max, extra);
+	dbg_tfr("ep 0x%llx, sg %u, desc %u.\n", ep_addr, sgt->nents, max);
 
-	max += extra;
 	req = xdma_request_alloc(max);
 	if (!req)
 		return NULL;
@@ -3120,9 +3220,9 @@ static struct xdma_request_cb *xdma_init_request(struct sg_table *sgt,
 	req->sgt = sgt;
 	req->ep_addr = ep_addr;
 
-	for (i = 0, sg = sgt->sgl; i < sgt->nents; i++, sg = sg_next(sg)) {
-		unsigned int tlen = sg_dma_len(sg);
+	for (sg = sgt->sgl, left = sgt->nents; sg && left;) {
 		dma_addr_t addr = sg_dma_address(sg);
+		u64 tlen = xdma_sg_run(&sg, &left);
 
 		req->total_len += tlen;
 		while (tlen) {
@@ -3255,7 +3355,7 @@ ssize_t xdma_xfer_aperture(struct xdma_engine *engine, bool write, u64 ep_addr,
 		spin_lock_irqsave(&engine->lock, flags);
 
 		desc_idx = engine->desc_idx;
-		desc_max = engine->desc_max;
+		desc_max = engine->desc_ring_max;
 
 		xfer->desc_virt = desc_virt = engine->desc + desc_idx;
 		xfer->res_virt = engine->cyclic_result + desc_idx;
@@ -3545,6 +3645,7 @@ ssize_t xdma_xfer_submit(void *dev_hndl, int channel, bool write, u64 ep_addr,
 
 	dbg_tfr("%s, len %u sg cnt %u.\n", engine->name, req->total_len,
 		req->sw_desc_cnt);
+	trace_xdma_xfer_submit(engine, NULL, req->sw_desc_cnt, req->total_len);
 
 	sg = sgt->sgl;
 	nents = req->sw_desc_cnt;
@@ -3777,6 +3878,10 @@ ssize_t xdma_xfer_completion(void *cb_hndl, void *dev_hndl, int channel,
 #endif
 			rv = -EIO;
 			break;
+		case TRANSFER_STATE_ABORTED:
+			/* cancelled by xdma_engine_abort(), engine already stopped */
+			rv = -ECANCELED;
+			break;
 		default:
 			/* transfer can still be in-flight */
 			pr_info("xfer 0x%p,%u, s 0x%x timed out, ep 0x%llx.\n",
@@ -3908,11 +4013,31 @@ ssize_t xdma_xfer_submit_nowait(void *cb_hndl, void *dev_hndl, int channel,
 		goto unmap_sgl;
 	}
 
+	/*
+	 * a request may be split in at most two transfers (req->tfer[]) and
+	 * must not wrap onto descriptors of requests still queued on the engine
+	 */
+	if (req->sw_desc_cnt > engine->desc_max) {
+		pr_info("%s, %u desc > %u per request.\n", engine->name,
+			req->sw_desc_cnt, engine->desc_max);
+		rv = -E2BIG;
+		goto unmap_sgl;
+	}
+	if (READ_ONCE(engine->desc_used) + req->sw_desc_cnt >
+	    engine->desc_ring_max) {
+		dbg_tfr("%s, %u desc, ring used %d/%u, busy.\n", engine->name,
+			req->sw_desc_cnt, engine->desc_used,
+			engine->desc_ring_max);
+		rv = -EBUSY;
+		goto unmap_sgl;
+	}
+
 	//used when doing completion.
 	req->cb = cb;
 	cb->req = req;
 	dbg_tfr("%s, len %u sg cnt %u.\n",
 		engine->name, req->total_len, req->sw_desc_cnt);
+	trace_xdma_xfer_submit(engine, cb, req->sw_desc_cnt, req->total_len);
 
 	sg = sgt->sgl;
 	nents = req->sw_desc_cnt;
@@ -3996,6 +4121,1059 @@ rel_req:
 	return rv;
 }
 
+static struct xdma_engine *xdma_engine_lookup(struct xdma_dev *xdev,
+					      int channel, bool write)
+{
+	struct xdma_engine *engine;
+
+	if (!xdev)
+		return NULL;
+
+	if (write) {
+		if (channel < 0 || channel >= xdev->h2c_channel_max)
+			return NULL;
+		engine = &xdev->engine_h2c[channel];
+	} else {
+		if (channel < 0 || channel >= xdev->c2h_channel_max)
+			return NULL;
+		engine = &xdev->engine_c2h[channel];
+	}
+
+	if (engine->magic != MAGIC_ENGINE) {
+		pr_err("%s has invalid magic number %lx\n", engine->name,
+		       engine->magic);
+		return NULL;
+	}
+	return engine;
+}
+
+/* wait (up to ~1ms) for a stopped engine to finish its descriptor in flight */
+static void xdma_engine_wait_idle(struct xdma_engine *engine)
+{
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		if (!(read_register(&engine->regs->status) & XDMA_STAT_BUSY))
+			break;
+		udelay(10);
+	}
+}
+
+/**
+ * xdma_engine_abort() - stop an engine and cancel every queued transfer
+ *
+ * Transfers still on the engine queue are marked ABORTED; asynchronous
+ * requests get io_done(-ECANCELED) for their last transfer and are expected
+ * to release the request through xdma_xfer_completion(), as on normal
+ * completion. Synchronous waiters are woken up.
+ */
+int xdma_engine_abort(void *dev_hndl, int channel, bool write)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+	struct xdma_transfer *xfer;
+	unsigned long flags;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine)
+		return -EINVAL;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (engine->running) {
+		xdma_engine_stop(engine);
+		/* let the descriptor in flight drain before handing buffers back */
+		xdma_engine_wait_idle(engine);
+	}
+	engine_status_read(engine, 1, 0);
+
+	while (!list_empty(&engine->transfer_list)) {
+		xfer = list_first_entry(&engine->transfer_list,
+					struct xdma_transfer, entry);
+		list_del(&xfer->entry);
+		xfer->state = TRANSFER_STATE_ABORTED;
+		xlx_wake_up(&xfer->wq);
+
+		if (xfer->cb && xfer->last_in_request && xfer->cb->io_done) {
+			trace_xdma_xfer_done(engine, xfer->cb, xfer->desc_num,
+					     -ECANCELED);
+			xfer->cb->io_done((unsigned long)xfer->cb, -ECANCELED);
+		}
+	}
+	engine->desc_dequeued = 0;
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xdma_engine_abort);
+
+/* number of descriptors needed to cover @len bytes of @sgt */
+static unsigned int xdma_chain_count_desc(struct sg_table *sgt,
+					  unsigned int len)
+{
+	struct scatterlist *sg;
+	unsigned int cnt = 0;
+	int i;
+
+	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
+		unsigned int tlen = min_t(unsigned int, sg_dma_len(sg), len);
+
+		if (!tlen)
+			break;
+		cnt += (tlen + desc_blen_max - 1) / desc_blen_max;
+		len -= tlen;
+	}
+	return len ? 0 : cnt;
+}
+
+/**
+ * xdma_chain_build() - build a reusable descriptor chain for a mapped sgt
+ *
+ * Only the first @len bytes of @sgt are covered, so callers do not need to
+ * trim the sg_table before every transfer. The sg_table must stay mapped
+ * for as long as the chain exists.
+ *
+ * Unlike xdma_init_request(), adjacent sg entries are not merged: every
+ * entry boundary stays a descriptor boundary, so a caller can split a
+ * contiguous buffer where it wants xdma_chain_mark() interrupts.
+ *
+ * @return chain or ERR_PTR() on failure
+ */
+struct xdma_chain *xdma_chain_build(void *dev_hndl, int channel, bool write,
+				    u64 ep_addr, struct sg_table *sgt,
+				    unsigned int len)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+	struct xdma_chain *chain;
+	struct xdma_transfer *xfer;
+	struct scatterlist *sg;
+	unsigned int cnt, j = 0, remaining = len;
+	dma_addr_t res_bus;
+	u32 control;
+	int i;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine || !sgt || !sgt->nents || !len)
+		return ERR_PTR(-EINVAL);
+
+	/* credit mode feeds engine->desc_used to the engine on start */
+	if (enable_st_c2h_credit && engine->streaming &&
+	    engine->dir == DMA_FROM_DEVICE)
+		return ERR_PTR(-EOPNOTSUPP);
+
+	cnt = xdma_chain_count_desc(sgt, len);
+	if (!cnt)
+		return ERR_PTR(-EINVAL);
+
+	chain = kzalloc_node(sizeof(*chain), GFP_KERNEL,
+			     dev_to_node(&xdev->pdev->dev));
+	if (!chain)
+		return ERR_PTR(-ENOMEM);
+
+	chain->engine = engine;
+	chain->desc_cnt = cnt;
+	chain->len = len;
+	xfer = &chain->xfer;
+
+	xfer->desc_virt = dma_alloc_coherent(&xdev->pdev->dev,
+					     cnt * sizeof(struct xdma_desc),
+					     &xfer->desc_bus, GFP_KERNEL);
+	if (!xfer->desc_virt)
+		goto err_free;
+
+	if (engine->streaming && engine->dir == DMA_FROM_DEVICE) {
+		xfer->res_virt = dma_alloc_coherent(&xdev->pdev->dev,
+					cnt * sizeof(struct xdma_result),
+					&xfer->res_bus, GFP_KERNEL);
+		if (!xfer->res_virt)
+			goto err_free;
+	}
+
+#if HAS_SWAKE_UP
+	init_swait_queue_head(&xfer->wq);
+#else
+	init_waitqueue_head(&xfer->wq);
+#endif
+	xfer->dir = engine->dir;
+	transfer_desc_init(xfer, cnt);
+
+	res_bus = xfer->res_bus;
+	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
+		unsigned int tlen = min_t(unsigned int, sg_dma_len(sg),
+					  remaining);
+		dma_addr_t addr = sg_dma_address(sg);
+
+		remaining -= tlen;
+		while (tlen) {
+			unsigned int dlen = min_t(unsigned int, tlen,
+						  desc_blen_max);
+
+			xdma_desc_set(xfer->desc_virt + j, addr, ep_addr, dlen,
+				      xfer->dir);
+			if (!engine->non_incr_addr)
+				ep_addr += dlen;
+			if (xfer->res_virt) {
+				xfer->desc_virt[j].src_addr_lo =
+					cpu_to_le32(PCI_DMA_L(res_bus));
+				xfer->desc_virt[j].src_addr_hi =
+					cpu_to_le32(PCI_DMA_H(res_bus));
+				res_bus += sizeof(struct xdma_result);
+			}
+			xfer->len += dlen;
+			addr += dlen;
+			tlen -= dlen;
+			j++;
+		}
+		if (!remaining)
+			break;
+	}
+
+	/* stop engine, EOP for AXI ST, req IRQ on last descriptor */
+	control = XDMA_DESC_STOPPED | XDMA_DESC_EOP | XDMA_DESC_COMPLETED;
+	xdma_desc_control_set(xfer->desc_virt + cnt - 1, control);
+	if (engine->eop_flush) {
+		for (j = 0; j < cnt - 1; j++)
+			xdma_desc_control_set(xfer->desc_virt + j,
+					      XDMA_DESC_COMPLETED);
+		xfer->desc_cmpl_th = 1;
+	} else
+		xfer->desc_cmpl_th = cnt;
+
+	for (j = 0; j < cnt; j++)
+		xdma_desc_adjacent(xfer->desc_virt + j,
+			xdma_get_next_adj(cnt - j - 1,
+					  (xfer->desc_virt + j)->next_lo));
+
+	xfer->desc_num = cnt;
+	xfer->desc_adjacent = cnt;
+	xfer->last_in_request = 1;
+	xfer->state = TRANSFER_STATE_NEW;
+	return chain;
+
+err_free:
+	xdma_chain_free(chain);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL_GPL(xdma_chain_build);
+
+/**
+ * xdma_chain_mark() - raise a progress interrupt part way through a chain
+ *
+ * The descriptor that completes byte @offset - 1 requests an interrupt, the
+ * engine keeps running. io_progress() / frame_progress() then report the
+ * number of completed descriptors, compare it against the return value.
+ *
+ * @return # of descriptors done once @offset bytes have landed, < 0 on error
+ */
+int xdma_chain_mark(struct xdma_chain *chain, unsigned int offset)
+{
+	struct xdma_transfer *xfer;
+	unsigned int j, done = 0;
+
+	if (IS_ERR_OR_NULL(chain) || !offset || offset > chain->len)
+		return -EINVAL;
+
+	/* poll mode treats every writeback as the end of the transfer */
+	if (poll_mode)
+		return -EOPNOTSUPP;
+
+	xfer = &chain->xfer;
+	if (WARN_ON(xfer->state == TRANSFER_STATE_SUBMITTED))
+		return -EBUSY;
+
+	for (j = 0; j < chain->desc_cnt; j++) {
+		done += le32_to_cpu(xfer->desc_virt[j].bytes);
+		if (done >= offset)
+			break;
+	}
+	/* the last descriptor interrupts anyway */
+	if (j + 1 < chain->desc_cnt)
+		xdma_desc_control_set(xfer->desc_virt + j,
+				      XDMA_DESC_COMPLETED);
+	return j + 1;
+}
+EXPORT_SYMBOL_GPL(xdma_chain_mark);
+
+/* xdma_chain_desc_count() - descriptors per run, 0 for an invalid chain */
+unsigned int xdma_chain_desc_count(struct xdma_chain *chain)
+{
+	return IS_ERR_OR_NULL(chain) ? 0 : chain->desc_cnt;
+}
+EXPORT_SYMBOL_GPL(xdma_chain_desc_count);
+
+/* xdma_chain_free() - release a chain; it must not be queued on the engine */
+void xdma_chain_free(struct xdma_chain *chain)
+{
+	struct xdma_transfer *xfer;
+	struct device *dev;
+
+	if (IS_ERR_OR_NULL(chain))
+		return;
+
+	xfer = &chain->xfer;
+	dev = &chain->engine->xdev->pdev->dev;
+	WARN_ON(xfer->state == TRANSFER_STATE_SUBMITTED);
+
+	if (xfer->res_virt)
+		dma_free_coherent(dev,
+				  chain->desc_cnt * sizeof(struct xdma_result),
+				  xfer->res_virt, xfer->res_bus);
+	if (xfer->desc_virt)
+		dma_free_coherent(dev,
+				  chain->desc_cnt * sizeof(struct xdma_desc),
+				  xfer->desc_virt, xfer->desc_bus);
+	kfree(chain);
+}
+EXPORT_SYMBOL_GPL(xdma_chain_free);
+
+/* queue the prebuilt transfer again; only per-run state is reset */
+static int xdma_chain_queue(struct xdma_chain *chain, struct xdma_io_cb *cb)
+{
+	struct xdma_transfer *xfer = &chain->xfer;
+
+	if (xfer->state == TRANSFER_STATE_SUBMITTED)
+		return -EBUSY;
+
+	xfer->state = TRANSFER_STATE_NEW;
+	xfer->flags = 0;
+	xfer->desc_cmpl = 0;
+	xfer->cb = cb;
+	if (cb)
+		cb->req = NULL;
+
+	trace_xdma_xfer_submit(chain->engine, cb, chain->desc_cnt, chain->len);
+	return transfer_queue(chain->engine, xfer);
+}
+
+/* bytes moved by the last run of a chain, or error */
+static ssize_t xdma_chain_result(struct xdma_chain *chain)
+{
+	struct xdma_engine *engine = chain->engine;
+	struct xdma_transfer *xfer = &chain->xfer;
+	ssize_t done = 0;
+	int i, cmpl;
+
+	switch (xfer->state) {
+	case TRANSFER_STATE_COMPLETED:
+		if (!xfer->res_virt)
+			return xfer->len;
+		/* For C2H streaming use writeback results */
+		cmpl = xfer->desc_cmpl ? xfer->desc_cmpl : xfer->desc_num;
+		for (i = 0; i < cmpl; i++)
+			done += xfer->res_virt[i].length;
+		return done;
+	case TRANSFER_STATE_FAILED:
+		pr_info("%s chain 0x%p failed.\n", engine->name, chain);
+		return -EIO;
+	case TRANSFER_STATE_ABORTED:
+		return -ECANCELED;
+	default:
+		return -EBUSY;
+	}
+}
+
+/**
+ * xdma_chain_submit() - run a prebuilt chain and wait for it (blocking)
+ *
+ * @return # of bytes transferred or < 0 in case of error
+ */
+ssize_t xdma_chain_submit(struct xdma_chain *chain, int timeout_ms)
+{
+	struct xdma_engine *engine;
+	struct xdma_transfer *xfer;
+	unsigned long flags;
+	ssize_t rv;
+
+	if (IS_ERR_OR_NULL(chain))
+		return -EINVAL;
+
+	engine = chain->engine;
+	xfer = &chain->xfer;
+
+	rv = xdma_chain_queue(chain, NULL);
+	if (rv < 0)
+		return rv;
+
+	if (timeout_ms > 0)
+		xlx_wait_event_interruptible_timeout(xfer->wq,
+			(xfer->state != TRANSFER_STATE_SUBMITTED),
+			msecs_to_jiffies(timeout_ms));
+	else
+		xlx_wait_event_interruptible(xfer->wq,
+			(xfer->state != TRANSFER_STATE_SUBMITTED));
+
+	spin_lock_irqsave(&engine->lock, flags);
+	if (xfer->state == TRANSFER_STATE_SUBMITTED) {
+		/* transfer can still be in-flight */
+		pr_info("%s chain 0x%p timed out.\n", engine->name, chain);
+		engine_status_read(engine, 0, 1);
+		transfer_abort(engine, xfer);
+		xdma_engine_stop(engine);
+		spin_unlock_irqrestore(&engine->lock, flags);
+		return -ERESTARTSYS;
+	}
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	return xdma_chain_result(chain);
+}
+EXPORT_SYMBOL_GPL(xdma_chain_submit);
+
+/**
+ * xdma_chain_submit_nowait() - queue a prebuilt chain
+ *
+ * cb->io_done() is called from the engine service path once the chain
+ * completes or is cancelled; call xdma_chain_completion() from there.
+ *
+ * @return -EIOCBQUEUED when queued, < 0 in case of error
+ */
+ssize_t xdma_chain_submit_nowait(void *cb_hndl, struct xdma_chain *chain)
+{
+	struct xdma_io_cb *cb = (struct xdma_io_cb *)cb_hndl;
+	int rv;
+
+	if (IS_ERR_OR_NULL(chain) || !cb || !cb->io_done)
+		return -EINVAL;
+
+	rv = xdma_chain_queue(chain, cb);
+	if (rv < 0) {
+		chain->xfer.cb = NULL;
+		return rv;
+	}
+	return -EIOCBQUEUED;
+}
+EXPORT_SYMBOL_GPL(xdma_chain_submit_nowait);
+
+/**
+ * xdma_chain_completion() - collect the result of a nowait chain submit
+ *
+ * Unlike xdma_xfer_completion() nothing is freed, the chain stays ready
+ * for the next submit.
+ *
+ * @return # of bytes transferred or < 0 in case of error
+ */
+ssize_t xdma_chain_completion(struct xdma_chain *chain)
+{
+	if (IS_ERR_OR_NULL(chain))
+		return -EINVAL;
+
+	chain->xfer.cb = NULL;
+	return xdma_chain_result(chain);
+}
+EXPORT_SYMBOL_GPL(xdma_chain_completion);
+
+/* copy @chain into ring slot @idx, interrupt on its last descriptor */
+static void xdma_ring_slot_fill(struct xdma_ring *ring, unsigned int idx,
+				struct xdma_chain *chain, void *cookie)
+{
+	struct xdma_ring_slot *slot = &ring->slot[idx];
+	struct xdma_ring_slot *next = &ring->slot[(idx + 1) % ring->slots];
+	unsigned int n = chain->desc_cnt;
+	unsigned int j;
+
+	for (j = 0; j < n; j++) {
+		struct xdma_desc *d = slot->desc_virt + j;
+		struct xdma_desc *s = chain->xfer.desc_virt + j;
+		dma_addr_t next_bus;
+
+		/* last descriptor links to the next slot, the engine never stops */
+		if (j + 1 < n)
+			next_bus = slot->desc_bus +
+				   (j + 1) * sizeof(struct xdma_desc);
+		else
+			next_bus = next->desc_bus;
+
+		d->bytes = s->bytes;
+		d->dst_addr_lo = s->dst_addr_lo;
+		d->dst_addr_hi = s->dst_addr_hi;
+		d->next_lo = cpu_to_le32(PCI_DMA_L(next_bus));
+		d->next_hi = cpu_to_le32(PCI_DMA_H(next_bus));
+		/* keep progress interrupts set by xdma_chain_mark() */
+		d->control = cpu_to_le32(DESC_MAGIC |
+			(j + 1 == n ? XDMA_DESC_COMPLETED :
+			 le32_to_cpu(s->control) & XDMA_DESC_COMPLETED));
+		xdma_desc_adjacent(d, xdma_get_next_adj(n - j - 1, d->next_lo));
+	}
+	memset(slot->res_virt, 0, n * sizeof(struct xdma_result));
+	slot->desc_num = n;
+	slot->cookie = cookie;
+	trace_xdma_xfer_submit(ring->engine, cookie, n, chain->len);
+	/* slot must be complete in memory before the engine can fetch it */
+	wmb();
+}
+
+/*
+ * put the next caller buffer into slot @idx; buffers whose chain does not
+ * fit are handed back right away. With @scratch the slot gets the scratch
+ * chain when no buffer is available.
+ *
+ * @return true if a caller buffer was placed
+ */
+static bool xdma_ring_refill(struct xdma_ring *ring, unsigned int idx,
+			     bool scratch)
+{
+	struct xdma_chain *chain;
+	void *cookie;
+
+	for (;;) {
+		chain = NULL;
+		cookie = ring->ops->refill(ring->priv, &chain);
+		if (!cookie)
+			break;
+		if (chain && chain->engine == ring->engine &&
+		    chain->desc_cnt <= ring->slot_desc_max) {
+			xdma_ring_slot_fill(ring, idx, chain, cookie);
+			return true;
+		}
+		ring->ops->frame_done(ring->priv, cookie, 0, -EINVAL);
+	}
+
+	if (scratch)
+		xdma_ring_slot_fill(ring, idx, ring->scratch, NULL);
+	return false;
+}
+
+/*
+ * slot @idx finished: sum the writeback lengths and hand it back. EOP must
+ * be set on the last descriptor of the slot and nowhere else, otherwise
+ * the frame did not match the slot size and the ring is out of step.
+ *
+ * @return true if the engine must be realigned on a slot boundary
+ */
+static bool xdma_ring_slot_done(struct xdma_ring *ring, unsigned int idx,
+				int err)
+{
+	struct xdma_ring_slot *slot = &ring->slot[idx];
+	bool realign = false;
+	ssize_t bytes = 0;
+	void *cookie;
+	unsigned int j;
+
+	for (j = 0; j < slot->desc_num; j++) {
+		bool eop = slot->res_virt[j].status & RX_STATUS_EOP;
+
+		bytes += slot->res_virt[j].length;
+		if (eop != (j + 1 == slot->desc_num))
+			realign = true;
+	}
+	if (realign && !err)
+		err = -EIO;
+
+	cookie = slot->cookie;
+	slot->cookie = NULL;
+	trace_xdma_xfer_done(ring->engine, cookie, slot->desc_num, err);
+	ring->ops->frame_done(ring->priv, cookie, bytes, err);
+	return realign;
+}
+
+/* (re)start the engine on the first descriptor of slot @idx */
+static void xdma_ring_hw_start(struct xdma_ring *ring, unsigned int idx)
+{
+	struct xdma_engine *engine = ring->engine;
+	struct xdma_ring_slot *slot = &ring->slot[idx];
+	u32 w;
+
+	ring->head = idx;
+	ring->head_done = 0;
+	/* completed_desc_count restarts from 0 with the run bit */
+	ring->desc_seen = 0;
+	engine->desc_dequeued = 0;
+	engine->shutdown = ENGINE_SHUTDOWN_NONE;
+	if (engine->poll_wb)
+		((struct xdma_poll_wb *)engine->poll_mode_addr_virt)
+			->completed_desc_count = 0;
+
+	w = cpu_to_le32(PCI_DMA_L(slot->desc_bus));
+	write_register(w, &engine->sgdma_regs->first_desc_lo,
+		       (unsigned long)(&engine->sgdma_regs->first_desc_lo) -
+			       (unsigned long)(&engine->sgdma_regs));
+	w = cpu_to_le32(PCI_DMA_H(slot->desc_bus));
+	write_register(w, &engine->sgdma_regs->first_desc_hi,
+		       (unsigned long)(&engine->sgdma_regs->first_desc_hi) -
+			       (unsigned long)(&engine->sgdma_regs));
+	w = xdma_get_next_adj(slot->desc_num,
+			      cpu_to_le32(PCI_DMA_L(slot->desc_bus)));
+	write_register(w, &engine->sgdma_regs->first_desc_adjacent,
+		       (unsigned long)(&engine->sgdma_regs->first_desc_adjacent) -
+			       (unsigned long)(&engine->sgdma_regs));
+
+	engine_start_mode_config(engine);
+	engine->running = 1;
+}
+
+/* engine_service() for an engine owned by a ring; engine->lock held */
+static int xdma_ring_service(struct xdma_ring *ring)
+{
+	struct xdma_engine *engine = ring->engine;
+	bool realign = false, progress = false;
+	u32 count, fresh;
+	int rv;
+
+	rv = engine_status_read(engine, 1, 0);
+	if (rv < 0)
+		return rv;
+	if (!engine->running)
+		return 0;
+
+	count = read_register(&engine->regs->completed_desc_count);
+	fresh = count - ring->desc_seen;
+	ring->desc_seen = count;
+
+	while (fresh && !realign) {
+		unsigned int idx = ring->head;
+		unsigned int left = ring->slot[idx].desc_num - ring->head_done;
+
+		if (fresh < left) {
+			ring->head_done += fresh;
+			progress = true;
+			break;
+		}
+		fresh -= left;
+		ring->head = (idx + 1) % ring->slots;
+		ring->head_done = 0;
+
+		realign = xdma_ring_slot_done(ring, idx, 0);
+		/* idx is now the slot furthest away from the engine */
+		xdma_ring_refill(ring, idx, true);
+	}
+
+	if (engine->status & XDMA_STAT_C2H_ERR_MASK) {
+		pr_info("%s ring error, status 0x%08x.\n", engine->name,
+			engine->status);
+		/* the frame in progress is lost, skip its slot */
+		xdma_engine_stop(engine);
+		xdma_engine_wait_idle(engine);
+		engine_status_read(engine, 1, 0);
+		xdma_ring_slot_done(ring, ring->head, -EIO);
+		xdma_ring_refill(ring, ring->head, true);
+		xdma_ring_hw_start(ring, (ring->head + 1) % ring->slots);
+	} else if (realign || !(engine->status & XDMA_STAT_BUSY)) {
+		/*
+		 * restart on a slot boundary; the bridge drops data while the
+		 * engine is stopped and resumes on the next start of frame
+		 */
+		xdma_engine_stop(engine);
+		xdma_engine_wait_idle(engine);
+		engine_status_read(engine, 1, 0);
+		xdma_ring_hw_start(ring, ring->head);
+	} else if (progress && ring->ops->frame_progress) {
+		struct xdma_ring_slot *slot = &ring->slot[ring->head];
+
+		if (slot->cookie)
+			ring->ops->frame_progress(ring->priv, slot->cookie,
+						  ring->head_done);
+	}
+	return 0;
+}
+
+/**
+ * xdma_ring_create() - allocate a cyclic ring for an AXI-ST C2H engine
+ *
+ * @slot_desc_max must cover the largest chain ever handed out by refill();
+ * @scratch receives frames while no caller buffer is available.
+ *
+ * @return ring or ERR_PTR() on failure
+ */
+struct xdma_ring *xdma_ring_create(void *dev_hndl, int channel,
+				   unsigned int slots,
+				   unsigned int slot_desc_max,
+				   struct xdma_chain *scratch,
+				   const struct xdma_ring_ops *ops, void *priv)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+	struct xdma_ring *ring;
+	unsigned int i, j;
+
+	engine = xdma_engine_lookup(xdev, channel, false);
+	if (!engine || !engine->streaming || slots < 3 || !slot_desc_max ||
+	    IS_ERR_OR_NULL(scratch) || scratch->engine != engine ||
+	    scratch->desc_cnt > slot_desc_max || !ops || !ops->refill ||
+	    !ops->frame_done)
+		return ERR_PTR(-EINVAL);
+
+	/* the ring is serviced by the engine interrupt, one slot per frame */
+	if (poll_mode || enable_st_c2h_credit || engine->eop_flush)
+		return ERR_PTR(-EOPNOTSUPP);
+
+	ring = kzalloc_node(sizeof(*ring), GFP_KERNEL,
+			    dev_to_node(&xdev->pdev->dev));
+	if (!ring)
+		return ERR_PTR(-ENOMEM);
+
+	ring->slot = kcalloc_node(slots, sizeof(*ring->slot), GFP_KERNEL,
+				  dev_to_node(&xdev->pdev->dev));
+	if (!ring->slot) {
+		kfree(ring);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	ring->engine = engine;
+	ring->ops = ops;
+	ring->priv = priv;
+	ring->scratch = scratch;
+	ring->slots = slots;
+	ring->slot_desc_max = slot_desc_max;
+
+	/* one allocation per slot keeps every allocation small */
+	for (i = 0; i < slots; i++) {
+		struct xdma_ring_slot *slot = &ring->slot[i];
+
+		slot->desc_virt = dma_alloc_coherent(&xdev->pdev->dev,
+				slot_desc_max * sizeof(struct xdma_desc),
+				&slot->desc_bus, GFP_KERNEL);
+		slot->res_virt = dma_alloc_coherent(&xdev->pdev->dev,
+				slot_desc_max * sizeof(struct xdma_result),
+				&slot->res_bus, GFP_KERNEL);
+		if (!slot->desc_virt || !slot->res_virt) {
+			xdma_ring_destroy(ring);
+			return ERR_PTR(-ENOMEM);
+		}
+
+		/* writeback result addresses never change */
+		for (j = 0; j < slot_desc_max; j++) {
+			dma_addr_t res_bus = slot->res_bus +
+					     j * sizeof(struct xdma_result);
+
+			slot->desc_virt[j].src_addr_lo =
+				cpu_to_le32(PCI_DMA_L(res_bus));
+			slot->desc_virt[j].src_addr_hi =
+				cpu_to_le32(PCI_DMA_H(res_bus));
+		}
+	}
+	return ring;
+}
+EXPORT_SYMBOL_GPL(xdma_ring_create);
+
+/**
+ * xdma_ring_start() - fill every slot and start the engine on slot 0
+ *
+ * The engine must be idle with no transfer queued.
+ */
+int xdma_ring_start(struct xdma_ring *ring)
+{
+	struct xdma_engine *engine;
+	unsigned long flags;
+	unsigned int i;
+
+	if (IS_ERR_OR_NULL(ring))
+		return -EINVAL;
+
+	engine = ring->engine;
+	if (xdma_device_flag_check(engine->xdev, XDEV_FLAG_OFFLINE))
+		return -EBUSY;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (engine->running || engine->ring ||
+	    !list_empty(&engine->transfer_list) ||
+	    (engine->shutdown & ENGINE_SHUTDOWN_REQUEST)) {
+		spin_unlock_irqrestore(&engine->lock, flags);
+		return -EBUSY;
+	}
+
+	for (i = 0; i < ring->slots; i++)
+		xdma_ring_refill(ring, i, true);
+
+	engine_status_read(engine, 1, 0);
+	engine->ring = ring;
+	xdma_ring_hw_start(ring, 0);
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xdma_ring_start);
+
+/**
+ * xdma_ring_kick() - move newly available buffers into scratch slots
+ *
+ * Only slots at least two ahead of the engine are rewritten.
+ */
+void xdma_ring_kick(struct xdma_ring *ring)
+{
+	struct xdma_engine *engine;
+	unsigned long flags;
+	unsigned int i, idx;
+
+	if (IS_ERR_OR_NULL(ring))
+		return;
+
+	engine = ring->engine;
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (engine->ring == ring) {
+		for (i = 2; i < ring->slots; i++) {
+			idx = (ring->head + i) % ring->slots;
+			if (ring->slot[idx].cookie)
+				continue;
+			if (!xdma_ring_refill(ring, idx, false))
+				break;
+		}
+	}
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+}
+EXPORT_SYMBOL_GPL(xdma_ring_kick);
+
+/**
+ * xdma_ring_stop() - stop the engine and hand every buffer back
+ *
+ * frame_done(-ECANCELED) is called for each slot holding a caller buffer,
+ * oldest first. The engine accepts regular transfers again afterwards.
+ */
+void xdma_ring_stop(struct xdma_ring *ring)
+{
+	struct xdma_engine *engine;
+	unsigned long flags;
+	unsigned int i, idx;
+	void *cookie;
+
+	if (IS_ERR_OR_NULL(ring))
+		return;
+
+	engine = ring->engine;
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (engine->ring != ring) {
+		spin_unlock_irqrestore(&engine->lock, flags);
+		return;
+	}
+
+	xdma_engine_stop(engine);
+	xdma_engine_wait_idle(engine);
+	engine_status_read(engine, 1, 0);
+	engine->ring = NULL;
+	engine->desc_dequeued = 0;
+
+	for (i = 0; i < ring->slots; i++) {
+		idx = (ring->head + i) % ring->slots;
+		cookie = ring->slot[idx].cookie;
+		ring->slot[idx].cookie = NULL;
+		if (cookie)
+			ring->ops->frame_done(ring->priv, cookie, 0,
+					      -ECANCELED);
+	}
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+}
+EXPORT_SYMBOL_GPL(xdma_ring_stop);
+
+/* xdma_ring_destroy() - free a ring; it must not be running */
+void xdma_ring_destroy(struct xdma_ring *ring)
+{
+	struct device *dev;
+	unsigned int i;
+
+	if (IS_ERR_OR_NULL(ring))
+		return;
+
+	WARN_ON(ring->engine->ring == ring);
+	dev = &ring->engine->xdev->pdev->dev;
+
+	for (i = 0; i < ring->slots; i++) {
+		struct xdma_ring_slot *slot = &ring->slot[i];
+
+		if (slot->res_virt)
+			dma_free_coherent(dev,
+				ring->slot_desc_max * sizeof(struct xdma_result),
+				slot->res_virt, slot->res_bus);
+		if (slot->desc_virt)
+			dma_free_coherent(dev,
+				ring->slot_desc_max * sizeof(struct xdma_desc),
+				slot->desc_virt, slot->desc_bus);
+	}
+	kfree(ring->slot);
+	kfree(ring);
+}
+EXPORT_SYMBOL_GPL(xdma_ring_destroy);
+
+/**
+ * xdma_engine_poll_wb() - enable descriptor writeback next to interrupts
+ *
+ * Completion interrupts stay enabled; the writeback area only lets a caller
+ * busy-poll for a completion it expects soon, see
+ * xdma_engine_poll_completion(). Not available with the global poll_mode.
+ */
+int xdma_engine_poll_wb(void *dev_hndl, int channel, bool write, bool enable)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+	unsigned long flags;
+	int rv;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine)
+		return -EINVAL;
+	if (poll_mode)
+		return -EOPNOTSUPP;
+
+	if (enable && !engine->poll_mode_addr_virt) {
+		engine->poll_mode_addr_virt =
+			dma_alloc_coherent(&xdev->pdev->dev,
+					   sizeof(struct xdma_poll_wb),
+					   &engine->poll_mode_bus, GFP_KERNEL);
+		if (!engine->poll_mode_addr_virt)
+			return -ENOMEM;
+		rv = engine_writeback_setup(engine);
+		if (rv < 0) {
+			/* don't leave an unconfigured area for the next call */
+			dma_free_coherent(&xdev->pdev->dev,
+					  sizeof(struct xdma_poll_wb),
+					  engine->poll_mode_addr_virt,
+					  engine->poll_mode_bus);
+			engine->poll_mode_addr_virt = NULL;
+			return rv;
+		}
+	}
+
+	/* takes effect on the next engine start */
+	spin_lock_irqsave(&engine->lock, flags);
+	engine->poll_wb = enable && engine->poll_mode_addr_virt;
+	spin_unlock_irqrestore(&engine->lock, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xdma_engine_poll_wb);
+
+/* 24-bit writeback count reached @target (compared modulo 2^24) */
+static inline bool xdma_wb_count_reached(u32 v, u32 target)
+{
+	return !((v - target) & WB_COUNT_MASK & ~(WB_COUNT_MASK >> 1));
+}
+
+/* writeback count at which the oldest pending transfer (or ring slot) is done */
+static bool xdma_engine_wb_target(struct xdma_engine *engine, u32 *target)
+{
+	struct xdma_transfer *xfer;
+	struct xdma_ring *ring = engine->ring;
+
+	if (!engine->running)
+		return false;
+
+	if (ring) {
+		*target = ring->desc_seen - ring->head_done +
+			  ring->slot[ring->head].desc_num;
+		return true;
+	}
+
+	if (list_empty(&engine->transfer_list))
+		return false;
+
+	xfer = list_first_entry(&engine->transfer_list, struct xdma_transfer,
+				entry);
+	*target = engine->desc_dequeued + xfer->desc_num;
+	return true;
+}
+
+/**
+ * xdma_engine_poll_completion() - busy-poll for the next completion
+ *
+ * Spins on the writeback area for up to @budget_us. When the oldest pending
+ * transfer (or ring slot) completes within the budget the engine is serviced
+ * right here, so io_done()/frame_done() run in the caller's context instead
+ * of waiting for the interrupt work; the interrupt that follows finds
+ * nothing left to do.
+ *
+ * @return 1 if a completion was serviced, 0 if the budget ran out (the
+ *	interrupt path takes over), < 0 in case of error
+ */
+int xdma_engine_poll_completion(void *dev_hndl, int channel, bool write,
+				unsigned int budget_us)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+	struct xdma_poll_wb *wb;
+	unsigned long flags;
+	ktime_t deadline;
+	u32 target, v;
+	bool pending;
+	int rv;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine || !engine->poll_wb)
+		return -EINVAL;
+
+	wb = (struct xdma_poll_wb *)engine->poll_mode_addr_virt;
+
+	spin_lock_irqsave(&engine->lock, flags);
+	pending = xdma_engine_wb_target(engine, &target);
+	spin_unlock_irqrestore(&engine->lock, flags);
+	if (!pending)
+		return 0;
+
+	deadline = ktime_add_us(ktime_get(), budget_us);
+	do {
+		v = READ_ONCE(wb->completed_desc_count);
+		if ((v & WB_ERR_MASK) || xdma_wb_count_reached(v, target)) {
+			spin_lock_irqsave(&engine->lock, flags);
+			WRITE_ONCE(engine->irq_ns, ktime_get_ns());
+			rv = engine_service(engine, 0);
+			spin_unlock_irqrestore(&engine->lock, flags);
+			return rv < 0 ? rv : 1;
+		}
+		cpu_relax();
+	} while (ktime_before(ktime_get(), deadline));
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xdma_engine_poll_completion);
+
+u64 xdma_engine_irq_ns(void *dev_hndl, int channel, bool write)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine)
+		return 0;
+
+	return READ_ONCE(engine->irq_ns);
+}
+EXPORT_SYMBOL_GPL(xdma_engine_irq_ns);
+
+int xdma_engine_cmpl_cpu(void *dev_hndl, int channel, bool write)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine || !engine->cmplthp)
+		return -1;
+
+	return engine->cmplthp->cpu;
+}
+EXPORT_SYMBOL_GPL(xdma_engine_cmpl_cpu);
+
+int xdma_engine_irq_line(void *dev_hndl, int channel, bool write)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	struct xdma_engine *engine;
+
+	engine = xdma_engine_lookup(xdev, channel, write);
+	if (!engine || !xdev->msix_enabled || !engine->msix_irq_line)
+		return -1;
+
+	return engine->msix_irq_line;
+}
+EXPORT_SYMBOL_GPL(xdma_engine_irq_line);
+
+int xdma_user_irq_line(void *dev_hndl, unsigned int user)
+{
+	struct xdma_dev *xdev = (struct xdma_dev *)dev_hndl;
+	int j;
+
+	if (!xdev || !xdev->msix_enabled || user >= xdev->user_max)
+		return -1;
+
+	/* same numbering as irq_msix_user_setup(): user vectors follow H2C, C2H */
+	j = xdev->h2c_channel_max + xdev->c2h_channel_max + user;
+#if KERNEL_VERSION(4, 12, 0) <= LINUX_VERSION_CODE
+	return pci_irq_vector(xdev->pdev, j);
+#else
+	return xdev->entry[j].vector;
+#endif
+}
+EXPORT_SYMBOL_GPL(xdma_user_irq_line);
+
 int xdma_performance_submit(struct xdma_dev *xdev, struct xdma_engine *engine)
 {
 	u32 max_consistent_size = XDMA_PERF_NUM_DESC * 32 * 1024; /* 4MB */
@@ -4139,7 +5317,13 @@ static struct xdma_dev *alloc_dev_instance(struct pci_dev *pdev)
 	}
 
 	/* allocate zeroed device book keeping structure */
-	xdev = kzalloc(sizeof(struct xdma_dev), GFP_KERNEL);
+	/*
+	 * engines and their locks are touched on every completion, keep them
+	 * next to the card (descriptors and writeback areas already are, the
+	 * DMA API allocates coherent memory on the device's node)
+	 */
+	xdev = kzalloc_node(sizeof(struct xdma_dev), GFP_KERNEL,
+			    dev_to_node(&pdev->dev));
 	if (!xdev) {
 		pr_info("OOM, xdma_dev.\n");
 		return NULL;
@@ -96,6 +96,12 @@
 #define XDMA_ENGINE_XFER_MAX_DESC		0x800
 #define XDMA_ENGINE_CREDIT_XFER_MAX_DESC	0x3FF
 
+/*
+ * number of descriptors in the pre-allocated ring of an AXI-ST C2H engine,
+ * large enough to keep several full-frame requests queued at once
+ */
+#define XDMA_ENGINE_ST_C2H_RING_DESC		0x2000
+
 /* maximum size of a single DMA transfer descriptor */
 #define XDMA_DESC_BLEN_BITS	28
 #define XDMA_DESC_BLEN_MAX	((1 << (XDMA_DESC_BLEN_BITS)) - 1)
@@ -291,6 +297,8 @@ struct xdma_io_cb {
 	struct xdma_request_cb *req;
 	u8 write:1;
 	void (*io_done)(unsigned long cb_hndl, int err);
+	/* optional: descriptors of the head transfer done so far */
+	void (*io_progress)(unsigned long cb_hndl, unsigned int desc_done);
 };
 
 struct config_regs {
@@ -490,6 +498,46 @@ struct xdma_request_cb {
 #endif
 };
 
+/*
+ * prebuilt descriptor chain: descriptors (and C2H ST results) for one
+ * caller-owned buffer, built once and re-queued as is for every transfer
+ */
+struct xdma_chain {
+	struct xdma_engine *engine;
+	struct xdma_transfer xfer;	/* re-queued on every submit */
+	unsigned int desc_cnt;		/* descriptors in the chain */
+	unsigned int len;		/* bytes covered by the chain */
+};
+
+/* one frame slot of a cyclic C2H ring */
+struct xdma_ring_slot {
+	struct xdma_desc *desc_virt;	/* slot_desc_max descriptors */
+	dma_addr_t desc_bus;
+	struct xdma_result *res_virt;	/* writeback results, 1:1 to desc */
+	dma_addr_t res_bus;
+	unsigned int desc_num;		/* descriptors programmed */
+	void *cookie;			/* caller buffer, NULL for scratch */
+};
+
+/*
+ * cyclic C2H ring: the last descriptor of every slot links to the first
+ * descriptor of the next slot, the last slot links back to slot 0.
+ * head is the slot the engine is (at least) working on; slots head and
+ * head + 1 are never rewritten because the engine may have prefetched them.
+ */
+struct xdma_ring {
+	struct xdma_engine *engine;
+	const struct xdma_ring_ops *ops;
+	void *priv;
+	struct xdma_chain *scratch;	/* placed in slots without buffer */
+	unsigned int slots;
+	unsigned int slot_desc_max;
+	unsigned int head;
+	unsigned int head_done;		/* descriptors of head completed */
+	u32 desc_seen;			/* completed_desc_count consumed */
+	struct xdma_ring_slot *slot;
+};
+
 struct xdma_engine {
 	unsigned long magic;	/* structure ID for sanity checks */
 	struct xdma_dev *xdev;	/* parent device */
@@ -513,17 +561,19 @@ struct xdma_engine {
 	u8 running:1;		/* flag if the driver started engine */
 	u8 non_incr_addr:1;	/* flag if non-incremental addressing used */
 	u8 eop_flush:1;		/* st c2h only, flush up the data with eop */
-	u8 filler:1;
+	u8 poll_wb:1;		/* hybrid: desc writeback on top of IRQs */
 
 	int max_extra_adj;	/* descriptor prefetch capability */
 	int desc_dequeued;	/* num descriptors of completed transfers */
 	u32 desc_max;		/* max # descriptors per xfer */
+	u32 desc_ring_max;	/* # descriptors in the pre-allocated ring */
 	u32 status;		/* last known status of device */
 	/* only used for MSIX mode to store per-engine interrupt mask value */
 	u32 interrupt_enable_mask_value;
 
 	/* Transfer list management */
 	struct list_head transfer_list;	/* queue of transfers */
+	struct xdma_ring *ring;		/* cyclic ring owning the engine */
 
 	/* Members applicable to AXI-ST C2H (cyclic) transfers */
 	struct xdma_result *cyclic_result;
@@ -546,6 +596,7 @@ struct xdma_engine {
 	int msix_irq_line;		/* MSI-X vector for this engine */
 	u32 irq_bitmask;		/* IRQ bit mask for this engine */
 	struct work_struct work;	/* Work queue for interrupt handling */
+	u64 irq_ns;			/* ktime_get_ns() of the last service kick */
 
 	struct mutex desc_lock;		/* protects concurrent access */
 	dma_addr_t desc_bus;
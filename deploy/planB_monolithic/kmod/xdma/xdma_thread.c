@@ -21,8 +21,10 @@
 
 #include "xdma_thread.h"
 
+#include <linux/cpumask.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/topology.h>
 
 
 /* ********************* global variables *********************************** */
@@ -234,16 +236,19 @@ void xdma_thread_remove_work(struct xdma_engine *engine)
 	}
 }
 
-void xdma_thread_add_work(struct xdma_engine *engine)
+/*
+ * least loaded completion thread on @node (any node for NUMA_NO_NODE),
+ * thread_cnt if there is none
+ */
+static int xdma_thread_pick(int node)
 {
 	struct xdma_kthread *thp = cs_threads;
 	unsigned int v = 0;
 	int i, idx = thread_cnt;
-	unsigned long flags;
-
 
-	/* Polled mode only */
 	for (i = 0; i < thread_cnt; i++, thp++) {
+		if (node != NUMA_NO_NODE && cpu_to_node(thp->cpu) != node)
+			continue;
 		lock_thread(thp);
 		if (idx == thread_cnt) {
 			v = thp->work_cnt;
@@ -252,11 +257,27 @@ void xdma_thread_add_work(struct xdma_engine *engine)
 			idx = i;
 			unlock_thread(thp);
 			break;
-		} else if (thp->work_cnt < v)
+		} else if (thp->work_cnt < v) {
+			v = thp->work_cnt;
 			idx = i;
+		}
 		unlock_thread(thp);
 	}
 
+	return idx;
+}
+
+void xdma_thread_add_work(struct xdma_engine *engine)
+{
+	struct xdma_kthread *thp;
+	int idx;
+	unsigned long flags;
+
+	/* Polled mode only; keep the writeback polling on the card's node */
+	idx = xdma_thread_pick(dev_to_node(&engine->xdev->pdev->dev));
+	if (idx == thread_cnt)
+		idx = xdma_thread_pick(NUMA_NO_NODE);
+
 	thp = cs_threads + idx;
 	lock_thread(thp);
 	list_add_tail(&engine->cmplthp_list, &thp->work_list);
@@ -273,11 +294,11 @@ void xdma_thread_add_work(struct xdma_engine *engine)
 	spin_unlock_irqrestore(&engine->lock, flags);
 }
 
-int xdma_threads_create(unsigned int num_threads)
+int xdma_threads_create(unsigned int num_threads, int node)
 {
 	struct xdma_kthread *thp;
+	unsigned int i;
 	int rv;
-	int cpu;
 
 	if (thread_cnt) {
 		pr_warn("threads already created!");
@@ -291,10 +312,17 @@ int xdma_threads_create(unsigned int num_threads)
 		return -ENOMEM;
 	}
 
-	/* N dma writeback monitoring threads */
+	/*
+	 * N dma writeback monitoring threads, on the CPUs of @node first and
+	 * only then on the remote ones
+	 */
+	num_threads = min(num_threads, num_online_cpus());
 	thp = cs_threads;
-	for_each_online_cpu(cpu) {
-		pr_debug("index %d cpu %d online\n", thread_cnt, cpu);
+	for (i = 0; i < num_threads; i++) {
+		int cpu = cpumask_local_spread(i, node);
+
+		pr_debug("index %d cpu %d online, node %d\n", thread_cnt, cpu,
+			 cpu_to_node(cpu));
 		thp->cpu = cpu;
 		thp->timeout = 0;
 		thp->fproc = xdma_thread_cmpl_status_proc;
@@ -304,8 +332,6 @@ int xdma_threads_create(unsigned int num_threads)
 			goto cleanup_threads;
 
 		thread_cnt++;
-		if (thread_cnt == num_threads)
-			break;
 		thp++;
 	}
 
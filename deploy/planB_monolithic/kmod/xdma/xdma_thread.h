@@ -112,8 +112,12 @@ struct xdma_kthread {
 /*****************************************************************************/
 /**
  * xdma_threads_create() - create xdma threads
+ *
+ * @param[in]	num_threads:	number of completion threads
+ * @param[in]	node:		NUMA node to place them on first (the node of
+ *				the card's root port), NUMA_NO_NODE for any
 *********/
-int xdma_threads_create(unsigned int num_threads);
+int xdma_threads_create(unsigned int num_threads, int node);
 
 /*****************************************************************************/
 /**
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Tracepoints for the XDMA SGDMA engines.
+ *
+ * All events carry the engine channel and direction. Transfers are keyed by
+ * the caller's io cb (or the ring slot cookie), which is what the caller's
+ * own tracepoints use to tie a DMA run back to a frame.
+ *
+ * Only libxdma.c defines CREATE_TRACE_POINTS.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM xdma
+
+#if !defined(__XDMA_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __XDMA_TRACE_H__
+
+#include <linux/dma-direction.h>
+#include <linux/tracepoint.h>
+
+#include "libxdma.h"
+
+DECLARE_EVENT_CLASS(xdma_engine_class,
+	TP_PROTO(struct xdma_engine *engine, const void *cookie, u32 desc,
+		 u32 value),
+	TP_ARGS(engine, cookie, desc, value),
+
+	TP_STRUCT__entry(
+		__field(u8, channel)
+		__field(bool, c2h)
+		__field(const void *, cookie)
+		__field(u32, desc)
+		__field(u32, value)
+	),
+
+	TP_fast_assign(
+		__entry->channel = engine->channel;
+		__entry->c2h = engine->dir == DMA_FROM_DEVICE;
+		__entry->cookie = cookie;
+		__entry->desc = desc;
+		__entry->value = value;
+	),
+
+	TP_printk("%s%u cookie=%p desc=%u value=0x%x",
+		  __entry->c2h ? "c2h" : "h2c", __entry->channel,
+		  __entry->cookie, __entry->desc, __entry->value)
+);
+
+/* engine_start(): desc = descriptors of the head transfer, value = 0 */
+DEFINE_EVENT(xdma_engine_class, xdma_engine_start,
+	TP_PROTO(struct xdma_engine *engine, const void *cookie, u32 desc,
+		 u32 value),
+	TP_ARGS(engine, cookie, desc, value));
+
+/* engine_service(): desc = completed descriptor count, value = status */
+DEFINE_EVENT(xdma_engine_class, xdma_engine_service,
+	TP_PROTO(struct xdma_engine *engine, const void *cookie, u32 desc,
+		 u32 value),
+	TP_ARGS(engine, cookie, desc, value));
+
+/* engine error: desc = completed descriptors, value = status */
+DEFINE_EVENT(xdma_engine_class, xdma_engine_error,
+	TP_PROTO(struct xdma_engine *engine, const void *cookie, u32 desc,
+		 u32 value),
+	TP_ARGS(engine, cookie, desc, value));
+
+TRACE_EVENT(xdma_xfer_submit,
+	TP_PROTO(struct xdma_engine *engine, const void *cookie,
+		 unsigned int nents, unsigned int len),
+	TP_ARGS(engine, cookie, nents, len),
+
+	TP_STRUCT__entry(
+		__field(u8, channel)
+		__field(bool, c2h)
+		__field(const void *, cookie)
+		__field(unsigned int, nents)
+		__field(unsigned int, len)
+	),
+
+	TP_fast_assign(
+		__entry->channel = engine->channel;
+		__entry->c2h = engine->dir == DMA_FROM_DEVICE;
+		__entry->cookie = cookie;
+		__entry->nents = nents;
+		__entry->len = len;
+	),
+
+	TP_printk("%s%u cookie=%p nents=%u len=%u",
+		  __entry->c2h ? "c2h" : "h2c", __entry->channel,
+		  __entry->cookie, __entry->nents, __entry->len)
+);
+
+/* io_done()/frame_done() about to run: desc = descriptors of the run */
+TRACE_EVENT(xdma_xfer_done,
+	TP_PROTO(struct xdma_engine *engine, const void *cookie, u32 desc,
+		 int err),
+	TP_ARGS(engine, cookie, desc, err),
+
+	TP_STRUCT__entry(
+		__field(u8, channel)
+		__field(bool, c2h)
+		__field(const void *, cookie)
+		__field(u32, desc)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__entry->channel = engine->channel;
+		__entry->c2h = engine->dir == DMA_FROM_DEVICE;
+		__entry->cookie = cookie;
+		__entry->desc = desc;
+		__entry->err = err;
+	),
+
+	TP_printk("%s%u cookie=%p desc=%u err=%d",
+		  __entry->c2h ? "c2h" : "h2c", __entry->channel,
+		  __entry->cookie, __entry->desc, __entry->err)
+);
+
+#endif /* __XDMA_TRACE_H__ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE xdma_trace
+#include <trace/define_trace.h>
@@ -4,10 +4,13 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "video_cap.h"
@@ -26,15 +29,96 @@ void print_usage(const char *prog_name) {
   printf("  -s            开始视频采集 (使能 + 测试模式)\n");
   printf("  -p            停止视频采集\n");
   printf("  -t            复位设备\n");
+  printf("  -g <n>        流式采集 n 帧 (mmap + GET_FRAME)\n");
+  printf("  -S            获取采集统计\n");
+  printf("  -m <n>        mmap 寄存器窗口, 采样 STATUS n 次并统计速率\n");
   printf("  -h            显示此帮助\n");
 }
 
+/* 流式采集: 映射全部帧缓冲, START 后取 count 帧, 再 STOP */
+static void grab_frames(int fd, int count) {
+  struct video_cap_frame frame;
+  void *bufs[DMA_BUFFER_COUNT];
+  int i, n;
+
+  for (n = 0; n < DMA_BUFFER_COUNT; n++) {
+    bufs[n] = mmap(NULL, DMA_BUFFER_SIZE, PROT_READ, MAP_SHARED, fd,
+                   (off_t)VIDEO_CAP_MMAP_OFFSET(n));
+    if (bufs[n] == MAP_FAILED) {
+      perror("mmap 失败");
+      goto unmap;
+    }
+  }
+
+  if (ioctl(fd, VIDEO_CAP_START, 0) < 0) {
+    perror("IOCTL START 失败");
+    goto unmap;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (ioctl(fd, VIDEO_CAP_GET_FRAME, &frame) < 0) {
+      perror("IOCTL GET_FRAME 失败");
+      break;
+    }
+    printf("帧 %u: buf=%u size=%u ts=%llu ns%s 首像素=0x%08X\n",
+           frame.sequence, frame.index, frame.size,
+           (unsigned long long)frame.timestamp,
+           (frame.flags & FRAME_FLAG_ERROR) ? " [ERROR]" : "",
+           *(const volatile __u32 *)bufs[frame.index]);
+  }
+
+  if (ioctl(fd, VIDEO_CAP_STOP, 0) < 0)
+    perror("IOCTL STOP 失败");
+
+unmap:
+  while (n--)
+    munmap(bufs[n], DMA_BUFFER_SIZE);
+}
+
+/* 只读映射用户寄存器窗口, 直接采样 STATUS (不经过 ioctl) */
+static void sample_status(int fd, int count) {
+  struct video_cap_info info;
+  struct timespec t0, t1;
+  const volatile __u32 *regs;
+  __u32 v, changes = 0, last = 0;
+  double sec;
+  int i;
+
+  if (ioctl(fd, VIDEO_CAP_GET_INFO, &info) < 0) {
+    perror("IOCTL GET_INFO 失败");
+    return;
+  }
+
+  regs = mmap(NULL, info.bar0_size, PROT_READ, MAP_SHARED, fd,
+              (off_t)VIDEO_CAP_MMAP_REGS_OFFSET);
+  if (regs == MAP_FAILED) {
+    perror("mmap 寄存器窗口失败");
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < count; i++) {
+    v = regs[REG_STATUS / 4];
+    if (i && v != last)
+      changes++;
+    last = v;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  printf("STATUS = 0x%08X, %d 次采样 %.3f ms (%.0f 次/秒), 变化 %u 次\n", last,
+         count, sec * 1e3, sec > 0 ? count / sec : 0.0, changes);
+
+  munmap((void *)regs, info.bar0_size);
+}
+
 int main(int argc, char *argv[]) {
   int fd;
   int opt;
   struct video_cap_version ver;
   struct video_cap_info info;
   struct video_cap_reg reg;
+  struct video_cap_stats stats;
 
   fd = open(DEV_NAME, O_RDWR);
   if (fd < 0) {
@@ -42,7 +126,7 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  while ((opt = getopt(argc, argv, "vidr:w:spth")) != -1) {
+  while ((opt = getopt(argc, argv, "vidr:w:sptg:Sm:h")) != -1) {
     switch (opt) {
     case 'v':
       if (ioctl(fd, VIDEO_CAP_GET_VERSION, &ver) < 0) {
@@ -68,40 +152,45 @@ int main(int argc, char *argv[]) {
       }
       break;
 
-    case 'd':
+    case 'd': {
+      /* 一次批量 ioctl 读全部核心寄存器 */
+      struct video_cap_reg regs[] = {
+          {REG_VERSION, 0},    {REG_CONTROL, 0},    {REG_STATUS, 0},
+          {REG_IRQ_MASK, 0},   {REG_IRQ_STATUS, 0}, {REG_VID_FORMAT, 0},
+          {REG_VID_RESOLUTION, 0},
+      };
+      struct video_cap_reg_batch batch = {
+          .regs = (__u64)(uintptr_t)regs,
+          .count = sizeof(regs) / sizeof(regs[0]),
+      };
+      __u32 v;
+
       printf("=== 寄存器 Dump ===\n");
-      reg.offset = REG_VERSION;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0)
-        printf("VERSION    [0x%04X] = 0x%08X\n", reg.offset, reg.value);
-      reg.offset = REG_CONTROL;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0) {
-        printf("CONTROL    [0x%04X] = 0x%08X", reg.offset, reg.value);
-        printf(" (EN=%d, RST=%d, TEST=%d)\n", (reg.value & CTRL_ENABLE) ? 1 : 0,
-               (reg.value & CTRL_SOFT_RESET) ? 1 : 0,
-               (reg.value & CTRL_TEST_MODE) ? 1 : 0);
-      }
-      reg.offset = REG_STATUS;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0) {
-        printf("STATUS     [0x%04X] = 0x%08X", reg.offset, reg.value);
-        printf(" (IDLE=%d, MIG=%d, OVFL=%d, LINK=%d)\n",
-               (reg.value & STS_IDLE) ? 1 : 0,
-               (reg.value & STS_MIG_CALIB) ? 1 : 0,
-               (reg.value & STS_FIFO_OVERFLOW) ? 1 : 0,
-               (reg.value & STS_PCIE_LINK_UP) ? 1 : 0);
+      if (ioctl(fd, VIDEO_CAP_READ_REGS, &batch) < 0) {
+        perror("IOCTL READ_REGS 失败");
+        break;
       }
-      reg.offset = REG_IRQ_MASK;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0)
-        printf("IRQ_MASK   [0x%04X] = 0x%08X\n", reg.offset, reg.value);
-      reg.offset = REG_IRQ_STATUS;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0)
-        printf("IRQ_STATUS [0x%04X] = 0x%08X\n", reg.offset, reg.value);
-      reg.offset = REG_VID_FORMAT;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0)
-        printf("VID_FORMAT [0x%04X] = 0x%08X\n", reg.offset, reg.value);
-      reg.offset = REG_VID_RESOLUTION;
-      if (ioctl(fd, VIDEO_CAP_READ_REG, &reg) == 0)
-        printf("VID_RES    [0x%04X] = 0x%08X (%dx%d)\n", reg.offset, reg.value,
-               (reg.value >> 16) & 0xFFFF, reg.value & 0xFFFF);
+      printf("VERSION    [0x%04X] = 0x%08X\n", regs[0].offset, regs[0].value);
+      v = regs[1].value;
+      printf("CONTROL    [0x%04X] = 0x%08X", regs[1].offset, v);
+      printf(" (EN=%d, RST=%d, TEST=%d)\n", (v & CTRL_ENABLE) ? 1 : 0,
+             (v & CTRL_SOFT_RESET) ? 1 : 0, (v & CTRL_TEST_MODE) ? 1 : 0);
+      v = regs[2].value;
+      printf("STATUS     [0x%04X] = 0x%08X", regs[2].offset, v);
+      printf(" (IDLE=%d, MIG=%d, OVFL=%d, LINK=%d)\n", (v & STS_IDLE) ? 1 : 0,
+             (v & STS_MIG_CALIB) ? 1 : 0, (v & STS_FIFO_OVERFLOW) ? 1 : 0,
+             (v & STS_PCIE_LINK_UP) ? 1 : 0);
+      printf("IRQ_MASK   [0x%04X] = 0x%08X\n", regs[3].offset, regs[3].value);
+      printf("IRQ_STATUS [0x%04X] = 0x%08X\n", regs[4].offset, regs[4].value);
+      printf("VID_FORMAT [0x%04X] = 0x%08X\n", regs[5].offset, regs[5].value);
+      v = regs[6].value;
+      printf("VID_RES    [0x%04X] = 0x%08X (%dx%d)\n", regs[6].offset, v,
+             (v >> 16) & 0xFFFF, v & 0xFFFF);
+      break;
+    }
+
+    case 'm':
+      sample_status(fd, atoi(optarg));
       break;
 
     case 'r':
@@ -160,6 +249,29 @@ int main(int argc, char *argv[]) {
       }
       break;
 
+    case 'g':
+      grab_frames(fd, atoi(optarg));
+      break;
+
+    case 'S':
+      if (ioctl(fd, VIDEO_CAP_GET_STATS, &stats) < 0) {
+        perror("IOCTL GET_STATS 失败");
+      } else {
+        printf("已采集帧:     %llu\n",
+               (unsigned long long)stats.frames_captured);
+        printf("丢帧:         %llu\n", (unsigned long long)stats.frames_dropped);
+        printf("传输字节:     %llu\n",
+               (unsigned long long)stats.bytes_transferred);
+        printf("DMA错误:      %llu\n", (unsigned long long)stats.dma_errors);
+        printf("FIFO溢出/欠流: %llu / %llu\n",
+               (unsigned long long)stats.overflow_count,
+               (unsigned long long)stats.underflow_count);
+        printf("当前帧率:     %u.%02u fps\n", stats.current_fps / 100,
+               stats.current_fps % 100);
+        printf("运行时间:     %u s\n", stats.uptime_seconds);
+      }
+      break;
+
     case 'h':
     default:
       print_usage(argv[0]);
@@ -6,39 +6,156 @@
 
 #include <linux/cdev.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/pci.h>
+#include <linux/percpu.h>
+#include <linux/scatterlist.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/videodev2.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "video_cap.h"
 #include "video_cap_regs.h"
 
+/*
+ * XDMA 描述符 / C2H 流写回结果 (PG195, 各32字节)
+ */
+struct xdma_desc {
+  __le32 control;
+  __le32 bytes;
+  __le32 src_lo; /* C2H 流: 写回结果的总线地址 */
+  __le32 src_hi;
+  __le32 dst_lo;
+  __le32 dst_hi;
+  __le32 next_lo;
+  __le32 next_hi;
+};
+
+struct xdma_c2h_result {
+  __le32 status;
+  __le32 length;
+  __le32 reserved[6];
+};
+
+/* C2H 通道打开的中断: 描述符完成/停止 + 所有错误 */
+#define XDMA_CH_IE_MASK                                                        \
+  (XDMA_CTRL_IE_DESC_STOPPED | XDMA_CTRL_IE_DESC_COMPLETED |                   \
+   XDMA_CTRL_IE_ALIGN_MISMATCH | XDMA_CTRL_IE_MAGIC_STOPPED |                  \
+   XDMA_CTRL_IE_READ_ERROR | XDMA_CTRL_IE_DESC_ERROR)
+
+/*
+ * 帧缓冲由不超过 1MB 的页块拼成 (普通页分配即可, 不依赖 CMA), 拆成单页以便 mmap;
+ * DMA 映射后地址相邻的页合并成一块, 每块一个描述符
+ */
+#define VIDEO_CAP_CHUNK_ORDER 8 /* 4KB 页时 1MB */
+
+struct video_cap_buf {
+  struct page **pages;
+  unsigned int npages;
+  struct sg_table sgt;
+  int nents;     /* dma_map_sg 返回的块数 */
+  u32 desc_last; /* 本缓冲区最后一个描述符在环上的位置 (START 时按帧长确定) */
+};
+
+/*
+ * 每CPU统计: 只在中断里更新 (同一CPU上没有并发写者), GET_STATS 无锁汇总
+ */
+struct video_cap_pcpu_stats {
+  u64 frames_captured;
+  u64 frames_dropped;
+  u64 bytes_transferred;
+  u64 dma_errors;
+  u64 overflow_count;
+  u64 underflow_count;
+  struct u64_stats_sync syncp;
+};
+
+/*
+ * 最新完成的一帧: 中断里写, GET_FRAME/GET_STATS 用 seqcount 无锁读
+ */
+struct video_cap_latest {
+  seqcount_t seq;
+  u32 frames; /* START 后完成的帧数 (= 最新帧 sequence + 1) */
+  u32 index;
+  u32 size;
+  u32 flags;
+  u64 timestamp;
+  u64 period_ns; /* 帧间隔 (1/8 指数平均) */
+};
+
+/*
+ * RW 寄存器影子: CONTROL/IRQ_MASK/VID_FORMAT 只由本驱动写, 读时不走 MMIO;
+ * 通道0窗口里的 CONTROL/VID_FORMAT 是同一组寄存器, 共用影子
+ */
+enum {
+  SHADOW_CONTROL,
+  SHADOW_IRQ_MASK,
+  SHADOW_VID_FORMAT,
+  SHADOW_COUNT,
+};
+
 /*
  * 设备上下文结构体
  */
 struct video_cap_dev {
   struct pci_dev *pdev; /* PCI设备结构 */
-  void __iomem *bar0;   /* BAR0内核映射地址 (用户寄存器 + XDMA) */
+  void __iomem *bar0;   /* BAR0内核映射地址 (用户寄存器, AXI-Lite) */
   unsigned long bar0_len;
+  void __iomem *dma_regs; /* XDMA 配置 BAR (C2H 引擎 + 中断块) */
 
   dev_t dev_num;         /* 设备号 (主/次) */
   struct cdev cdev;      /* 字符设备结构 */
   struct class *class;   /* 设备类 */
   struct device *device; /* 设备结构 */
 
-  spinlock_t lock; /* 主要锁 */
+  spinlock_t lock; /* 主要锁 (也保护寄存器影子) */
+  u32 shadow[SHADOW_COUNT];
 
   /* 设备状态 */
   int usage_count;
 
   /* 中断处理 */
   int irq;
+
+  /* 流式采集 (START/STOP/GET_FRAME) */
+  struct mutex mutex; /* START/STOP/SET_FORMAT/缓冲区分配 */
+  struct video_cap_format fmt;
+  struct file *owner; /* START 的文件, 关闭时自动 STOP */
+  bool streaming;
+  struct video_cap_buf buf[DMA_BUFFER_COUNT];
+  struct xdma_desc *desc; /* 首尾相连的描述符环, 每个缓冲区若干个 (每块一个) */
+  dma_addr_t desc_dma;
+  struct xdma_c2h_result *result; /* 与描述符一一对应的写回结果 */
+  dma_addr_t result_dma;
+  u32 desc_max;   /* desc/result 数组长度 (各缓冲区块数之和) */
+  u32 desc_total; /* 当前帧长下环上的描述符数 */
+  /* 以下由中断处理 (resync 时由 resync_work 在引擎停下后重置) */
+  u32 completed;  /* 已处理的描述符数 (对应 XDMA_CH_COMPLETED, 32 位回绕) */
+  u32 desc_pos;   /* 下一个要处理的描述符 */
+  u32 cur_slot;   /* desc_pos 所在的缓冲区 */
+  u32 frame_len;  /* cur_slot 已完成描述符的字节数 */
+  bool frame_err;
+  bool resync;    /* 环在重建或已错位 (帧提前结束): 中断不处理完成的描述符 */
+  struct work_struct resync_work;
+  u32 consumed;  /* GET_FRAME 取走的最新帧的 frames 值 */
+  u64 start_ns;
+  struct video_cap_latest latest;
+  wait_queue_head_t frame_wq;
+  struct video_cap_pcpu_stats __percpu *stats;
 };
 
 /*
@@ -51,12 +168,689 @@ static struct class *video_cap_class = NULL;
 /*
  * 寄存器访问辅助函数
  */
+static inline int reg_shadow_index(u32 offset) {
+  switch (offset) {
+  case REG_CONTROL:
+  case REG_CH0_CONTROL:
+    return SHADOW_CONTROL;
+  case REG_IRQ_MASK:
+    return SHADOW_IRQ_MASK;
+  case REG_VID_FORMAT:
+  case REG_CH0_VID_FORMAT:
+    return SHADOW_VID_FORMAT;
+  default:
+    return -1;
+  }
+}
+
 static inline u32 reg_read(struct video_cap_dev *dev, u32 offset) {
+  int idx = reg_shadow_index(offset);
+
+  if (idx >= 0)
+    return READ_ONCE(dev->shadow[idx]);
   return ioread32(dev->bar0 + offset);
 }
 
-static inline void reg_write(struct video_cap_dev *dev, u32 offset, u32 val) {
+/*
+ * 影子寄存器: MMIO 写和影子更新在 dev->lock 下, 和读改写互斥。写后读回一次,
+ * 影子只保存硬件实际锁存的位 (只读位、SOFT_RESET 这类自清除位都不会留在影子里)
+ */
+static void reg_update(struct video_cap_dev *dev, u32 offset, u32 clear,
+                       u32 set) {
+  int idx = reg_shadow_index(offset);
+  u32 val;
+
+  spin_lock(&dev->lock);
+  val = (dev->shadow[idx] & ~clear) | set;
   iowrite32(val, dev->bar0 + offset);
+  WRITE_ONCE(dev->shadow[idx], ioread32(dev->bar0 + offset));
+  spin_unlock(&dev->lock);
+}
+
+static inline void reg_write(struct video_cap_dev *dev, u32 offset, u32 val) {
+  if (reg_shadow_index(offset) >= 0)
+    reg_update(dev, offset, ~0u, val);
+  else
+    iowrite32(val, dev->bar0 + offset);
+}
+
+/* 从硬件重新装载影子 (probe、第一个 open 和 RESET 时; FPGA 可能被重新加载过) */
+static void reg_shadow_load(struct video_cap_dev *dev) {
+  spin_lock(&dev->lock);
+  WRITE_ONCE(dev->shadow[SHADOW_CONTROL], ioread32(dev->bar0 + REG_CONTROL));
+  WRITE_ONCE(dev->shadow[SHADOW_IRQ_MASK], ioread32(dev->bar0 + REG_IRQ_MASK));
+  WRITE_ONCE(dev->shadow[SHADOW_VID_FORMAT],
+             ioread32(dev->bar0 + REG_VID_FORMAT));
+  spin_unlock(&dev->lock);
+}
+
+/*
+ * 批量寄存器访问: 先整体校验偏移, 再逐项执行
+ */
+static int video_cap_reg_batch(struct video_cap_dev *dev, unsigned long arg,
+                               bool write) {
+  struct video_cap_reg_batch batch;
+  struct video_cap_reg *regs;
+  struct video_cap_reg __user *uregs;
+  size_t len;
+  u32 i;
+  int ret = 0;
+
+  if (copy_from_user(&batch, (void __user *)arg, sizeof(batch)))
+    return -EFAULT;
+  if (!batch.count)
+    return 0;
+  if (batch.count > VIDEO_CAP_REG_BATCH_MAX)
+    return -EINVAL;
+
+  uregs = u64_to_user_ptr(batch.regs);
+  len = batch.count * sizeof(*regs);
+  regs = kmalloc(len, GFP_KERNEL);
+  if (!regs)
+    return -ENOMEM;
+
+  if (copy_from_user(regs, uregs, len)) {
+    ret = -EFAULT;
+    goto out;
+  }
+
+  for (i = 0; i < batch.count; i++) {
+    if (regs[i].offset >= dev->bar0_len || (regs[i].offset & 3)) {
+      ret = -EINVAL;
+      goto out;
+    }
+  }
+
+  for (i = 0; i < batch.count; i++) {
+    if (write)
+      reg_write(dev, regs[i].offset, regs[i].value);
+    else
+      regs[i].value = reg_read(dev, regs[i].offset);
+  }
+
+  if (!write && copy_to_user(uregs, regs, len))
+    ret = -EFAULT;
+
+out:
+  kfree(regs);
+  return ret;
+}
+
+static inline u32 dma_reg_read(struct video_cap_dev *dev, u32 offset) {
+  return ioread32(dev->dma_regs + offset);
+}
+
+static inline void dma_reg_write(struct video_cap_dev *dev, u32 offset,
+                                 u32 val) {
+  iowrite32(val, dev->dma_regs + offset);
+}
+
+/*
+ * 帧缓冲环
+ */
+static void video_cap_buf_free(struct device *d, struct video_cap_buf *b) {
+  unsigned int i;
+
+  if (b->nents)
+    dma_unmap_sg(d, b->sgt.sgl, b->sgt.orig_nents, DMA_FROM_DEVICE);
+  b->nents = 0;
+  sg_free_table(&b->sgt);
+
+  /* 仍被用户 mmap 着的页由映射持有引用, 这里只放掉驱动自己的那份 */
+  for (i = 0; i < b->npages; i++)
+    __free_page(b->pages[i]);
+  kvfree(b->pages);
+  b->pages = NULL;
+  b->npages = 0;
+}
+
+/* 尽量按大块分配, 失败时逐级减半直到单页 */
+static int video_cap_buf_alloc(struct device *d, struct video_cap_buf *b) {
+  unsigned int n = DMA_BUFFER_SIZE >> PAGE_SHIFT;
+  unsigned int order = VIDEO_CAP_CHUNK_ORDER;
+  unsigned int k;
+  int ret;
+
+  b->pages = kvcalloc(n, sizeof(*b->pages), GFP_KERNEL);
+  if (!b->pages)
+    return -ENOMEM;
+
+  while (b->npages < n) {
+    struct page *p;
+
+    order = min_t(unsigned int, order, ilog2(n - b->npages));
+    p = alloc_pages(GFP_KERNEL | __GFP_ZERO |
+                        (order ? __GFP_NORETRY | __GFP_NOWARN : 0),
+                    order);
+    if (!p) {
+      if (!order)
+        return -ENOMEM;
+      order--;
+      continue;
+    }
+
+    split_page(p, order);
+    for (k = 0; k < (1U << order); k++)
+      b->pages[b->npages++] = p + k;
+  }
+
+  ret = sg_alloc_table_from_pages(&b->sgt, b->pages, n, 0, DMA_BUFFER_SIZE,
+                                  GFP_KERNEL);
+  if (ret)
+    return ret;
+
+  b->nents = dma_map_sg(d, b->sgt.sgl, b->sgt.orig_nents, DMA_FROM_DEVICE);
+  if (!b->nents)
+    return -ENOMEM;
+  return 0;
+}
+
+static void video_cap_ring_free(struct video_cap_dev *dev) {
+  struct device *d = &dev->pdev->dev;
+  int i;
+
+  if (dev->desc)
+    dma_free_coherent(d, dev->desc_max * sizeof(*dev->desc), dev->desc,
+                      dev->desc_dma);
+  dev->desc = NULL;
+
+  if (dev->result)
+    dma_free_coherent(d, dev->desc_max * sizeof(*dev->result), dev->result,
+                      dev->result_dma);
+  dev->result = NULL;
+
+  for (i = 0; i < DMA_BUFFER_COUNT; i++)
+    video_cap_buf_free(d, &dev->buf[i]);
+  dev->desc_max = 0;
+}
+
+/* 首次 START/mmap 时分配, 之后一直保留到设备移除 (持 dev->mutex) */
+static int video_cap_ring_alloc(struct video_cap_dev *dev) {
+  struct device *d = &dev->pdev->dev;
+  int i, ret;
+
+  if (dev->desc)
+    return 0;
+
+  for (i = 0; i < DMA_BUFFER_COUNT; i++) {
+    ret = video_cap_buf_alloc(d, &dev->buf[i]);
+    if (ret)
+      goto fail;
+    dev->desc_max += dev->buf[i].nents;
+  }
+
+  ret = -ENOMEM;
+  dev->result = dma_alloc_coherent(d, dev->desc_max * sizeof(*dev->result),
+                                   &dev->result_dma, GFP_KERNEL);
+  if (!dev->result)
+    goto fail;
+
+  dev->desc = dma_alloc_coherent(d, dev->desc_max * sizeof(*dev->desc),
+                                 &dev->desc_dma, GFP_KERNEL);
+  if (!dev->desc)
+    goto fail;
+
+  dev_info(d, "DMA ring: %d x %d bytes, %u chunks\n", DMA_BUFFER_COUNT,
+           DMA_BUFFER_SIZE, dev->desc_max);
+  return 0;
+
+fail:
+  dev_err(d, "Failed to allocate %d x %d byte DMA ring (%d)\n",
+          DMA_BUFFER_COUNT, DMA_BUFFER_SIZE, ret);
+  video_cap_ring_free(dev);
+  return ret;
+}
+
+/*
+ * 描述符环: 每个缓冲区按块各若干个描述符, 只覆盖 frame_size 字节, 最后一个指回
+ * 第一个, 引擎循环写入不停止; 每个缓冲区的最后一个描述符带 COMPLETED (一帧一次
+ * 中断)。C2H 流遇到 TLAST(EOP) 提前结束当前描述符, 实际长度在写回结果里。
+ */
+static void video_cap_ring_setup(struct video_cap_dev *dev) {
+  u32 i, j = 0;
+
+  for (i = 0; i < DMA_BUFFER_COUNT; i++) {
+    struct video_cap_buf *b = &dev->buf[i];
+    u32 left = dev->fmt.frame_size;
+    struct scatterlist *sg;
+    int k;
+
+    for_each_sg(b->sgt.sgl, sg, b->nents, k) {
+      struct xdma_desc *d = &dev->desc[j];
+      dma_addr_t res = dev->result_dma + j * sizeof(*dev->result);
+      u32 len = min_t(u32, sg_dma_len(sg), left);
+
+      d->control = cpu_to_le32(XDMA_DESC_MAGIC);
+      d->bytes = cpu_to_le32(len);
+      d->src_lo = cpu_to_le32(lower_32_bits(res));
+      d->src_hi = cpu_to_le32(upper_32_bits(res));
+      d->dst_lo = cpu_to_le32(lower_32_bits(sg_dma_address(sg)));
+      d->dst_hi = cpu_to_le32(upper_32_bits(sg_dma_address(sg)));
+      j++;
+
+      left -= len;
+      if (!left)
+        break;
+    }
+
+    b->desc_last = j - 1;
+    dev->desc[j - 1].control |= cpu_to_le32(XDMA_DESC_COMPLETED);
+  }
+  dev->desc_total = j;
+
+  for (i = 0; i < j; i++) {
+    dma_addr_t next = dev->desc_dma + ((i + 1) % j) * sizeof(*dev->desc);
+
+    dev->desc[i].next_lo = cpu_to_le32(lower_32_bits(next));
+    dev->desc[i].next_hi = cpu_to_le32(upper_32_bits(next));
+  }
+
+  memset(dev->result, 0, dev->desc_max * sizeof(*dev->result));
+  wmb();
+}
+
+/*
+ * 一个缓冲区写完: 按累计的长度/错误发布为最新帧, 更新统计 (中断上下文)
+ */
+static void video_cap_slot_done(struct video_cap_dev *dev,
+                                struct video_cap_pcpu_stats *st, u64 now) {
+  struct video_cap_latest *l = &dev->latest;
+  u32 len = dev->frame_len, flags = FRAME_FLAG_TIMESTAMP;
+  u64 period = l->period_ns;
+
+  /* 没有 EOP (帧比缓冲区大) 或长度不对 (丢行/错位): 数据不完整 */
+  if (dev->frame_err || len != dev->fmt.frame_size)
+    flags |= FRAME_FLAG_ERROR;
+
+  st->frames_captured++;
+  st->bytes_transferred += len;
+
+  /* 上一帧还没被 GET_FRAME 取走就被这一帧取代 */
+  if (l->frames && l->frames != READ_ONCE(dev->consumed))
+    st->frames_dropped++;
+
+  if (l->frames && now > l->timestamp) {
+    u64 delta = now - l->timestamp;
+
+    period = period ? period - (period >> 3) + (delta >> 3) : delta;
+  }
+
+  write_seqcount_begin(&l->seq);
+  l->frames++;
+  l->index = dev->cur_slot;
+  l->size = len;
+  l->flags = flags;
+  l->timestamp = now;
+  l->period_ns = period;
+  write_seqcount_end(&l->seq);
+
+  dev->cur_slot = (dev->cur_slot + 1) % DMA_BUFFER_COUNT;
+  dev->frame_len = 0;
+  dev->frame_err = false;
+}
+
+/*
+ * 一个描述符完成: 检查写回结果 (中断上下文)。返回 false 表示 EOP 落在缓冲区中间:
+ * 引擎已经把下一帧写进这个缓冲区剩下的描述符, 之后每帧都会错位, 交给 resync_work
+ */
+static bool video_cap_desc_done(struct video_cap_dev *dev,
+                                struct video_cap_pcpu_stats *st, u64 now) {
+  struct xdma_c2h_result *res = &dev->result[dev->desc_pos];
+  bool last = dev->desc_pos == dev->buf[dev->cur_slot].desc_last;
+  u32 status, len;
+
+  dma_rmb();
+  status = le32_to_cpu(READ_ONCE(res->status));
+  len = le32_to_cpu(READ_ONCE(res->length));
+  WRITE_ONCE(res->status, 0);
+
+  if ((status & XDMA_ID_MASK) != XDMA_RESULT_MAGIC)
+    dev->frame_err = true;
+  dev->frame_len += len;
+  dev->desc_pos = (dev->desc_pos + 1) % dev->desc_total;
+
+  if (last) {
+    if (!(status & XDMA_RESULT_EOP))
+      dev->frame_err = true;
+    video_cap_slot_done(dev, st, now);
+    return true;
+  }
+  if (!(status & XDMA_RESULT_EOP))
+    return true;
+
+  video_cap_slot_done(dev, st, now);
+  WRITE_ONCE(dev->resync, true);
+  schedule_work(&dev->resync_work);
+  return false;
+}
+
+/*
+ * 中断处理: 读清 C2H 通道状态, 按已完成描述符计数推进环
+ */
+static irqreturn_t video_cap_irq(int irq, void *data) {
+  struct video_cap_dev *dev = data;
+  struct video_cap_pcpu_stats *st;
+  u32 status, done, fifo, n;
+  u64 now = ktime_get_ns();
+
+  status = dma_reg_read(dev, XDMA_C2H_CHANNEL_OFFSET + XDMA_CH_STATUS_RC);
+  if (!READ_ONCE(dev->streaming))
+    return status ? IRQ_HANDLED : IRQ_NONE;
+
+  st = this_cpu_ptr(dev->stats);
+  u64_stats_update_begin(&st->syncp);
+
+  /* 出错时引擎停在当前描述符, 需要 STOP/START 恢复 */
+  if (status & XDMA_STS_ERROR_MASK) {
+    st->dma_errors++;
+    dev_err_ratelimited(&dev->pdev->dev, "C2H engine error, status 0x%08x\n",
+                        status);
+  }
+
+  /* FPGA FIFO 溢出/欠流 (RW1C, 每次事件计一次) */
+  fifo = reg_read(dev, REG_IRQ_STATUS) & (IRQ_OVERFLOW | IRQ_UNDERFLOW);
+  if (fifo) {
+    if (fifo & IRQ_OVERFLOW)
+      st->overflow_count++;
+    if (fifo & IRQ_UNDERFLOW)
+      st->underflow_count++;
+    reg_write(dev, REG_IRQ_STATUS, fifo);
+  }
+
+  /* 环在重建或已错位, 等 resync_work 停下引擎重新开始 */
+  if (READ_ONCE(dev->resync))
+    goto out;
+  smp_rmb(); /* 与 video_cap_hw_start 的 smp_wmb 配对 */
+
+  done = dma_reg_read(dev, XDMA_C2H_CHANNEL_OFFSET + XDMA_CH_COMPLETED);
+  n = done - dev->completed;
+  dev->completed = done;
+
+  /* 中断晚了一圈以上: 被覆盖的描述符不看写回结果, 其间结束的帧只占序号、计丢帧 */
+  for (; n > dev->desc_total; n--) {
+    if (dev->desc_pos == dev->buf[dev->cur_slot].desc_last) {
+      st->frames_dropped++;
+      write_seqcount_begin(&dev->latest.seq);
+      dev->latest.frames++;
+      write_seqcount_end(&dev->latest.seq);
+      dev->cur_slot = (dev->cur_slot + 1) % DMA_BUFFER_COUNT;
+      dev->frame_len = 0;
+      dev->frame_err = false;
+    }
+    dev->desc_pos = (dev->desc_pos + 1) % dev->desc_total;
+  }
+
+  while (n--) {
+    if (!video_cap_desc_done(dev, st, now))
+      break;
+  }
+
+out:
+  u64_stats_update_end(&st->syncp);
+
+  wake_up_interruptible(&dev->frame_wq);
+  return IRQ_HANDLED;
+}
+
+/*
+ * 停 FPGA 视频流和 C2H 引擎 (持 dev->mutex)
+ */
+static void video_cap_hw_stop(struct video_cap_dev *dev) {
+  int i;
+
+  /* 先停 FPGA 视频流, 再停引擎 */
+  reg_update(dev, REG_CONTROL, CTRL_ENABLE, 0);
+  dma_reg_write(dev, XDMA_C2H_CHANNEL_OFFSET + XDMA_CH_CONTROL, 0);
+  for (i = 0; i < 100; i++) {
+    if (!(dma_reg_read(dev, XDMA_C2H_CHANNEL_OFFSET + XDMA_CH_STATUS) &
+          XDMA_STS_BUSY))
+      break;
+    usleep_range(100, 200);
+  }
+  if (i == 100)
+    dev_warn(&dev->pdev->dev, "C2H engine still busy after stop\n");
+}
+
+/*
+ * 按当前帧长重建描述符环, 从第一个缓冲区开始运行 C2H 通道0, 再打开 FPGA 视频流
+ * (持 dev->mutex, 引擎已停); bridge 在下一个 SOF 对齐, 第一帧从缓冲区开头写起
+ */
+static void video_cap_hw_start(struct video_cap_dev *dev) {
+  u32 ch = XDMA_C2H_CHANNEL_OFFSET;
+
+  WRITE_ONCE(dev->resync, true);
+  video_cap_ring_setup(dev);
+  dev->completed = 0;
+  dev->desc_pos = 0;
+  dev->cur_slot = 0;
+  dev->frame_len = 0;
+  dev->frame_err = false;
+
+  dma_reg_write(dev, ch + XDMA_CH_CONTROL, 0);
+  dma_reg_read(dev, ch + XDMA_CH_STATUS_RC);
+  dma_reg_write(dev, XDMA_SGDMA_C2H_OFFSET + XDMA_SGDMA_DESC_LO,
+                lower_32_bits(dev->desc_dma));
+  dma_reg_write(dev, XDMA_SGDMA_C2H_OFFSET + XDMA_SGDMA_DESC_HI,
+                upper_32_bits(dev->desc_dma));
+  dma_reg_write(dev, XDMA_SGDMA_C2H_OFFSET + XDMA_SGDMA_DESC_ADJ, 0);
+  dma_reg_write(dev, ch + XDMA_CH_INT_ENABLE, XDMA_CH_IE_MASK);
+
+  /* RUN 上升沿清零已完成描述符计数, 之后中断才能按 0 起算 */
+  dma_reg_write(dev, ch + XDMA_CH_CONTROL, XDMA_CTRL_RUN | XDMA_CH_IE_MASK);
+  smp_wmb();
+  WRITE_ONCE(dev->resync, false);
+
+  /* 最后打开 FPGA 视频流, 保留用户设置的测试模式等位 */
+  reg_update(dev, REG_CONTROL, 0, CTRL_ENABLE);
+}
+
+/*
+ * 帧比描述符短 (丢行/bridge 重新对齐): 停下引擎, 从第一个缓冲区重新开始。
+ * 帧序号继续累加; 停下时还没写完的那一帧直接丢掉
+ */
+static void video_cap_resync_work(struct work_struct *work) {
+  struct video_cap_dev *dev =
+      container_of(work, struct video_cap_dev, resync_work);
+
+  mutex_lock(&dev->mutex);
+  if (dev->streaming && READ_ONCE(dev->resync)) {
+    dev_warn_ratelimited(&dev->pdev->dev,
+                         "short frame, restarting C2H ring\n");
+    video_cap_hw_stop(dev);
+    video_cap_hw_start(dev);
+  }
+  mutex_unlock(&dev->mutex);
+}
+
+/*
+ * 停止采集 (持 dev->mutex)
+ */
+static void video_cap_stop_locked(struct video_cap_dev *dev) {
+  if (!dev->streaming)
+    return;
+
+  video_cap_hw_stop(dev);
+  dma_reg_write(dev, XDMA_IRQ_OFFSET + XDMA_IRQ_CHANNEL_EN_W1C, ~0u);
+
+  WRITE_ONCE(dev->streaming, false);
+  synchronize_irq(dev->irq);
+  dev->owner = NULL;
+  wake_up_interruptible_all(&dev->frame_wq);
+}
+
+/*
+ * 开始采集: 描述符环挂上 C2H 通道0, 引擎循环运行直到 STOP
+ */
+static int video_cap_start(struct video_cap_dev *dev, struct file *file) {
+  int ret;
+
+  if (!dev->dma_regs || dev->irq < 0)
+    return -ENODEV;
+
+  mutex_lock(&dev->mutex);
+  if (dev->streaming) {
+    ret = -EBUSY;
+    goto out;
+  }
+
+  ret = video_cap_ring_alloc(dev);
+  if (ret)
+    goto out;
+
+  dev->consumed = 0;
+  dev->latest.frames = 0;
+  dev->latest.period_ns = 0;
+  dev->start_ns = ktime_get_ns();
+
+  /* 只有一个 MSI 向量: 所有通道中断都路由到向量0 */
+  dma_reg_write(dev, XDMA_IRQ_OFFSET + XDMA_IRQ_CHANNEL_VEC0, 0);
+  dma_reg_write(dev, XDMA_IRQ_OFFSET + XDMA_IRQ_CHANNEL_VEC1, 0);
+  dma_reg_write(dev, XDMA_IRQ_OFFSET + XDMA_IRQ_CHANNEL_EN_W1S, ~0u);
+
+  WRITE_ONCE(dev->streaming, true);
+  dev->owner = file;
+  video_cap_hw_start(dev);
+
+out:
+  mutex_unlock(&dev->mutex);
+  return ret;
+}
+
+/*
+ * 取最新完成的一帧 (比上次 GET_FRAME 返回的更新)
+ */
+static int video_cap_get_frame(struct video_cap_dev *dev, struct file *file,
+                               struct video_cap_frame *frame) {
+  struct video_cap_latest *l = &dev->latest;
+  unsigned int seq;
+  long ret;
+  u32 frames;
+
+  if (!READ_ONCE(dev->streaming))
+    return -EINVAL;
+
+  if (READ_ONCE(l->frames) == READ_ONCE(dev->consumed)) {
+    if (file->f_flags & O_NONBLOCK)
+      return -EAGAIN;
+
+    ret = wait_event_interruptible_timeout(
+        dev->frame_wq,
+        !READ_ONCE(dev->streaming) ||
+            READ_ONCE(l->frames) != READ_ONCE(dev->consumed),
+        HZ);
+    if (ret < 0)
+      return ret;
+    if (ret == 0)
+      return -ETIMEDOUT;
+    if (!READ_ONCE(dev->streaming))
+      return -EINVAL;
+  }
+
+  do {
+    seq = read_seqcount_begin(&l->seq);
+    frames = l->frames;
+    frame->index = l->index;
+    frame->size = l->size;
+    frame->flags = l->flags;
+    frame->timestamp = l->timestamp;
+  } while (read_seqcount_retry(&l->seq, seq));
+
+  frame->sequence = frames - 1;
+  WRITE_ONCE(dev->consumed, frames);
+
+  /* 流式映射: 交给用户前让 CPU 看到 DMA 写入的内容 (无 IOMMU 的 swiotlb 会在这里拷贝) */
+  dma_sync_sg_for_cpu(&dev->pdev->dev, dev->buf[frame->index].sgt.sgl,
+                      dev->buf[frame->index].sgt.orig_nents, DMA_FROM_DEVICE);
+  return 0;
+}
+
+/*
+ * 汇总每CPU统计
+ */
+static void video_cap_get_stats(struct video_cap_dev *dev,
+                                struct video_cap_stats *out) {
+  struct video_cap_latest *l = &dev->latest;
+  unsigned int seq;
+  u64 period;
+  int cpu;
+
+  memset(out, 0, sizeof(*out));
+
+  for_each_possible_cpu(cpu) {
+    struct video_cap_pcpu_stats *st = per_cpu_ptr(dev->stats, cpu);
+    u64 captured, dropped, bytes, errors, overflow, underflow;
+    unsigned int start;
+
+    do {
+      start = u64_stats_fetch_begin(&st->syncp);
+      captured = st->frames_captured;
+      dropped = st->frames_dropped;
+      bytes = st->bytes_transferred;
+      errors = st->dma_errors;
+      overflow = st->overflow_count;
+      underflow = st->underflow_count;
+    } while (u64_stats_fetch_retry(&st->syncp, start));
+
+    out->frames_captured += captured;
+    out->frames_dropped += dropped;
+    out->bytes_transferred += bytes;
+    out->dma_errors += errors;
+    out->overflow_count += overflow;
+    out->underflow_count += underflow;
+  }
+
+  if (!READ_ONCE(dev->streaming))
+    return;
+
+  do {
+    seq = read_seqcount_begin(&l->seq);
+    period = l->period_ns;
+  } while (read_seqcount_retry(&l->seq, seq));
+
+  if (period)
+    out->current_fps = div64_u64(100ULL * NSEC_PER_SEC, period);
+  out->uptime_seconds = div_u64(ktime_get_ns() - dev->start_ns, NSEC_PER_SEC);
+}
+
+/*
+ * 设置格式: FPGA 时序固定 1080p60, 只能选像素格式 (停止时)
+ */
+static int video_cap_set_format(struct video_cap_dev *dev,
+                                struct video_cap_format *f) {
+  u32 bpp, vid_fmt;
+  int ret = 0;
+
+  switch (f->pixel_format) {
+  case V4L2_PIX_FMT_XBGR32:
+    bpp = 4;
+    vid_fmt = VID_FMT_RGB888;
+    break;
+  case V4L2_PIX_FMT_YUYV:
+    bpp = VIDEO_BYTES_PER_PIXEL_YUV;
+    vid_fmt = VID_FMT_YUV422;
+    break;
+  default:
+    return -EINVAL;
+  }
+
+  if (f->width != VIDEO_WIDTH_1080P || f->height != VIDEO_HEIGHT_1080P)
+    return -EINVAL;
+
+  mutex_lock(&dev->mutex);
+  if (dev->streaming) {
+    ret = -EBUSY;
+    goto out;
+  }
+
+  f->bytes_per_line = f->width * bpp;
+  f->frame_size = f->bytes_per_line * f->height;
+  f->frame_rate = VIDEO_FRAME_RATE_60 * 100;
+  dev->fmt = *f;
+  reg_write(dev, REG_VID_FORMAT, vid_fmt);
+
+out:
+  mutex_unlock(&dev->mutex);
+  return ret;
 }
 
 /*
@@ -111,6 +905,11 @@ static long video_cap_ioctl(struct file *file, unsigned int cmd,
     info.max_width = VIDEO_WIDTH_1080P;
     info.max_height = VIDEO_HEIGHT_1080P;
     info.capabilities = CAP_VIDEO_CAPTURE | CAP_READ_WRITE;
+    if (dev->dma_regs && dev->irq >= 0) {
+      info.capabilities |= CAP_STREAMING;
+      info.dma_buffer_size = DMA_BUFFER_SIZE;
+      info.dma_buffer_count = DMA_BUFFER_COUNT;
+    }
 
     if (copy_to_user((void __user *)arg, &info, sizeof(info)))
       return -EFAULT;
@@ -147,13 +946,75 @@ static long video_cap_ioctl(struct file *file, unsigned int cmd,
     break;
   }
 
+  case VIDEO_CAP_READ_REGS:
+    ret = video_cap_reg_batch(dev, arg, false);
+    break;
+
+  case VIDEO_CAP_WRITE_REGS:
+    ret = video_cap_reg_batch(dev, arg, true);
+    break;
+
   case VIDEO_CAP_RESET: {
     /* FPGA 软复位 */
-    u32 ctrl = reg_read(dev, REG_CONTROL);
-    reg_write(dev, REG_CONTROL, ctrl | CTRL_SOFT_RESET);
+    reg_update(dev, REG_CONTROL, 0, CTRL_SOFT_RESET);
 
     /* 等待复位清除 (FPGA内自动清除) */
     udelay(10);
+    reg_shadow_load(dev);
+    break;
+  }
+
+  case VIDEO_CAP_START:
+    ret = video_cap_start(dev, file);
+    break;
+
+  case VIDEO_CAP_STOP:
+    mutex_lock(&dev->mutex);
+    video_cap_stop_locked(dev);
+    mutex_unlock(&dev->mutex);
+    break;
+
+  case VIDEO_CAP_GET_FRAME: {
+    struct video_cap_frame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    ret = video_cap_get_frame(dev, file, &frame);
+    if (ret)
+      return ret;
+
+    if (copy_to_user((void __user *)arg, &frame, sizeof(frame)))
+      return -EFAULT;
+    break;
+  }
+
+  case VIDEO_CAP_SET_FORMAT: {
+    struct video_cap_format fmt;
+
+    if (copy_from_user(&fmt, (void __user *)arg, sizeof(fmt)))
+      return -EFAULT;
+
+    ret = video_cap_set_format(dev, &fmt);
+    break;
+  }
+
+  case VIDEO_CAP_GET_FORMAT: {
+    struct video_cap_format fmt;
+
+    mutex_lock(&dev->mutex);
+    fmt = dev->fmt;
+    mutex_unlock(&dev->mutex);
+
+    if (copy_to_user((void __user *)arg, &fmt, sizeof(fmt)))
+      return -EFAULT;
+    break;
+  }
+
+  case VIDEO_CAP_GET_STATS: {
+    struct video_cap_stats stats;
+
+    video_cap_get_stats(dev, &stats);
+    if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+      return -EFAULT;
     break;
   }
 
@@ -169,20 +1030,30 @@ static long video_cap_ioctl(struct file *file, unsigned int cmd,
  */
 static int video_cap_open(struct inode *inode, struct file *file) {
   struct video_cap_dev *dev;
+  bool first;
 
   dev = container_of(inode->i_cdev, struct video_cap_dev, cdev);
   file->private_data = dev;
 
   spin_lock(&dev->lock);
-  dev->usage_count++;
+  first = !dev->usage_count++;
   spin_unlock(&dev->lock);
 
+  if (first)
+    reg_shadow_load(dev);
+
   return 0;
 }
 
 static int video_cap_release(struct inode *inode, struct file *file) {
   struct video_cap_dev *dev = file->private_data;
 
+  /* START 的文件关闭时自动停止 */
+  mutex_lock(&dev->mutex);
+  if (dev->owner == file)
+    video_cap_stop_locked(dev);
+  mutex_unlock(&dev->mutex);
+
   spin_lock(&dev->lock);
   dev->usage_count--;
   spin_unlock(&dev->lock);
@@ -190,13 +1061,162 @@ static int video_cap_release(struct inode *inode, struct file *file) {
   return 0;
 }
 
+/*
+ * mmap (只读):
+ * - 帧缓冲区: offset = VIDEO_CAP_MMAP_OFFSET(i), 每个单独映射
+ * - 用户寄存器窗口: offset = VIDEO_CAP_MMAP_REGS_OFFSET, 非缓存映射 BAR0
+ */
+static int video_cap_mmap(struct file *file, struct vm_area_struct *vma) {
+  struct video_cap_dev *dev = file->private_data;
+  unsigned long buf_pages = DMA_BUFFER_SIZE >> PAGE_SHIFT;
+  unsigned long idx = vma->vm_pgoff / buf_pages;
+  unsigned long len = vma->vm_end - vma->vm_start;
+  int ret;
+
+  if (vma->vm_flags & VM_WRITE)
+    return -EPERM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+  vm_flags_clear(vma, VM_MAYWRITE);
+#else
+  vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+  if (vma->vm_pgoff == (VIDEO_CAP_MMAP_REGS_OFFSET >> PAGE_SHIFT)) {
+    vma->vm_pgoff = 0;
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+    return vm_iomap_memory(vma, pci_resource_start(dev->pdev, 0),
+                           dev->bar0_len);
+  }
+
+  if (!dev->dma_regs)
+    return -ENODEV;
+  if ((vma->vm_pgoff % buf_pages) || idx >= DMA_BUFFER_COUNT ||
+      len > DMA_BUFFER_SIZE)
+    return -EINVAL;
+
+  mutex_lock(&dev->mutex);
+  ret = video_cap_ring_alloc(dev);
+  mutex_unlock(&dev->mutex);
+  if (ret)
+    return ret;
+
+  vma->vm_pgoff = 0;
+  return vm_map_pages(vma, dev->buf[idx].pages, dev->buf[idx].npages);
+}
+
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = video_cap_open,
     .release = video_cap_release,
     .unlocked_ioctl = video_cap_ioctl,
+    .mmap = video_cap_mmap,
 };
 
+/*
+ * 流式采集资源: 每CPU统计, XDMA 配置 BAR, MSI 中断
+ * 找不到 XDMA 配置 BAR 或中断不可用时只保留寄存器访问, START 返回 ENODEV
+ */
+static int video_cap_stream_init(struct video_cap_dev *dev) {
+  struct pci_dev *pdev = dev->pdev;
+  int bar, ret, cpu;
+
+  mutex_init(&dev->mutex);
+  init_waitqueue_head(&dev->frame_wq);
+  INIT_WORK(&dev->resync_work, video_cap_resync_work);
+  seqcount_init(&dev->latest.seq);
+  dev->irq = -1;
+
+  dev->fmt.width = VIDEO_WIDTH_1080P;
+  dev->fmt.height = VIDEO_HEIGHT_1080P;
+  dev->fmt.pixel_format = V4L2_PIX_FMT_XBGR32;
+  dev->fmt.bytes_per_line = VIDEO_WIDTH_1080P * 4;
+  dev->fmt.frame_size = dev->fmt.bytes_per_line * VIDEO_HEIGHT_1080P;
+  dev->fmt.frame_rate = VIDEO_FRAME_RATE_60 * 100;
+
+  dev->stats = alloc_percpu(struct video_cap_pcpu_stats);
+  if (!dev->stats)
+    return -ENOMEM;
+  for_each_possible_cpu(cpu) {
+    u64_stats_init(&per_cpu_ptr(dev->stats, cpu)->syncp);
+  }
+
+  if (dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(64)) &&
+      dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(32))) {
+    dev_warn(&pdev->dev, "No usable DMA mask, streaming disabled\n");
+    return 0;
+  }
+
+  /* XDMA 配置 BAR: IRQ 块和 CONFIG 块 identifier 都匹配 (BAR0 固定是用户寄存器) */
+  for (bar = 1; bar < PCI_STD_NUM_BARS; bar++) {
+    void __iomem *base;
+
+    if (!(pci_resource_flags(pdev, bar) & IORESOURCE_MEM) ||
+        pci_resource_len(pdev, bar) <= XDMA_SGDMA_C2H_OFFSET)
+      continue;
+
+    base = pci_iomap(pdev, bar, 0);
+    if (!base)
+      continue;
+
+    if ((ioread32(base + XDMA_IRQ_OFFSET) & XDMA_ID_MASK) ==
+            XDMA_IRQ_BLOCK_ID &&
+        (ioread32(base + XDMA_CONFIG_OFFSET) & XDMA_ID_MASK) ==
+            XDMA_CONFIG_BLOCK_ID) {
+      dev->dma_regs = base;
+      break;
+    }
+    pci_iounmap(pdev, base);
+  }
+
+  if (!dev->dma_regs) {
+    dev_warn(&pdev->dev, "XDMA config BAR not found, streaming disabled\n");
+    return 0;
+  }
+  dev_info(&pdev->dev, "XDMA config BAR%d\n", bar);
+
+  ret = pci_alloc_irq_vectors(pdev, 1, 1, PCI_IRQ_MSI);
+  if (ret < 0) {
+    dev_warn(&pdev->dev, "MSI unavailable (%d), streaming disabled\n", ret);
+    return 0;
+  }
+
+  ret = request_irq(pci_irq_vector(pdev, 0), video_cap_irq, 0, DRIVER_NAME,
+                    dev);
+  if (ret) {
+    dev_warn(&pdev->dev, "request_irq failed (%d), streaming disabled\n",
+             ret);
+    pci_free_irq_vectors(pdev);
+    return 0;
+  }
+  dev->irq = pci_irq_vector(pdev, 0);
+
+  return 0;
+}
+
+static void video_cap_stream_exit(struct video_cap_dev *dev) {
+  struct pci_dev *pdev = dev->pdev;
+
+  if (dev->irq >= 0) {
+    mutex_lock(&dev->mutex);
+    video_cap_stop_locked(dev);
+    mutex_unlock(&dev->mutex);
+    cancel_work_sync(&dev->resync_work);
+
+    free_irq(dev->irq, dev);
+    pci_free_irq_vectors(pdev);
+    dev->irq = -1;
+  }
+
+  video_cap_ring_free(dev);
+
+  if (dev->dma_regs)
+    pci_iounmap(pdev, dev->dma_regs);
+  dev->dma_regs = NULL;
+
+  free_percpu(dev->stats);
+  dev->stats = NULL;
+}
+
 /*
  * PCIe 探测函数
  */
@@ -204,7 +1224,7 @@ static int video_cap_probe(struct pci_dev *pdev,
                            const struct pci_device_id *id) {
   struct video_cap_dev *dev;
   int ret;
-  int bar = 0; /* XDMA 使用 BAR0 用于 AXI-Lite 和 DMA 控制 */
+  int bar = 0; /* BAR0: 用户寄存器 (AXI-Lite), DMA 控制在 XDMA 配置 BAR */
 
   dev_info(&pdev->dev, "Probing Video Capture Device\n");
 
@@ -247,12 +1267,19 @@ static int video_cap_probe(struct pci_dev *pdev,
 
   dev_info(&pdev->dev, "BAR0 mapped at %p (length %lu)\n", dev->bar0,
            dev->bar0_len);
+  reg_shadow_load(dev);
+
+  ret = video_cap_stream_init(dev);
+  if (ret) {
+    dev_err(&pdev->dev, "Failed to init streaming\n");
+    goto stream_exit;
+  }
 
   /* 初始化字符设备 */
   ret = alloc_chrdev_region(&dev->dev_num, 0, 1, DRIVER_NAME);
   if (ret < 0) {
     dev_err(&pdev->dev, "Failed to allocate major number\n");
-    goto unmap_bar;
+    goto stream_exit;
   }
 
   major_number = MAJOR(dev->dev_num);
@@ -286,7 +1313,8 @@ del_cdev:
   cdev_del(&dev->cdev);
 unregister_chrdev:
   unregister_chrdev_region(dev->dev_num, 1);
-unmap_bar:
+stream_exit:
+  video_cap_stream_exit(dev);
   pci_iounmap(pdev, dev->bar0);
 release_regions:
   pci_release_regions(pdev);
@@ -307,6 +1335,8 @@ static void video_cap_remove(struct pci_dev *pdev) {
     cdev_del(&dev->cdev);
     unregister_chrdev_region(dev->dev_num, 1);
 
+    video_cap_stream_exit(dev);
+
     if (dev->bar0)
       pci_iounmap(pdev, dev->bar0);
 
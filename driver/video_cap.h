@@ -39,9 +39,21 @@ typedef uint64_t __u64;
  * DMA缓冲区配置
  */
 #define DMA_BUFFER_COUNT 4                /* DMA缓冲区数量 (双缓冲/三缓冲) */
-#define DMA_BUFFER_SIZE (8 * 1024 * 1024) /* 每个缓冲区8MB (> 1080p RGB帧) */
+#define DMA_BUFFER_SIZE (8 * 1024 * 1024) /* 每个缓冲区8MB (> 1080p RGB帧), 由页块拼成 */
 #define DMA_ALIGNMENT 4096                /* 页面对齐 */
 
+/*
+ * 帧缓冲 mmap: 第 i 个缓冲区用 offset = VIDEO_CAP_MMAP_OFFSET(i) 单独映射 (只读),
+ * 长度不超过 DMA_BUFFER_SIZE。缓冲区在首次 START/mmap 时分配, 直到设备移除才释放。
+ */
+#define VIDEO_CAP_MMAP_OFFSET(i) ((__u64)(i) * DMA_BUFFER_SIZE)
+
+/*
+ * 用户寄存器窗口 (BAR0) 只读 mmap: 紧跟帧缓冲之后, 长度不超过 bar0_size,
+ * 用于高频采样 STATUS 等只读寄存器 (读 IRQ_STATUS 之类无副作用)
+ */
+#define VIDEO_CAP_MMAP_REGS_OFFSET VIDEO_CAP_MMAP_OFFSET(DMA_BUFFER_COUNT)
+
 /*
  * IOCTL 接口定义
  */
@@ -60,13 +72,19 @@ typedef uint64_t __u64;
 /* 写寄存器 */
 #define VIDEO_CAP_WRITE_REG _IOW(VIDEO_CAP_MAGIC, 0x11, struct video_cap_reg)
 
+/* 批量读/写寄存器 (一次最多 VIDEO_CAP_REG_BATCH_MAX 个, 任一偏移非法则都不执行) */
+#define VIDEO_CAP_READ_REGS                                                    \
+  _IOW(VIDEO_CAP_MAGIC, 0x12, struct video_cap_reg_batch)
+#define VIDEO_CAP_WRITE_REGS                                                   \
+  _IOW(VIDEO_CAP_MAGIC, 0x13, struct video_cap_reg_batch)
+
 /* 开始采集 */
 #define VIDEO_CAP_START _IO(VIDEO_CAP_MAGIC, 0x20)
 
 /* 停止采集 */
 #define VIDEO_CAP_STOP _IO(VIDEO_CAP_MAGIC, 0x21)
 
-/* 获取帧 (阻塞) */
+/* 获取帧 (阻塞, O_NONBLOCK 时无新帧返回 EAGAIN, 1s 无帧返回 ETIMEDOUT) */
 #define VIDEO_CAP_GET_FRAME _IOR(VIDEO_CAP_MAGIC, 0x22, struct video_cap_frame)
 
 /* 设置视频格式 */
@@ -115,6 +133,20 @@ struct video_cap_reg {
   __u32 value;
 };
 
+/*
+ * regs 指向用户态 struct video_cap_reg[count]; READ_REGS 回填各项 value,
+ * WRITE_REGS 按数组顺序写入。CONTROL/IRQ_MASK/VID_FORMAT (含通道0窗口的
+ * 别名) 读的是驱动影子值。
+ */
+#define VIDEO_CAP_REG_BATCH_MAX 256
+
+struct video_cap_reg_batch {
+  __u64 regs; /* struct video_cap_reg * */
+  __u32 count;
+  __u32 reserved;
+};
+
+/* SET_FORMAT 仅在停止时允许; pixel_format 支持 XBGR32/YUYV, frame_size 由驱动计算 */
 struct video_cap_format {
   __u32 width;
   __u32 height;
@@ -124,14 +156,19 @@ struct video_cap_format {
   __u32 frame_rate; /* fps x 100 */
 };
 
+/*
+ * GET_FRAME 返回最新完成的一帧 (比上次 GET_FRAME 返回的更新);
+ * 环形缓冲由 DMA 连续循环写入, 该缓冲区在之后 DMA_BUFFER_COUNT - 1 帧内保持不变。
+ */
 struct video_cap_frame {
-  __u64 timestamp; /* 纳秒 */
-  __u32 sequence;  /* 帧序号 */
+  __u64 timestamp; /* 纳秒 (CLOCK_MONOTONIC, DMA 完成中断时刻) */
+  __u32 sequence;  /* 帧序号 (START 后从0开始) */
   __u32 size;      /* 实际数据大小 */
   __u32 flags;     /* 帧标志 */
-  __u32 reserved;
+  __u32 index;     /* 缓冲区索引 (0..DMA_BUFFER_COUNT-1) */
 };
 
+/* frames_dropped: 被更新的帧覆盖、从未被 GET_FRAME 取走的帧 */
 struct video_cap_stats {
   __u64 frames_captured;
   __u64 frames_dropped;
@@ -38,6 +38,10 @@
 #define REG_BUF_ADDR2 0x0208 /* RW: 帧缓存地址2 */
 #define REG_BUF_IDX 0x0210   /* RO: 当前缓存索引 */
 
+/* 每通道寄存器窗口: CH_BASE(ch) = 0x1000 + ch * 0x100; 通道0与上面的全局寄存器互为镜像 */
+#define REG_CH0_CONTROL 0x1000    /* RW: 同 REG_CONTROL */
+#define REG_CH0_VID_FORMAT 0x1004 /* RW: 同 REG_VID_FORMAT */
+
 /* 调试计数器 (未在当前FPGA中实现) */
 #define REG_DBG_PIXEL_COUNT 0x0300 /* RO: 像素计数 */
 #define REG_DBG_LINE_COUNT 0x0304  /* RO: 行计数 */
@@ -140,5 +144,60 @@
 #define XDMA_C2H_CHANNEL_OFFSET 0x00001000
 #define XDMA_H2C_CHANNEL_OFFSET 0x00000000
 #define XDMA_IRQ_OFFSET 0x00002000
+#define XDMA_CONFIG_OFFSET 0x00003000
+#define XDMA_SGDMA_C2H_OFFSET 0x00005000
+
+/*
+ * XDMA 配置 BAR 识别: IRQ/CONFIG 块 identifier 高16位
+ * (开了 AXI-Lite master 时配置 BAR 是 BAR1, 否则是 BAR0)
+ */
+#define XDMA_ID_MASK 0xFFFF0000
+#define XDMA_IRQ_BLOCK_ID 0x1FC20000
+#define XDMA_CONFIG_BLOCK_ID 0x1FC30000
+
+/* C2H 通道寄存器 (相对 XDMA_C2H_CHANNEL_OFFSET) */
+#define XDMA_CH_CONTROL 0x0004     /* RW: 通道控制 */
+#define XDMA_CH_STATUS 0x0040      /* RW1C: 通道状态 */
+#define XDMA_CH_STATUS_RC 0x0044   /* RC: 通道状态 (读清) */
+#define XDMA_CH_COMPLETED 0x0048   /* RO: 已完成描述符计数 (RUN 上升沿清零) */
+#define XDMA_CH_INT_ENABLE 0x0090  /* RW: 通道中断使能 */
+
+/* C2H SGDMA 寄存器 (相对 XDMA_SGDMA_C2H_OFFSET) */
+#define XDMA_SGDMA_DESC_LO 0x0080  /* RW: 首描述符总线地址低32位 */
+#define XDMA_SGDMA_DESC_HI 0x0084  /* RW: 首描述符总线地址高32位 */
+#define XDMA_SGDMA_DESC_ADJ 0x0088 /* RW: 相邻描述符数 */
+
+/* IRQ 块寄存器 (相对 XDMA_IRQ_OFFSET) */
+#define XDMA_IRQ_CHANNEL_EN_W1S 0x0014 /* W1S: 通道中断使能 */
+#define XDMA_IRQ_CHANNEL_EN_W1C 0x0018 /* W1C: 通道中断关闭 */
+#define XDMA_IRQ_CHANNEL_VEC0 0x00A0   /* RW: 通道 0..3 的 MSI 向量号 */
+#define XDMA_IRQ_CHANNEL_VEC1 0x00A4   /* RW: 通道 4..7 的 MSI 向量号 */
+
+/*
+ * XDMA_CH_CONTROL / XDMA_CH_STATUS 位定义 (两者位置一致)
+ */
+#define XDMA_CTRL_RUN (1 << 0)            /* 引擎运行 */
+#define XDMA_CTRL_IE_DESC_STOPPED (1 << 1) /* 描述符链停止 */
+#define XDMA_CTRL_IE_DESC_COMPLETED (1 << 2) /* 带 COMPLETED 的描述符完成 */
+#define XDMA_CTRL_IE_ALIGN_MISMATCH (1 << 3)
+#define XDMA_CTRL_IE_MAGIC_STOPPED (1 << 4)
+#define XDMA_CTRL_IE_READ_ERROR (0x1F << 9)
+#define XDMA_CTRL_IE_DESC_ERROR (0x1F << 19)
+#define XDMA_STS_BUSY (1 << 0)
+#define XDMA_STS_INVALID_LEN (1 << 5)
+#define XDMA_STS_ERROR_MASK                                                    \
+  (XDMA_CTRL_IE_ALIGN_MISMATCH | XDMA_CTRL_IE_MAGIC_STOPPED |                  \
+   XDMA_STS_INVALID_LEN | XDMA_CTRL_IE_READ_ERROR | XDMA_CTRL_IE_DESC_ERROR)
+
+/*
+ * XDMA 描述符 / C2H 流写回
+ */
+#define XDMA_DESC_MAGIC 0xAD4B0000 /* control 高16位 */
+#define XDMA_DESC_STOPPED (1 << 0)
+#define XDMA_DESC_COMPLETED (1 << 1) /* 完成时触发中断 */
+#define XDMA_DESC_EOP (1 << 4)
+#define XDMA_DESC_LEN_MAX 0x0FFFFFFF /* bytes 字段 28 位 */
+#define XDMA_RESULT_MAGIC 0x52B40000 /* 写回 status 高16位 */
+#define XDMA_RESULT_EOP (1 << 0)
 
 #endif /* __VIDEO_CAP_REGS_H__ */
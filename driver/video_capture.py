@@ -42,20 +42,19 @@ CTRL_ENABLE = 0x01
 CTRL_TEST_MODE = 0x04
 
 
-def write_reg_dd(offset, value):
-    """Write a 32-bit register using dd command"""
-    # Convert value to bytes (little-endian)
+_user_fd = None
+
+
+def write_reg(offset, value):
+    """Write a 32-bit register with pwrite() on a cached /dev/xdma0_user fd"""
+    global _user_fd
     data = value.to_bytes(4, byteorder='little')
-    
-    # Use dd to write
-    seek_blocks = offset // 4
-    cmd = f"dd of={USER_DEVICE} bs=4 seek={seek_blocks} count=1 2>/dev/null"
-    
+
     try:
-        proc = subprocess.Popen(cmd, shell=True, stdin=subprocess.PIPE)
-        proc.communicate(input=data)
-        return proc.returncode == 0
-    except Exception as e:
+        if _user_fd is None:
+            _user_fd = os.open(USER_DEVICE, os.O_RDWR)
+        return os.pwrite(_user_fd, data, offset) == 4
+    except OSError as e:
         print(f"Error writing register: {e}")
         return False
 
@@ -65,12 +64,12 @@ def enable_capture(test_mode=False):
     ctrl = CTRL_ENABLE
     if test_mode:
         ctrl |= CTRL_TEST_MODE
-    return write_reg_dd(REG_CONTROL, ctrl)
+    return write_reg(REG_CONTROL, ctrl)
 
 
 def disable_capture():
     """Disable video capture"""
-    return write_reg_dd(REG_CONTROL, 0)
+    return write_reg(REG_CONTROL, 0)
 
 
 def wait_for_interrupt(fd_event): 
@@ -20,6 +20,8 @@
 //
 // 注意：
 // - pack_word_last 仍保持“整帧最后一个 beat 才置位”的语义。
+// - 每帧行数取 frame_lines（video_timing_meas 测得的高度，SOF 时锁存）；
+//   为 0（无测量/未接）时退回 FRAME_LINES 参数。
 // - 为了让行尾/帧尾能落在 128-bit beat 边界，上游每行输出的 32-bit word 数应能被 4 整除。
 //   例如：RGB32: 1920 words/line；YUYV: 960 words/line，均满足。
 //------------------------------------------------------------------------------
@@ -45,6 +47,9 @@ module video_cap_c2h_bridge #(
     input  wire         ctrl_enable,
     input  wire         ctrl_soft_reset,
 
+    // 运行时帧行数（axi_aclk 域，准静态）；0 = 用 FRAME_LINES
+    input  wire [11:0]  frame_lines,
+
     // 来自视频源的 VSYNC（可能异步输入到 axi_aclk 域，由本模块内部同步）
     input  wire         vid_vsync,
 
@@ -179,7 +184,8 @@ module video_cap_c2h_bridge #(
     (* mark_debug="true" *) reg  sof_pending;
     (* mark_debug="true" *) reg  frame_in_progress;
     (* mark_debug="true" *) reg  first_frame_seen;
-    (* mark_debug="true" *) reg  [10:0] line_cnt;
+    (* mark_debug="true" *) reg  [11:0] line_cnt;
+    reg  [11:0] frame_lines_cur;   // 本帧行数，SOF 时锁存，帧中途不变
     wire out_path_idle;
 
     wire axis_pix_xfer = axis_pix_tvalid && axis_pix_tready;
@@ -191,14 +197,15 @@ module video_cap_c2h_bridge #(
             sof_pending       <= 1'b0;
             frame_in_progress <= 1'b0;
             first_frame_seen  <= 1'b0;
-            line_cnt          <= 11'd0;
+            line_cnt          <= 12'd0;
+            frame_lines_cur   <= FRAME_LINES;
         end else begin
             if (~ctrl_enable || ctrl_soft_reset || vid_fifo_overflow_axi || vid_fifo_underflow_axi) begin
                 capture_armed     <= 1'b0;
                 sof_pending       <= 1'b0;
                 frame_in_progress <= 1'b0;
                 first_frame_seen  <= 1'b0;
-                line_cnt          <= 11'd0;
+                line_cnt          <= 12'd0;
             end else begin
                 if (!frame_in_progress && !sof_pending) begin
                     capture_armed <= s_axis_c2h_tready && out_path_idle;
@@ -213,11 +220,12 @@ module video_cap_c2h_bridge #(
                 if (frame_start_pulse) begin
                     frame_in_progress <= 1'b1;
                     first_frame_seen  <= 1'b1;
-                    line_cnt          <= 11'd0;
+                    line_cnt          <= 12'd0;
+                    frame_lines_cur   <= (frame_lines != 12'd0) ? frame_lines : FRAME_LINES;
                     capture_armed     <= 1'b0;
                 end else if (frame_in_progress && axis_pix_tvalid && axis_pix_tready && axis_pix_tlast) begin
-                    if (line_cnt >= (FRAME_LINES - 1)) begin
-                        line_cnt          <= 11'd0;
+                    if (line_cnt >= (frame_lines_cur - 1)) begin
+                        line_cnt          <= 12'd0;
                         frame_in_progress <= 1'b0;
                     end else begin
                         line_cnt <= line_cnt + 1'b1;
@@ -281,7 +289,7 @@ module video_cap_c2h_bridge #(
 
     // pack：最新 word 放在最高 32bit，保证“低地址=更早数据”的顺序
     wire [127:0] pack_word_data = {axis_pix_tdata, word_buf[2], word_buf[1], word_buf[0]};
-    wire pack_word_last = axis_pix_tlast && (line_cnt == (FRAME_LINES - 1));
+    wire pack_word_last = axis_pix_tlast && (line_cnt == (frame_lines_cur - 1));
 
     assign c2h_bram_fifo_din   = {pack_word_last, pack_word_data};
     assign c2h_bram_fifo_wr_en = pack_word_fire && c2h_bram_fifo_wr_ready;
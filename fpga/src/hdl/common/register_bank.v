@@ -15,7 +15,8 @@
 //   0x0010 - IRQ_STATUS  (RW1C)
 //   0x0014 - CAPS        (RO)   capability / parameters
 //   0x0100 - VID_FMT     (RW)   legacy/global (mirrors CH0_VID_FORMAT)
-//   0x0104 - VID_RES     (RO)
+//   0x0104 - VID_RES     (RO)   measured {height, width}, 0 = no input
+//   0x0108 - VID_PERIOD  (RO)   measured frame period in us, 0 = no input
 //   0x0200 - BUF_ADDR0   (RW)
 //   0x0204 - BUF_ADDR1   (RW)
 //   0x0208 - BUF_ADDR2   (RW)
@@ -83,6 +84,10 @@ module register_bank #(
     input  wire         sts_fifo_overflow,
     input  wire         sts_pcie_link_up,
 
+    // measured input timing (video_timing_meas, AXI clock domain)
+    input  wire [31:0]  sts_vid_res,
+    input  wire [31:0]  sts_frame_period,
+
     // interrupts (placeholders; hook up later if needed)
     output wire         irq_frame_done,
     output wire         irq_error
@@ -99,6 +104,7 @@ module register_bank #(
     localparam [15:0] ADDR_CAPS       = 16'h0014;
     localparam [15:0] ADDR_VID_FMT    = 16'h0100;
     localparam [15:0] ADDR_VID_RES    = 16'h0104;
+    localparam [15:0] ADDR_VID_PERIOD = 16'h0108;
     localparam [15:0] ADDR_BUF_ADDR0  = 16'h0200;
     localparam [15:0] ADDR_BUF_ADDR1  = 16'h0204;
     localparam [15:0] ADDR_BUF_ADDR2  = 16'h0208;
@@ -112,7 +118,7 @@ module register_bank #(
     //--------------------------------------------------------------------------
     // Constants / defaults
     //--------------------------------------------------------------------------
-    localparam [31:0] VERSION         = 32'h20251221;
+    localparam [31:0] VERSION         = 32'h20260301;
     localparam [31:0] CONTROL_DEFAULT = 32'h0000_0005; // enable(bit0) + test(bit2)
     localparam [31:0] VID_FMT_DEFAULT = 32'd0;         // RGB888
 
@@ -474,7 +480,8 @@ module register_bank #(
                         ADDR_IRQ_STATUS: s_axil_rdata <= reg_irq_status;
                         ADDR_CAPS:       s_axil_rdata <= REG_CAPS_VALUE;
                         ADDR_VID_FMT:    s_axil_rdata <= reg_vid_format;
-                        ADDR_VID_RES:    s_axil_rdata <= {16'd1080, 16'd1920}; // fixed 1080P
+                        ADDR_VID_RES:    s_axil_rdata <= sts_vid_res;
+                        ADDR_VID_PERIOD: s_axil_rdata <= sts_frame_period;
                         ADDR_BUF_ADDR0:  s_axil_rdata <= reg_buf_addr0;
                         ADDR_BUF_ADDR1:  s_axil_rdata <= reg_buf_addr1;
                         ADDR_BUF_ADDR2:  s_axil_rdata <= reg_buf_addr2;
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Module: video_timing_meas
+// Description:
+//   输入视频时序测量：从 DE/VSYNC 统计有效宽度（每行 DE 高的像素数）、有效高度
+//   （每帧 DE 行数）和帧周期（us），给 register_bank 的 VID_RES / VID_PERIOD 用。
+//   驱动据此算 sizeimage，并在变化时发 V4L2_EVENT_SOURCE_CHANGE。
+//
+// 约定：
+// - 视频域：在 VSYNC 有效沿（VS_POL=1 为上升沿）锁存上一帧的宽/高，并翻转 meas_tgl；
+//   锁存值保持到下一帧，AXI 域看到 toggle 翻转后再采样，多 bit 数据不需要逐位同步
+// - AXI 域：两次 toggle 之间的 aclk 数经 CLK_PER_US 分频即帧周期（us）
+// - 超过 TIMEOUT_US 没有新帧（无输入/时钟停了）：宽/高/周期全部清 0，驱动读到 0 视为无信号
+// - 宽/高各 16 bit（VID_RES = {height, width}）；周期 32 bit
+//------------------------------------------------------------------------------
+`timescale 1ns / 1ps
+
+module video_timing_meas #(
+    parameter integer VS_POL     = 1,        // 1: VSYNC 消隐期间为高
+    parameter integer CLK_PER_US = 250,      // axi_aclk 每 us 的周期数
+    parameter integer TIMEOUT_US = 200000    // 200ms 内没有帧 -> 无信号
+) (
+    // 视频域
+    input  wire         vid_clk,
+    input  wire         vid_rst_n,
+    input  wire         vid_vsync,
+    input  wire         vid_de,
+
+    // AXI 域
+    input  wire         axi_aclk,
+    input  wire         axi_aresetn,
+
+    output reg  [31:0]  sts_vid_res,         // {height[15:0], width[15:0]}，0 = 无信号
+    output reg  [31:0]  sts_frame_period     // 帧周期（us），0 = 无信号
+);
+
+    //--------------------------------------------------------------------------
+    // 视频域：宽/高计数
+    //--------------------------------------------------------------------------
+    reg        vs_d1;
+    reg        de_d1;
+    reg [15:0] pix_cnt;        // 当前行 DE 像素数
+    reg [15:0] line_width;     // 本帧第一行的宽度
+    reg [15:0] line_cnt;       // 本帧 DE 行数
+    reg [15:0] meas_width;
+    reg [15:0] meas_height;
+    reg        meas_tgl;
+
+    wire vs_act = VS_POL ? vid_vsync : ~vid_vsync;
+    wire vs_act_d1 = VS_POL ? vs_d1 : ~vs_d1;
+    wire vs_start = vs_act && !vs_act_d1;
+    wire de_fall = !vid_de && de_d1;
+
+    always @(posedge vid_clk or negedge vid_rst_n) begin
+        if (!vid_rst_n) begin
+            vs_d1       <= 1'b0;
+            de_d1       <= 1'b0;
+            pix_cnt     <= 16'd0;
+            line_width  <= 16'd0;
+            line_cnt    <= 16'd0;
+            meas_width  <= 16'd0;
+            meas_height <= 16'd0;
+            meas_tgl    <= 1'b0;
+        end else begin
+            vs_d1 <= vid_vsync;
+            de_d1 <= vid_de;
+
+            if (vid_de) begin
+                if (pix_cnt != 16'hFFFF)
+                    pix_cnt <= pix_cnt + 1'b1;
+            end else if (de_fall) begin
+                pix_cnt <= 16'd0;
+                if (line_cnt == 16'd0)
+                    line_width <= pix_cnt;
+                if (line_cnt != 16'hFFFF)
+                    line_cnt <= line_cnt + 1'b1;
+            end
+
+            // 帧边界：锁存上一帧，翻转 toggle 通知 AXI 域
+            if (vs_start) begin
+                meas_width  <= line_width;
+                meas_height <= line_cnt;
+                meas_tgl    <= ~meas_tgl;
+                line_cnt    <= 16'd0;
+                line_width  <= 16'd0;
+            end
+        end
+    end
+
+    //--------------------------------------------------------------------------
+    // AXI 域：toggle 同步 + 帧周期
+    //--------------------------------------------------------------------------
+    (* ASYNC_REG = "TRUE" *) reg tgl_sync1, tgl_sync2;
+    reg        tgl_sync3;
+    reg [7:0]  us_div;
+    reg [31:0] us_cnt;         // 距上一次帧边界的 us 数
+    reg        have_edge;      // 已经见过至少一次帧边界（第一次的周期不可信）
+
+    wire frame_edge = tgl_sync2 ^ tgl_sync3;
+    wire us_tick = (us_div == CLK_PER_US - 1);
+
+    always @(posedge axi_aclk or negedge axi_aresetn) begin
+        if (!axi_aresetn) begin
+            tgl_sync1        <= 1'b0;
+            tgl_sync2        <= 1'b0;
+            tgl_sync3        <= 1'b0;
+            us_div           <= 8'd0;
+            us_cnt           <= 32'd0;
+            have_edge        <= 1'b0;
+            sts_vid_res      <= 32'd0;
+            sts_frame_period <= 32'd0;
+        end else begin
+            tgl_sync1 <= meas_tgl;
+            tgl_sync2 <= tgl_sync1;
+            tgl_sync3 <= tgl_sync2;
+
+            us_div <= us_tick ? 8'd0 : us_div + 1'b1;
+
+            if (frame_edge) begin
+                // toggle 翻转时视频域的 meas_* 已稳定一帧，直接采样
+                sts_vid_res <= {meas_height, meas_width};
+                if (have_edge)
+                    sts_frame_period <= us_cnt;
+                have_edge <= 1'b1;
+                us_cnt    <= 32'd0;
+            end else if (us_tick) begin
+                if (us_cnt >= TIMEOUT_US) begin
+                    sts_vid_res      <= 32'd0;
+                    sts_frame_period <= 32'd0;
+                    have_edge        <= 1'b0;
+                end else begin
+                    us_cnt <= us_cnt + 1'b1;
+                end
+            end
+        end
+    end
+
+endmodule
@@ -290,6 +290,10 @@ module video_cap_top_pcie (
     // Register Bank
     //==========================================================================
     
+    // 输入时序测量结果（video_timing_meas 输出，见下文）
+    wire [31:0] sts_vid_res;
+    wire [31:0] sts_frame_period;
+
     register_bank u_register_bank (
         .aclk               (axi_aclk),
         .aresetn            (axi_aresetn),
@@ -324,6 +328,10 @@ module video_cap_top_pcie (
         .sts_mig_calib      (1'b1),
         .sts_fifo_overflow  (sts_fifo_overflow),
         .sts_pcie_link_up   (user_lnk_up),
+
+        // Measured input timing
+        .sts_vid_res        (sts_vid_res),
+        .sts_frame_period   (sts_frame_period),
         
         // Interrupts (not used - we use our own interrupt logic)
         .irq_frame_done     (),    // Unused - see VSYNC interrupt logic
@@ -386,6 +394,27 @@ module video_cap_top_pcie (
     
     // 组合 RGB 数据为 24-bit
     assign vid_data = {vid_rgb_r, vid_rgb_g, vid_rgb_b};
+
+    //==========================================================================
+    // 输入时序测量：宽/高/帧周期 -> REG_VID_RES / REG_VID_PERIOD
+    // 高度同时给 bridge 作为每帧行数（分辨率变了不用重新综合）
+    //==========================================================================
+
+    video_timing_meas #(
+        .VS_POL     (1),        // 与 SOF 检测一致：VSYNC 消隐期间为高
+        .CLK_PER_US (250)       // axi_aclk ~250MHz
+    ) u_video_timing_meas (
+        .vid_clk          (vid_pixel_clk),
+        .vid_rst_n        (vid_pixel_clk_locked),
+        .vid_vsync        (vid_vsync),
+        .vid_de           (vid_de),
+
+        .axi_aclk         (axi_aclk),
+        .axi_aresetn      (axi_aresetn),
+
+        .sts_vid_res      (sts_vid_res),
+        .sts_frame_period (sts_frame_period)
+    );
     
     //==========================================================================
     // 自定义 SOF (Start of Frame) 检测
@@ -903,6 +932,8 @@ module video_cap_top_pcie (
         .ctrl_enable        (ctrl_enable),
         .ctrl_soft_reset    (ctrl_soft_reset),
 
+        .frame_lines        (sts_vid_res[27:16]),
+
         .vid_vsync          (vid_vsync),
 
         .axis_pix_tdata     (axis_pix_tdata),